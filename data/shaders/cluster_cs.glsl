@@ -0,0 +1,168 @@
+#version 450
+
+// Must match the group size in ClusterCulling::recordCommands
+layout(local_size_x = 64) in;
+
+// VkDrawIndexedIndirectCommand
+struct DrawCommand
+{
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+};
+
+// Object space bounds of a meshlet, see Meshlet
+struct ClusterData
+{
+	vec4 boundingSphere;
+	vec4 cone;
+	uint firstIndex;
+	uint indexCount;
+	int vertexOffset;
+	uint padding;
+};
+
+struct BatchData
+{
+	uint firstSlot;
+	uint slotCount;
+	uint firstCluster;
+	uint clusterCount;
+	uint firstInstance;
+};
+
+layout(set = 0, binding = 0) uniform CameraData
+{
+	mat4 viewProjection;
+	vec4 frustumPlanes[6];
+	vec4 position;
+} camera;
+
+layout(set = 0, binding = 1) readonly buffer Clusters
+{
+	ClusterData clusters[];
+};
+
+layout(set = 0, binding = 2) readonly buffer Batches
+{
+	BatchData batches[];
+};
+
+layout(set = 0, binding = 3) readonly buffer InstanceData
+{
+	mat4 modelMatrices[];
+} instances;
+
+layout(set = 0, binding = 4) writeonly buffer DrawCommands
+{
+	DrawCommand draws[];
+};
+
+layout(set = 0, binding = 5) writeonly buffer VisibleInstances
+{
+	uint visibleInstances[];
+};
+
+layout(set = 0, binding = 6) buffer Statistics
+{
+	uint visibleCount;
+	uint frustumCulledCount;
+	uint backfaceCulledCount;
+	uint padding;
+} statistics;
+
+layout(push_constant) uniform PushConstants
+{
+	uint slotCount;
+	uint batchCount;
+} pushConstants;
+
+bool isInsideFrustum(vec4 sphere)
+{
+	bool inside = true;
+	for (int i = 0; i < 6; i++)
+	{
+		vec4 plane = camera.frustumPlanes[i];
+		inside = inside && dot(plane.xyz, sphere.xyz) + plane.w > -sphere.w;
+	}
+
+	return inside;
+}
+
+// Last batch starting at or before the slot
+uint findBatch(uint slot)
+{
+	uint low = 0;
+	uint high = pushConstants.batchCount - 1;
+	while (low < high)
+	{
+		uint middle = (low + high + 1) / 2;
+		if (batches[middle].firstSlot <= slot)
+			low = middle;
+		else
+			high = middle - 1;
+	}
+
+	return low;
+}
+
+void main()
+{
+	uint slot = gl_GlobalInvocationID.x;
+	if (slot >= pushConstants.slotCount)
+		return;
+
+	BatchData batch = batches[findBatch(slot)];
+	uint localSlot = slot - batch.firstSlot;
+	uint transformIndex = batch.firstInstance + localSlot / batch.clusterCount;
+	ClusterData cluster =
+		clusters[batch.firstCluster + localSlot % batch.clusterCount];
+	mat4 modelMatrix = instances.modelMatrices[transformIndex];
+
+	vec3 scales = vec3(length(modelMatrix[0].xyz), length(modelMatrix[1].xyz),
+					   length(modelMatrix[2].xyz));
+	float maxScale = max(scales.x, max(scales.y, scales.z));
+	vec4 sphere = vec4((modelMatrix * vec4(cluster.boundingSphere.xyz, 1.0)).xyz,
+					   cluster.boundingSphere.w * maxScale);
+
+	bool visible = isInsideFrustum(sphere);
+	if (!visible)
+	{
+		atomicAdd(statistics.frustumCulledCount, 1u);
+	}
+	else
+	{
+		// Normals only stay within the cone under rotation and uniform
+		// scaling without mirroring
+		float minScale = min(scales.x, min(scales.y, scales.z));
+		bool coneValid = cluster.cone.w < 1.0 &&
+						 maxScale - minScale <= 1e-3 * maxScale &&
+						 determinant(mat3(modelMatrix)) > 0.0;
+		if (coneValid)
+		{
+			vec3 axis = normalize(mat3(modelMatrix) * cluster.cone.xyz);
+			vec3 toCluster = sphere.xyz - camera.position.xyz;
+			if (dot(toCluster, axis) >=
+				cluster.cone.w * length(toCluster) + sphere.w)
+			{
+				visible = false;
+				atomicAdd(statistics.backfaceCulledCount, 1u);
+			}
+		}
+	}
+
+	if (visible)
+		atomicAdd(statistics.visibleCount, 1u);
+
+	// The vertex shader finds the model matrix through firstInstance
+	DrawCommand draw;
+	draw.indexCount = cluster.indexCount;
+	draw.instanceCount = visible ? 1u : 0u;
+	draw.firstIndex = cluster.firstIndex;
+	draw.vertexOffset = cluster.vertexOffset;
+	draw.firstInstance = slot;
+	draws[slot] = draw;
+	visibleInstances[slot] = transformIndex;
+}
@@ -0,0 +1,218 @@
+#version 450
+
+// Must match the group size in GpuCulling::recordCommands
+layout(local_size_x = 64) in;
+
+// VkDrawIndexedIndirectCommand
+struct DrawCommand
+{
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+};
+
+struct ObjectData
+{
+	vec4 boundingSphere;
+	uint firstDraw;
+	uint lodCount;
+	uint transformIndex;
+	uint firstInstance;
+	float lodScale;
+	uint padding0;
+	uint padding1;
+	uint padding2;
+};
+
+layout(set = 0, binding = 0) uniform CameraData
+{
+	mat4 viewProjection;
+	vec4 frustumPlanes[6];
+	vec4 position;
+	// Pixels per world unit at distance one, largest error in pixels
+	vec4 lod;
+} camera;
+
+layout(set = 0, binding = 1) readonly buffer Objects
+{
+	ObjectData objects[];
+};
+
+layout(set = 0, binding = 2) buffer DrawCommands
+{
+	DrawCommand draws[];
+};
+
+layout(set = 0, binding = 3) writeonly buffer VisibleInstances
+{
+	uint visibleInstances[];
+};
+
+layout(set = 0, binding = 4) buffer Statistics
+{
+	uint visibleCount;
+	uint firstPhaseCount;
+	uint secondPhaseCount;
+	uint occludedCount;
+} statistics;
+
+// Farthest depth of the area each texel covers
+layout(set = 0, binding = 5) uniform sampler2D hiZPyramid;
+
+layout(set = 0, binding = 6) buffer Visibility
+{
+	uint visibility[];
+};
+
+// Object space error of the level of each draw
+layout(set = 0, binding = 7) readonly buffer LodErrors
+{
+	float lodErrors[];
+};
+
+layout(push_constant) uniform PushConstants
+{
+	uint objectCount;
+	uint drawCount;
+	uint phase;
+	uint occlusion;
+	uint lodCount;
+} pushConstants;
+
+bool isInsideFrustum(vec4 sphere)
+{
+	bool inside = true;
+	for (int i = 0; i < 6; i++)
+	{
+		vec4 plane = camera.frustumPlanes[i];
+		inside = inside && dot(plane.xyz, sphere.xyz) + plane.w > -sphere.w;
+	}
+
+	return inside;
+}
+
+bool isOccluded(vec4 sphere)
+{
+	// Screen space rectangle and the nearest depth of the box around the
+	// sphere
+	vec2 minUV = vec2(1.0);
+	vec2 maxUV = vec2(0.0);
+	float nearestDepth = 1.0;
+	for (int i = 0; i < 8; i++)
+	{
+		vec3 corner = sphere.xyz + sphere.w * vec3((i & 1) != 0 ? 1.0 : -1.0,
+												   (i & 2) != 0 ? 1.0 : -1.0,
+												   (i & 4) != 0 ? 1.0 : -1.0);
+		vec4 clip = camera.viewProjection * vec4(corner, 1.0);
+		// Crosses the camera plane, no reliable projection
+		if (clip.w <= 0.0)
+			return false;
+
+		vec3 ndc = clip.xyz / clip.w;
+		vec2 uv = ndc.xy * 0.5 + 0.5;
+		minUV = min(minUV, uv);
+		maxUV = max(maxUV, uv);
+		nearestDepth = min(nearestDepth, ndc.z);
+	}
+	minUV = clamp(minUV, 0.0, 1.0);
+	maxUV = clamp(maxUV, 0.0, 1.0);
+
+	// The level where the rectangle covers at most 2x2 texels
+	vec2 size = (maxUV - minUV) * vec2(textureSize(hiZPyramid, 0));
+	float level = ceil(log2(max(max(size.x, size.y), 1.0)));
+
+	float depth = max(max(textureLod(hiZPyramid, minUV, level).r,
+						  textureLod(hiZPyramid, vec2(maxUV.x, minUV.y), level).r),
+					  max(textureLod(hiZPyramid, vec2(minUV.x, maxUV.y), level).r,
+						  textureLod(hiZPyramid, maxUV, level).r));
+
+	return nearestDepth > depth;
+}
+
+// The coarsest level whose error covers at most the threshold in pixels,
+// at the nearest point of the bounding sphere. The errors grow with the
+// level. Same as CpuCulling::selectLod.
+uint selectLod(ObjectData object)
+{
+	float distance = length(object.boundingSphere.xyz - camera.position.xyz) -
+					 object.boundingSphere.w;
+	if (distance <= 0.0)
+		return 0;
+
+	float pixelsPerUnit = camera.lod.x * object.lodScale / distance;
+	uint lod = 0;
+	while (lod + 1 < object.lodCount &&
+		   lodErrors[object.firstDraw + lod + 1] * pixelsPerUnit <= camera.lod.y)
+	{
+		lod++;
+	}
+
+	return lod;
+}
+
+// Each phase has its own instance list per level, where every batch has a
+// range starting from the firstInstance of its objects. The draws of a
+// phase start from drawOffset.
+void appendInstance(ObjectData object, uint drawOffset)
+{
+	uint lod = selectLod(object);
+	uint slot =
+		atomicAdd(draws[drawOffset + object.firstDraw + lod].instanceCount, 1u);
+	uint list = pushConstants.phase * pushConstants.lodCount + lod;
+	visibleInstances[list * pushConstants.objectCount + object.firstInstance +
+					 slot] = object.transformIndex;
+}
+
+void main()
+{
+	uint objectIndex = gl_GlobalInvocationID.x;
+	if (objectIndex >= pushConstants.objectCount)
+		return;
+
+	ObjectData object = objects[objectIndex];
+	bool insideFrustum = isInsideFrustum(object.boundingSphere);
+
+	if (pushConstants.occlusion == 0)
+	{
+		if (insideFrustum)
+		{
+			appendInstance(object, 0);
+			atomicAdd(statistics.visibleCount, 1u);
+			atomicAdd(statistics.firstPhaseCount, 1u);
+		}
+		return;
+	}
+
+	bool wasVisible = visibility[objectIndex] != 0;
+	if (pushConstants.phase == 0)
+	{
+		// Draw what was visible last frame, this is the occluder depth for
+		// the second phase
+		if (wasVisible && insideFrustum)
+		{
+			appendInstance(object, 0);
+			atomicAdd(statistics.firstPhaseCount, 1u);
+		}
+		return;
+	}
+
+	bool visible = insideFrustum && !isOccluded(object.boundingSphere);
+	if (visible)
+	{
+		atomicAdd(statistics.visibleCount, 1u);
+		// Already drawn in the first phase otherwise
+		if (!wasVisible)
+		{
+			appendInstance(object, pushConstants.drawCount);
+			atomicAdd(statistics.secondPhaseCount, 1u);
+		}
+	}
+	else if (insideFrustum)
+	{
+		atomicAdd(statistics.occludedCount, 1u);
+	}
+
+	visibility[objectIndex] = visible ? 1 : 0;
+}
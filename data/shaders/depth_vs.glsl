@@ -0,0 +1,48 @@
+#version 450
+
+// Position only variant of test_vs.glsl for the depth pre-pass. The position
+// must be computed exactly like in test_vs.glsl, or the EQUAL depth test of
+// the main pass fails.
+
+layout(set = 0, binding = 1) readonly buffer InstanceData
+{
+	mat4 modelMatrices[];
+} instances;
+
+layout(set = 0, binding = 2) uniform CameraData
+{
+	mat4 viewProjection;
+	vec4 frustumPlanes[6];
+} camera;
+
+layout(set = 0, binding = 3) readonly buffer VisibleInstances
+{
+	uint visibleInstances[];
+};
+
+// Matches Renderer::DrawConstants
+layout(push_constant) uniform DrawConstants
+{
+	uint firstInstance;
+	uint materialIndex;
+	uvec2 padding;
+	vec4 boundingSphere;
+	// Maps the stored position to object space, see VertexQuantization
+	vec4 positionOffset;
+	vec4 positionScale;
+} drawConstants;
+
+layout(location = 0) in vec3 inPosition;
+
+invariant gl_Position;
+
+void main()
+{
+	uint transformIndex = visibleInstances[drawConstants.firstInstance +
+	                                         uint(gl_InstanceIndex)];
+	vec3 position = drawConstants.positionOffset.xyz +
+					drawConstants.positionScale.xyz * inPosition;
+	gl_Position = camera.viewProjection *
+				  instances.modelMatrices[transformIndex] *
+				  vec4(position, 1.0);
+}
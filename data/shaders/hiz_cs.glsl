@@ -0,0 +1,41 @@
+#version 450
+
+// Must match the group size in HiZPyramid::recordCommands
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(set = 0, binding = 0) uniform sampler2D source;
+layout(set = 0, binding = 1, r32f) uniform writeonly image2D destination;
+
+layout(push_constant) uniform PushConstants
+{
+	ivec2 sourceSize;
+	ivec2 destinationSize;
+} pushConstants;
+
+void main()
+{
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(texel, pushConstants.destinationSize)))
+		return;
+
+	// The source texels covered by this texel. Level 0 does not divide the
+	// depth buffer evenly, so this is up to 3x3 texels there and 2x2 or less
+	// elsewhere.
+	ivec2 sourceSize = pushConstants.sourceSize;
+	ivec2 destinationSize = pushConstants.destinationSize;
+	ivec2 begin = texel * sourceSize / destinationSize;
+	ivec2 end = min(((texel + 1) * sourceSize + destinationSize - 1) /
+						destinationSize,
+					sourceSize);
+
+	float depth = 0.0;
+	for (int y = begin.y; y < end.y; y++)
+	{
+		for (int x = begin.x; x < end.x; x++)
+		{
+			depth = max(depth, texelFetch(source, ivec2(x, y), 0).r);
+		}
+	}
+
+	imageStore(destination, texel, vec4(depth));
+}
@@ -0,0 +1,37 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in VertexData
+{
+	vec2 texCoord;
+} inData;
+
+layout(location = 0) out vec4 fColor;
+
+// Matches Impostors::CaptureConstants
+layout(push_constant) uniform CaptureConstants
+{
+	mat4 viewProjection;
+	uint materialIndex;
+} captureConstants;
+
+layout(set = 0, binding = 0) uniform sampler immutableSampler;
+
+// Texture table indices of the textures of each material
+layout(set = 0, binding = 4) readonly buffer Materials
+{
+	uint materialTextures[];
+};
+
+// Every texture, partially bound
+layout(set = 1, binding = 0) uniform texture2D textures[];
+
+void main()
+{
+	// Same as test_fs.glsl. The atlas is cleared to zero alpha, so the
+	// impostor can tell the mesh from the background.
+	uint colorTexture = materialTextures[captureConstants.materialIndex];
+	fColor = texture(sampler2D(textures[colorTexture], immutableSampler),
+					 inData.texCoord);
+	fColor.a = 1.0;
+}
@@ -0,0 +1,26 @@
+#version 450
+
+// Renders a mesh into one tile of its impostor atlas, see Impostors
+
+// Matches Impostors::CaptureConstants
+layout(push_constant) uniform CaptureConstants
+{
+	mat4 viewProjection;
+	uint materialIndex;
+} captureConstants;
+
+// As stored, the view projection maps them to object space first
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec2 inTexCoord;
+
+layout(location = 0) out VertexData
+{
+	vec2 texCoord;
+} outData;
+
+void main()
+{
+	// Object space, the capture looks at the bounding sphere of the mesh
+	gl_Position = captureConstants.viewProjection * vec4(inPosition, 1.0);
+	outData.texCoord = inTexCoord;
+}
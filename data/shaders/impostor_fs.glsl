@@ -0,0 +1,44 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in VertexData
+{
+	vec2 texCoord;
+	flat vec4 tile;
+} inData;
+
+layout(location = 0) out vec4 fColor;
+
+// Matches Renderer::DrawConstants
+layout(push_constant) uniform DrawConstants
+{
+	uint firstInstance;
+	uint materialIndex;
+} drawConstants;
+
+layout(set = 0, binding = 0) uniform sampler immutableSampler;
+
+// The material of an impostor has only the atlas
+layout(set = 0, binding = 4) readonly buffer Materials
+{
+	uint materialTextures[];
+};
+
+layout(set = 1, binding = 0) uniform texture2D textures[];
+
+// Matches Impostors::s_atlasSize
+const float atlasSize = 512.0;
+
+void main()
+{
+	// Keep the filter from reaching into the neighbouring tiles
+	float halfTexel = 0.5 / atlasSize;
+	vec2 texCoord = clamp(inData.texCoord, inData.tile.xy + halfTexel,
+						  inData.tile.zw - halfTexel);
+
+	uint atlas = materialTextures[drawConstants.materialIndex];
+	fColor = texture(sampler2D(textures[atlas], immutableSampler), texCoord);
+	if (fColor.a < 0.5)
+		discard;
+	fColor.a = 1.0;
+}
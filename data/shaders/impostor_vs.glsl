@@ -0,0 +1,102 @@
+#version 450
+
+// Camera facing quad of a distant instance, see Impostors. The quad is in
+// the plane of the atlas tile nearest to the camera direction, so it matches
+// the capture of the tile.
+
+layout(set = 0, binding = 1) readonly buffer InstanceData
+{
+	mat4 modelMatrices[];
+} instances;
+
+layout(set = 0, binding = 2) uniform CameraData
+{
+	mat4 viewProjection;
+	vec4 frustumPlanes[6];
+	vec4 position;
+} camera;
+
+layout(set = 0, binding = 3) readonly buffer VisibleInstances
+{
+	uint visibleInstances[];
+};
+
+// Matches Renderer::DrawConstants
+layout(push_constant) uniform DrawConstants
+{
+	uint firstInstance;
+	uint materialIndex;
+	uvec2 padding;
+	// Object space bounding sphere of the mesh
+	vec4 boundingSphere;
+} drawConstants;
+
+// Matches Impostors::s_gridSize
+const float gridSize = 8.0;
+
+// Corner of the quad in xy, in [-1, 1]
+layout(location = 0) in vec3 inPosition;
+
+layout(location = 0) out VertexData
+{
+	vec2 texCoord;
+	// Atlas coordinates of the tile, min in xy and max in zw
+	flat vec4 tile;
+} outData;
+
+vec2 signNotZero(vec2 v)
+{
+	return vec2(v.x < 0.0 ? -1.0 : 1.0, v.y < 0.0 ? -1.0 : 1.0);
+}
+
+vec2 octEncode(vec3 direction)
+{
+	direction /= abs(direction.x) + abs(direction.y) + abs(direction.z);
+	vec2 point = direction.xy;
+	if (direction.z < 0.0)
+		point = (1.0 - abs(point.yx)) * signNotZero(point);
+	return point;
+}
+
+// Same as octDecode of impostor.cpp
+vec3 octDecode(vec2 point)
+{
+	vec3 direction = vec3(point, 1.0 - abs(point.x) - abs(point.y));
+	if (direction.z < 0.0)
+		direction.xy = (1.0 - abs(point.yx)) * signNotZero(point);
+	return normalize(direction);
+}
+
+void main()
+{
+	uint transformIndex = visibleInstances[drawConstants.firstInstance +
+										   uint(gl_InstanceIndex)];
+	mat4 model = instances.modelMatrices[transformIndex];
+	vec3 center = drawConstants.boundingSphere.xyz;
+	float radius = drawConstants.boundingSphere.w;
+
+	// The camera in object space picks the tile
+	vec3 eye = (inverse(model) * vec4(camera.position.xyz, 1.0)).xyz;
+	vec3 toEye = eye - center;
+	if (dot(toEye, toEye) == 0.0)
+		toEye = vec3(0.0, 0.0, 1.0);
+	vec2 cell = clamp(floor((octEncode(toEye) * 0.5 + 0.5) * gridSize),
+					  vec2(0.0), vec2(gridSize - 1.0));
+	vec3 direction = octDecode((cell + 0.5) / gridSize * 2.0 - 1.0);
+
+	// Same basis as getCaptureMatrix of impostor.cpp
+	vec3 worldUp = abs(direction.z) > 0.99 ? vec3(0.0, 1.0, 0.0)
+										   : vec3(0.0, 0.0, 1.0);
+	vec3 right = normalize(cross(worldUp, direction));
+	vec3 up = cross(direction, right);
+
+	vec3 position = center + radius * (inPosition.x * right +
+									   inPosition.y * up);
+	gl_Position = camera.viewProjection * model * vec4(position, 1.0);
+
+	// The tile is upright, its top row is at the top of the quad
+	outData.texCoord =
+		(cell + vec2(0.5 + 0.5 * inPosition.x, 0.5 - 0.5 * inPosition.y)) /
+		gridSize;
+	outData.tile = vec4(cell, cell + 1.0) / gridSize;
+}
@@ -1,18 +1,36 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout(location = 0) in VertexData
 {
-	vec3 color;
 	vec2 texCoord;
 } inData;
 
 layout(location = 0) out vec4 fColor;
 
+// Matches Renderer::DrawConstants
+layout(push_constant) uniform DrawConstants
+{
+	uint firstInstance;
+	uint materialIndex;
+} drawConstants;
+
 layout(set = 0, binding = 0) uniform sampler immutableSampler;
-layout(set = 1, binding = 1) uniform texture2D colorTexture;
+
+// Texture table indices of the textures of each material
+layout(set = 0, binding = 4) readonly buffer Materials
+{
+	uint materialTextures[];
+};
+
+// Every texture, partially bound
+layout(set = 1, binding = 0) uniform texture2D textures[];
 
 void main()
 {
-    fColor = texture(sampler2D(colorTexture, immutableSampler), inData.texCoord);
-	//fColor = vec4(ubo.model[0]);
-}
\ No newline at end of file
+	// The material is the same for the whole draw, so the index is
+	// dynamically uniform
+	uint colorTexture = materialTextures[drawConstants.materialIndex];
+	fColor = texture(sampler2D(textures[colorTexture], immutableSampler),
+					 inData.texCoord);
+}
@@ -1,23 +1,55 @@
 #version 450
 
-layout(set = 1, binding = 0) uniform UniformBufferObject
+layout(set = 0, binding = 1) readonly buffer InstanceData
 {
-	mat4 mvp;
-} ubo;
+	mat4 modelMatrices[];
+} instances;
 
+layout(set = 0, binding = 2) uniform CameraData
+{
+	mat4 viewProjection;
+	vec4 frustumPlanes[6];
+} camera;
+
+layout(set = 0, binding = 3) readonly buffer VisibleInstances
+{
+	uint visibleInstances[];
+};
+
+// Matches Renderer::DrawConstants
+layout(push_constant) uniform DrawConstants
+{
+	uint firstInstance;
+	uint materialIndex;
+	uvec2 padding;
+	vec4 boundingSphere;
+	// Maps the stored position to object space, see VertexQuantization
+	vec4 positionOffset;
+	vec4 positionScale;
+} drawConstants;
+
+// 16 bit snorm or float, see VertexFormat
 layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inColor;
-layout(location = 2) in vec2 inTexCoord;
+layout(location = 1) in vec2 inTexCoord;
 
 layout(location = 0) out VertexData
 {
-	vec3 color;
 	vec2 texCoord;
 } outData;
 
+// Matches the depth pre-pass bit for bit
+invariant gl_Position;
+
 void main()
 {
-    gl_Position = ubo.mvp * vec4(inPosition, 1.0);
-	outData.color = inColor;
+    // Batch draws start from instance zero, see DrawConstants. Cluster draws
+    // start from their slot and push zero.
+    uint transformIndex = visibleInstances[drawConstants.firstInstance +
+                                             uint(gl_InstanceIndex)];
+    vec3 position = drawConstants.positionOffset.xyz +
+                    drawConstants.positionScale.xyz * inPosition;
+    gl_Position = camera.viewProjection *
+                  instances.modelMatrices[transformIndex] *
+                  vec4(position, 1.0);
 	outData.texCoord = inTexCoord;
-}
\ No newline at end of file
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "headers.h"
+
+namespace vulkan_proto {
+// A device local buffer and the host visible staging buffer used to fill it
+struct Buffer {
+    VkDescriptorBufferInfo descriptor = {};
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+};
+} // namespace vulkan_proto
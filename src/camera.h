@@ -7,6 +7,18 @@ namespace vulkan_proto {
 struct Renderer;
 struct Logger;
 
+// Matches CameraData of the shaders, std140
+struct CameraData {
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    // Inward facing, see Frustum
+    std::array<glm::vec4, 6> frustumPlanes = {};
+    // World space, w is unused
+    glm::vec4 position = glm::vec4(0.0f);
+    // Level of detail selection. x is the height in pixels of one world unit
+    // at distance one, y the largest error in pixels a level may have.
+    glm::vec4 lod = glm::vec4(0.0f);
+};
+
 struct Camera {
     const Renderer &m_renderer;
 
@@ -0,0 +1,243 @@
+#include "cluster_culling.h"
+#include "renderer.h"
+
+namespace vulkan_proto {
+ClusterCulling::ClusterCulling(Renderer &renderer)
+    : m_renderer(renderer), m_pipeline(renderer) {}
+ClusterCulling::~ClusterCulling() {}
+
+void ClusterCulling::create(const std::vector<Cluster> &clusters,
+                            const std::vector<Batch> &batches,
+                            const VkDescriptorBufferInfo &cameraBuffer,
+                            const VkDescriptorBufferInfo &instanceBuffer) {
+    LOG("=Create cluster culling=");
+    THROW_IF(clusters.empty() || batches.empty(), "Nothing to cull");
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_renderer.getPhysicalDevice(), &properties);
+    for (const auto &batch : batches) {
+        THROW_IF(batch.slotCount > properties.limits.maxDrawIndirectCount,
+                 "A batch has %u clusters, at most %u can be drawn at once",
+                 batch.slotCount, properties.limits.maxDrawIndirectCount);
+    }
+
+    m_enabled = true;
+    m_batches = batches;
+    m_slotCount = batches.back().firstSlot + batches.back().slotCount;
+
+    const VkDeviceSize clustersSize = sizeof(clusters[0]) * clusters.size();
+    m_renderer.createStagedBuffer(
+        clustersSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, m_clusterBuffer);
+    m_renderer.copyCPUToGPU(reinterpret_cast<const void *>(clusters.data()),
+                            clustersSize, m_clusterBuffer.stagingMemory,
+                            m_clusterBuffer.stagingBuffer,
+                            m_clusterBuffer.buffer);
+
+    const VkDeviceSize batchesSize = sizeof(batches[0]) * batches.size();
+    m_renderer.createStagedBuffer(batchesSize,
+                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                  m_batchBuffer);
+    m_renderer.copyCPUToGPU(reinterpret_cast<const void *>(batches.data()),
+                            batchesSize, m_batchBuffer.stagingMemory,
+                            m_batchBuffer.stagingBuffer, m_batchBuffer.buffer);
+
+    // Every slot is written by the shader each frame
+    m_renderer.createStagedBuffer(
+        sizeof(VkDrawIndexedIndirectCommand) * m_slotCount,
+        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        m_drawCommandBuffer);
+    m_renderer.createStagedBuffer(sizeof(uint32_t) * m_slotCount,
+                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                  m_visibleInstanceBuffer);
+
+    m_renderer.createBuffer(sizeof(Statistics),
+                            VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                            m_statisticsBuffer, m_statisticsMemory);
+
+    createDescriptors(cameraBuffer, instanceBuffer);
+
+    // slotCount & batchCount of cluster_cs.glsl
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = 2 * sizeof(uint32_t);
+
+    m_pipeline.create(
+        m_renderer.getProgramInput().at("compute_shaders").at("cluster"),
+        {m_descriptorSetLayout}, {pushConstantRange});
+
+    LOG("%zu clusters in %zu batches, %u cluster slots", clusters.size(),
+        batches.size(), m_slotCount);
+}
+
+void ClusterCulling::destroy() {
+    LOG("=Destroy cluster culling=");
+    m_pipeline.destroy();
+
+    // The layout & the set are owned by the descriptor allocator
+    m_descriptorSetLayout = VK_NULL_HANDLE;
+    m_descriptorSet = VK_NULL_HANDLE;
+
+    vkDestroyBuffer(m_renderer.getDevice(), m_statisticsBuffer,
+                    m_renderer.getAllocator());
+    vkFreeMemory(m_renderer.getDevice(), m_statisticsMemory,
+                 m_renderer.getAllocator());
+    m_statisticsBuffer = VK_NULL_HANDLE;
+    m_statisticsMemory = VK_NULL_HANDLE;
+
+    m_renderer.destroyStagedBuffer(m_clusterBuffer);
+    m_renderer.destroyStagedBuffer(m_batchBuffer);
+    m_renderer.destroyStagedBuffer(m_drawCommandBuffer);
+    m_renderer.destroyStagedBuffer(m_visibleInstanceBuffer);
+
+    m_enabled = false;
+    m_slotCount = 0;
+    m_batches.clear();
+}
+
+void ClusterCulling::recordCommands(VkCommandBuffer commandBuffer) const {
+    if (m_enabled == false) {
+        return;
+    }
+
+    // The previous frame must be done reading the draw commands and the
+    // instance list before they are overwritten
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                             VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT |
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 0, nullptr, 0, nullptr, 0, nullptr);
+    vkCmdFillBuffer(commandBuffer, m_statisticsBuffer, 0, sizeof(Statistics),
+                    0);
+
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask =
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier,
+                         0, nullptr, 0, nullptr);
+
+    const uint32_t pushConstants[2] = {
+        m_slotCount, static_cast<uint32_t>(m_batches.size())};
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      m_pipeline.m_handle);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            m_pipeline.m_layout, 0, 1, &m_descriptorSet, 0,
+                            nullptr);
+    vkCmdPushConstants(commandBuffer, m_pipeline.m_layout,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants),
+                       pushConstants);
+    // Must match local_size_x of the shader
+    const uint32_t groupSize = 64;
+    vkCmdDispatch(commandBuffer, (m_slotCount + groupSize - 1) / groupSize, 1,
+                  1);
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask =
+        VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                             VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0,
+                         nullptr, 0, nullptr);
+}
+
+void ClusterCulling::recordDraws(VkCommandBuffer commandBuffer,
+                                 uint32_t batchIndex) const {
+    const Batch &batch = m_batches[batchIndex];
+    vkCmdDrawIndexedIndirect(commandBuffer, m_drawCommandBuffer.buffer,
+                             batch.firstSlot *
+                                 sizeof(VkDrawIndexedIndirectCommand),
+                             batch.slotCount,
+                             sizeof(VkDrawIndexedIndirectCommand));
+}
+
+ClusterCulling::Statistics ClusterCulling::getStatistics() const {
+    // Only valid once the last submitted frame has finished
+    Statistics statistics;
+    void *data = nullptr;
+    VK_CHECK(vkMapMemory(m_renderer.getDevice(), m_statisticsMemory, 0,
+                         sizeof(Statistics), 0, &data));
+    memcpy(&statistics, data, sizeof(statistics));
+    vkUnmapMemory(m_renderer.getDevice(), m_statisticsMemory);
+
+    return statistics;
+}
+
+void ClusterCulling::createDescriptors(
+    const VkDescriptorBufferInfo &cameraBuffer,
+    const VkDescriptorBufferInfo &instanceBuffer) {
+    // Camera
+    // layout (set = 0, binding = 0)
+    // Clusters, batches & model matrices
+    // layout (set = 0, binding = 1..3)
+    // Draw commands, visible instances & statistics
+    // layout (set = 0, binding = 4..6)
+    std::array<VkDescriptorSetLayoutBinding, 7> bindings;
+    for (uint32_t i = 0; i < static_cast<uint32_t>(bindings.size()); i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[i].pImmutableSamplers = nullptr;
+    }
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = {};
+    descriptorSetLayoutCI.sType =
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptorSetLayoutCI.bindingCount = static_cast<uint32_t>(bindings.size());
+    descriptorSetLayoutCI.pBindings = bindings.data();
+
+    DescriptorAllocator &descriptorAllocator =
+        m_renderer.getDescriptorAllocator();
+    m_descriptorSetLayout =
+        descriptorAllocator.getLayout(descriptorSetLayoutCI);
+    m_descriptorSet = descriptorAllocator.allocate(m_descriptorSetLayout);
+
+    VkDescriptorBufferInfo statisticsInfo = {};
+    statisticsInfo.buffer = m_statisticsBuffer;
+    statisticsInfo.offset = 0;
+    statisticsInfo.range = sizeof(Statistics);
+
+    // Every binding is a buffer, so the infos are packed in binding order
+    const std::array<VkDescriptorBufferInfo, 7> descriptors = {
+        cameraBuffer,
+        m_clusterBuffer.descriptor,
+        m_batchBuffer.descriptor,
+        instanceBuffer,
+        m_drawCommandBuffer.descriptor,
+        m_visibleInstanceBuffer.descriptor,
+        statisticsInfo};
+
+    std::vector<VkDescriptorUpdateTemplateEntry> entries(bindings.size());
+    for (uint32_t i = 0; i < static_cast<uint32_t>(entries.size()); i++) {
+        entries[i].dstBinding = i;
+        entries[i].dstArrayElement = 0;
+        entries[i].descriptorCount = 1;
+        entries[i].descriptorType = bindings[i].descriptorType;
+        entries[i].offset = i * sizeof(VkDescriptorBufferInfo);
+        entries[i].stride = 0;
+    }
+
+    vkUpdateDescriptorSetWithTemplate(
+        m_renderer.getDevice(), m_descriptorSet,
+        descriptorAllocator.getUpdateTemplate(m_descriptorSetLayout, entries),
+        descriptors.data());
+}
+
+Logger &ClusterCulling::getLogger() { return m_renderer.getLogger(); }
+} // namespace vulkan_proto
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "buffer.h"
+#include "compute_pipeline.h"
+#include "headers.h"
+
+namespace vulkan_proto {
+
+struct Renderer;
+struct Logger;
+
+// Culls the meshlets of every instance on the GPU, against the view frustum
+// and by their normal cones, so a partly visible mesh only costs its visible
+// clusters. Every meshlet of every instance has a fixed slot with its own
+// draw command. The shader fills the slot with the meshlet when it is
+// visible, and with zero instances when it is not. The slots of a batch are
+// contiguous, so a batch is drawn with one multi draw indirect call.
+//
+// The firstInstance of each command is its slot, where the visible instance
+// list holds the model matrix index of the slot.
+struct ClusterCulling {
+    // Matches ClusterData of cluster_cs.glsl, std430
+    struct Cluster {
+        // Object space, see Meshlet
+        glm::vec4 boundingSphere = glm::vec4(0.0f);
+        glm::vec4 cone = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        // In the geometry pool
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        int32_t vertexOffset = 0;
+        uint32_t padding = 0;
+    };
+
+    // Matches BatchData of cluster_cs.glsl, std430. The slots of a batch are
+    // the clusters of its first instance, then of the second and so on.
+    struct Batch {
+        uint32_t firstSlot = 0;
+        uint32_t slotCount = 0;
+        uint32_t firstCluster = 0;
+        uint32_t clusterCount = 0;
+        // Model matrix index of the first instance
+        uint32_t firstInstance = 0;
+    };
+
+    // Matches Statistics of cluster_cs.glsl
+    struct Statistics {
+        uint32_t visibleCount = 0;
+        uint32_t frustumCulledCount = 0;
+        uint32_t backfaceCulledCount = 0;
+        uint32_t padding = 0;
+    };
+
+    const Renderer &m_renderer;
+    ComputePipeline m_pipeline;
+    bool m_enabled = false;
+
+    uint32_t m_slotCount = 0;
+    std::vector<Batch> m_batches;
+
+    Buffer m_clusterBuffer;
+    Buffer m_batchBuffer;
+    Buffer m_drawCommandBuffer;
+    Buffer m_visibleInstanceBuffer;
+
+    // Host visible Statistics, for logging only
+    VkBuffer m_statisticsBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_statisticsMemory = VK_NULL_HANDLE;
+
+    // From the descriptor allocator
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSet m_descriptorSet = VK_NULL_HANDLE;
+
+    ClusterCulling(Renderer &renderer);
+    ~ClusterCulling();
+    void create(const std::vector<Cluster> &clusters,
+                const std::vector<Batch> &batches,
+                const VkDescriptorBufferInfo &cameraBuffer,
+                const VkDescriptorBufferInfo &instanceBuffer);
+    void destroy();
+    // Must be recorded outside a render pass
+    void recordCommands(VkCommandBuffer commandBuffer) const;
+    // Draws the visible clusters of a batch
+    void recordDraws(VkCommandBuffer commandBuffer, uint32_t batchIndex) const;
+    Statistics getStatistics() const;
+    Logger &getLogger();
+
+  private:
+    void createDescriptors(const VkDescriptorBufferInfo &cameraBuffer,
+                           const VkDescriptorBufferInfo &instanceBuffer);
+};
+} // namespace vulkan_proto
@@ -0,0 +1,66 @@
+#include "compute_pipeline.h"
+#include "renderer.h"
+
+namespace vulkan_proto {
+ComputePipeline::ComputePipeline(Renderer &renderer) : m_renderer(renderer) {}
+ComputePipeline::~ComputePipeline() {}
+
+void ComputePipeline::create(
+    const nlohmann::json &shader,
+    const std::vector<VkDescriptorSetLayout> &setLayouts,
+    const std::vector<VkPushConstantRange> &pushConstantRanges) {
+    LOG("=Create compute pipeline=");
+    VkShaderModule sm =
+        m_renderer.getShaderCompiler().createShaderModuleFromGLSL(
+            std::string(m_renderer.getDataPath() +
+                        shader.at("path").get<std::string>()),
+            EShLangCompute);
+    THROW_IF(sm == VK_NULL_HANDLE,
+             "Shader module is VK_NULL_HANDLE for shader file %s",
+             shader.at("path").get<std::string>().c_str());
+    const std::string entryPoint = shader.at("entryPoint").get<std::string>();
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCI = {};
+    pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCI.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+    pipelineLayoutCI.pSetLayouts = setLayouts.data();
+    pipelineLayoutCI.pushConstantRangeCount =
+        static_cast<uint32_t>(pushConstantRanges.size());
+    pipelineLayoutCI.pPushConstantRanges = pushConstantRanges.data();
+
+    VK_CHECK(vkCreatePipelineLayout(m_renderer.getDevice(), &pipelineLayoutCI,
+                                    m_renderer.getAllocator(), &m_layout));
+
+    VkComputePipelineCreateInfo pipelineCI = {};
+    pipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineCI.stage.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineCI.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineCI.stage.module = sm;
+    pipelineCI.stage.pName = entryPoint.c_str();
+    pipelineCI.stage.pSpecializationInfo = nullptr;
+    pipelineCI.layout = m_layout;
+    pipelineCI.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineCI.basePipelineIndex = -1;
+
+    VK_CHECK(vkCreateComputePipelines(m_renderer.getDevice(), VK_NULL_HANDLE,
+                                      1, &pipelineCI,
+                                      m_renderer.getAllocator(), &m_handle));
+
+    vkDestroyShaderModule(m_renderer.getDevice(), sm,
+                          m_renderer.getAllocator());
+}
+
+void ComputePipeline::destroy() {
+    LOG("=Destroy compute pipeline=");
+    vkDestroyPipelineLayout(m_renderer.getDevice(), m_layout,
+                            m_renderer.getAllocator());
+    vkDestroyPipeline(m_renderer.getDevice(), m_handle,
+                      m_renderer.getAllocator());
+
+    m_layout = VK_NULL_HANDLE;
+    m_handle = VK_NULL_HANDLE;
+}
+
+Logger &ComputePipeline::getLogger() { return m_renderer.getLogger(); }
+} // namespace vulkan_proto
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "headers.h"
+
+namespace vulkan_proto {
+
+struct Renderer;
+struct Logger;
+
+struct ComputePipeline {
+    const Renderer &m_renderer;
+    VkPipeline m_handle = VK_NULL_HANDLE;
+    VkPipelineLayout m_layout = VK_NULL_HANDLE;
+
+    ComputePipeline(Renderer &renderer);
+    ~ComputePipeline();
+    void create(const nlohmann::json &shader,
+                const std::vector<VkDescriptorSetLayout> &setLayouts,
+                const std::vector<VkPushConstantRange> &pushConstantRanges);
+    void destroy();
+    Logger &getLogger();
+};
+} // namespace vulkan_proto
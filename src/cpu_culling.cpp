@@ -0,0 +1,238 @@
+#include "cpu_culling.h"
+#include <algorithm>
+#include <cmath>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace vulkan_proto {
+void CpuCulling::create(const std::vector<GpuCulling::Object> &objects,
+                        const std::vector<glm::vec3> &boxCenters,
+                        const std::vector<glm::vec3> &boxExtents,
+                        const std::vector<VkDrawIndexedIndirectCommand> &draws,
+                        const std::vector<float> &lodErrors) {
+    m_objectCount = static_cast<uint32_t>(objects.size());
+    m_objects = objects;
+    m_draws = draws;
+    m_lodErrors = lodErrors;
+    m_lodCount = 1;
+    for (const auto &object : objects) {
+        m_lodCount = std::max(m_lodCount, object.lodCount);
+    }
+
+    // Padding objects fail every plane test
+    const size_t paddedCount =
+        (objects.size() + s_batchSize - 1) / s_batchSize * s_batchSize;
+    const float lowest = std::numeric_limits<float>::lowest();
+    for (auto *v : {&m_centerX, &m_centerY, &m_centerZ, &m_boxCenterX,
+                    &m_boxCenterY, &m_boxCenterZ}) {
+        v->assign(paddedCount, 0.0f);
+    }
+    for (auto *v : {&m_radius, &m_extentX, &m_extentY, &m_extentZ}) {
+        v->assign(paddedCount, lowest);
+    }
+
+    for (size_t i = 0; i < objects.size(); i++) {
+        const glm::vec4 &sphere = objects[i].boundingSphere;
+        m_centerX[i] = sphere.x;
+        m_centerY[i] = sphere.y;
+        m_centerZ[i] = sphere.z;
+        m_radius[i] = sphere.w;
+
+        m_boxCenterX[i] = boxCenters[i].x;
+        m_boxCenterY[i] = boxCenters[i].y;
+        m_boxCenterZ[i] = boxCenters[i].z;
+        m_extentX[i] = boxExtents[i].x;
+        m_extentY[i] = boxExtents[i].y;
+        m_extentZ[i] = boxExtents[i].z;
+    }
+
+    m_visibleObjects.reserve(m_objectCount);
+}
+
+void CpuCulling::destroy() {
+    for (auto *v : {&m_centerX, &m_centerY, &m_centerZ, &m_radius,
+                    &m_boxCenterX, &m_boxCenterY, &m_boxCenterZ, &m_extentX,
+                    &m_extentY, &m_extentZ}) {
+        v->clear();
+    }
+    m_objects.clear();
+    m_visibleObjects.clear();
+    m_draws.clear();
+    m_lodErrors.clear();
+    m_objectCount = 0;
+    m_lodCount = 1;
+    m_occludedCount = 0;
+}
+
+void CpuCulling::cull(const Frustum &frustum, const CameraData &camera,
+                      const SoftwareOcclusion &occlusion,
+                      std::vector<VkDrawIndexedIndirectCommand> &draws,
+                      std::vector<uint32_t> &visibleInstances) {
+    cullObjects(frustum);
+
+    m_occludedCount = 0;
+    if (occlusion.m_enabled) {
+        const size_t frustumCount = m_visibleObjects.size();
+        m_visibleObjects.erase(
+            std::remove_if(m_visibleObjects.begin(), m_visibleObjects.end(),
+                           [this, &occlusion](uint32_t i) {
+                               return occlusion.isOccluded(
+                                   glm::vec3(m_boxCenterX[i], m_boxCenterY[i],
+                                             m_boxCenterZ[i]),
+                                   glm::vec3(m_extentX[i], m_extentY[i],
+                                             m_extentZ[i]));
+                           }),
+            m_visibleObjects.end());
+        m_occludedCount =
+            static_cast<uint32_t>(frustumCount - m_visibleObjects.size());
+    }
+
+    draws = m_draws;
+    for (auto &draw : draws) {
+        draw.instanceCount = 0;
+    }
+
+    // The slots past the instance count of a batch are not read
+    visibleInstances.resize(m_objectCount * m_lodCount);
+    for (const uint32_t objectIndex : m_visibleObjects) {
+        const GpuCulling::Object &object = m_objects[objectIndex];
+        const uint32_t lod = selectLod(object, camera);
+        auto &draw = draws[object.firstDraw + lod];
+        visibleInstances[lod * m_objectCount + object.firstInstance +
+                         draw.instanceCount++] = object.transformIndex;
+    }
+}
+
+uint32_t CpuCulling::selectLod(const GpuCulling::Object &object,
+                               const CameraData &camera) const {
+    // Nearest point of the bounding sphere
+    const glm::vec3 center(object.boundingSphere.x, object.boundingSphere.y,
+                           object.boundingSphere.z);
+    const glm::vec3 position(camera.position.x, camera.position.y,
+                             camera.position.z);
+    const float distance =
+        glm::length(center - position) - object.boundingSphere.w;
+    if (distance <= 0.0f) {
+        return 0;
+    }
+
+    const float pixelsPerUnit = camera.lod.x * object.lodScale / distance;
+    uint32_t lod = 0;
+    while (lod + 1 < object.lodCount &&
+           m_lodErrors[object.firstDraw + lod + 1] * pixelsPerUnit <=
+               camera.lod.y) {
+        lod++;
+    }
+
+    return lod;
+}
+
+void CpuCulling::cullObjects(const Frustum &frustum) {
+    // An object is visible if both its sphere and its box are at least
+    // partially on the inner side of every plane. The box test uses the
+    // projected radius of the box on the plane normal. A group of objects
+    // stops testing as soon as all of them are outside some plane.
+    m_visibleObjects.clear();
+    const uint32_t paddedCount = static_cast<uint32_t>(m_radius.size());
+
+#if defined(__SSE2__)
+    // Normal, distance & absolute normal of each plane, in every lane
+    __m128 planes[6][7];
+    for (size_t p = 0; p < 6; p++) {
+        const glm::vec4 &plane = frustum.m_planes[p];
+        planes[p][0] = _mm_set1_ps(plane.x);
+        planes[p][1] = _mm_set1_ps(plane.y);
+        planes[p][2] = _mm_set1_ps(plane.z);
+        planes[p][3] = _mm_set1_ps(plane.w);
+        planes[p][4] = _mm_set1_ps(std::abs(plane.x));
+        planes[p][5] = _mm_set1_ps(std::abs(plane.y));
+        planes[p][6] = _mm_set1_ps(std::abs(plane.z));
+    }
+
+    for (uint32_t i = 0; i < paddedCount; i += 4) {
+        const __m128 x = _mm_loadu_ps(&m_centerX[i]);
+        const __m128 y = _mm_loadu_ps(&m_centerY[i]);
+        const __m128 z = _mm_loadu_ps(&m_centerZ[i]);
+        const __m128 negativeRadius =
+            _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&m_radius[i]));
+        const __m128 bx = _mm_loadu_ps(&m_boxCenterX[i]);
+        const __m128 by = _mm_loadu_ps(&m_boxCenterY[i]);
+        const __m128 bz = _mm_loadu_ps(&m_boxCenterZ[i]);
+        const __m128 ex = _mm_loadu_ps(&m_extentX[i]);
+        const __m128 ey = _mm_loadu_ps(&m_extentY[i]);
+        const __m128 ez = _mm_loadu_ps(&m_extentZ[i]);
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (const auto &plane : planes) {
+            const __m128 &a = plane[0];
+            const __m128 &b = plane[1];
+            const __m128 &c = plane[2];
+            const __m128 &d = plane[3];
+
+            __m128 distance =
+                _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, x), _mm_mul_ps(b, y)),
+                           _mm_add_ps(_mm_mul_ps(c, z), d));
+            inside = _mm_and_ps(inside, _mm_cmpgt_ps(distance, negativeRadius));
+
+            distance =
+                _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, bx), _mm_mul_ps(b, by)),
+                           _mm_add_ps(_mm_mul_ps(c, bz), d));
+            const __m128 projectedRadius =
+                _mm_add_ps(_mm_add_ps(_mm_mul_ps(plane[4], ex),
+                                      _mm_mul_ps(plane[5], ey)),
+                           _mm_mul_ps(plane[6], ez));
+            inside = _mm_and_ps(
+                inside, _mm_cmpgt_ps(_mm_add_ps(distance, projectedRadius),
+                                     _mm_setzero_ps()));
+            if (_mm_movemask_ps(inside) == 0) {
+                break;
+            }
+        }
+
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(inside));
+        while (mask != 0) {
+            m_visibleObjects.push_back(i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+#else
+    for (uint32_t i = 0; i < paddedCount; i++) {
+        bool inside = true;
+        for (const auto &plane : frustum.m_planes) {
+            const float sphereDistance = plane.x * m_centerX[i] +
+                                         plane.y * m_centerY[i] +
+                                         plane.z * m_centerZ[i] + plane.w;
+            const float boxDistance = plane.x * m_boxCenterX[i] +
+                                      plane.y * m_boxCenterY[i] +
+                                      plane.z * m_boxCenterZ[i] + plane.w;
+            const float projectedRadius = std::abs(plane.x) * m_extentX[i] +
+                                          std::abs(plane.y) * m_extentY[i] +
+                                          std::abs(plane.z) * m_extentZ[i];
+            inside = inside && sphereDistance > -m_radius[i] &&
+                     boxDistance + projectedRadius > 0.0f;
+        }
+
+        if (inside) {
+            m_visibleObjects.push_back(i);
+        }
+    }
+#endif
+}
+
+void transformBoundingBox(const glm::vec3 &minimum, const glm::vec3 &maximum,
+                          const glm::mat4 &transform, glm::vec3 &center,
+                          glm::vec3 &extent) {
+    // Arvo, the new extent is the local extent projected on each world axis
+    const glm::vec3 localCenter = 0.5f * (minimum + maximum);
+    const glm::vec3 localExtent = 0.5f * (maximum - minimum);
+    const glm::vec4 c = transform * glm::vec4(localCenter.x, localCenter.y,
+                                              localCenter.z, 1.0f);
+    center = glm::vec3(c.x, c.y, c.z);
+    for (int i = 0; i < 3; i++) {
+        extent[i] = std::abs(transform[0][i]) * localExtent.x +
+                    std::abs(transform[1][i]) * localExtent.y +
+                    std::abs(transform[2][i]) * localExtent.z;
+    }
+}
+} // namespace vulkan_proto
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "camera.h"
+#include "frustum.h"
+#include "gpu_culling.h"
+#include "headers.h"
+#include "software_occlusion.h"
+
+namespace vulkan_proto {
+// Frustum culls the instances on the CPU and builds the indirect draw
+// commands of the visible ones. The world space bounds are kept as structure
+// of arrays, so the plane tests run on 4 objects at a time with SSE.
+// The visible objects pick their level of detail like the culling shader.
+struct CpuCulling {
+    // Objects are padded to a multiple of this with bounds that never pass
+    static constexpr uint32_t s_batchSize = 4;
+
+    uint32_t m_objectCount = 0;
+    // Most levels of detail of any object
+    uint32_t m_lodCount = 1;
+    // Inside the frustum but hidden by the occluders in the last cull
+    uint32_t m_occludedCount = 0;
+
+    // Bounding spheres
+    std::vector<float> m_centerX;
+    std::vector<float> m_centerY;
+    std::vector<float> m_centerZ;
+    std::vector<float> m_radius;
+    // Bounding boxes as center and half extents
+    std::vector<float> m_boxCenterX;
+    std::vector<float> m_boxCenterY;
+    std::vector<float> m_boxCenterZ;
+    std::vector<float> m_extentX;
+    std::vector<float> m_extentY;
+    std::vector<float> m_extentZ;
+
+    // The same objects the culling shader gets
+    std::vector<GpuCulling::Object> m_objects;
+    std::vector<uint32_t> m_visibleObjects;
+    // Every level of each batch, instanceCount is overwritten when culling
+    std::vector<VkDrawIndexedIndirectCommand> m_draws;
+    std::vector<float> m_lodErrors;
+
+    // The objects must be sorted by batch, the boxes are in world space
+    void create(const std::vector<GpuCulling::Object> &objects,
+                const std::vector<glm::vec3> &boxCenters,
+                const std::vector<glm::vec3> &boxExtents,
+                const std::vector<VkDrawIndexedIndirectCommand> &draws,
+                const std::vector<float> &lodErrors);
+    void destroy();
+    // Fills the draw commands and the transform indices of the visible
+    // objects, in the same layout the culling shader produces: every level
+    // has an instance list, where every batch has a range starting from the
+    // index of its first object. The objects in the frustum are also tested
+    // against the occluders, if enabled.
+    void cull(const Frustum &frustum, const CameraData &camera,
+              const SoftwareOcclusion &occlusion,
+              std::vector<VkDrawIndexedIndirectCommand> &draws,
+              std::vector<uint32_t> &visibleInstances);
+
+  private:
+    void cullObjects(const Frustum &frustum);
+    // Same as selectLod of cull_cs.glsl
+    uint32_t selectLod(const GpuCulling::Object &object,
+                       const CameraData &camera) const;
+};
+
+// Transforms an axis aligned box and returns the center and half extents of
+// the box around the result
+void transformBoundingBox(const glm::vec3 &minimum, const glm::vec3 &maximum,
+                          const glm::mat4 &transform, glm::vec3 &center,
+                          glm::vec3 &extent);
+} // namespace vulkan_proto
@@ -0,0 +1,349 @@
+#include "descriptor_allocator.h"
+#include "renderer.h"
+#include <algorithm>
+#include <numeric>
+
+namespace {
+// FNV-1a
+void hashCombine(uint64_t &hash, uint64_t value) {
+    for (uint32_t i = 0; i < 8; i++) {
+        hash ^= (value >> (i * 8)) & 0xff;
+        hash *= 1099511628211ull;
+    }
+}
+
+bool isSameEntry(const VkDescriptorUpdateTemplateEntry &a,
+                 const VkDescriptorUpdateTemplateEntry &b) {
+    return a.dstBinding == b.dstBinding &&
+           a.dstArrayElement == b.dstArrayElement &&
+           a.descriptorCount == b.descriptorCount &&
+           a.descriptorType == b.descriptorType && a.offset == b.offset &&
+           a.stride == b.stride;
+}
+
+bool isPoolFull(VkResult result) {
+    return result == VK_ERROR_OUT_OF_POOL_MEMORY ||
+           result == VK_ERROR_FRAGMENTED_POOL;
+}
+} // namespace
+
+namespace vulkan_proto {
+bool DescriptorAllocator::Layout::operator==(const Layout &other) const {
+    if (m_flags != other.m_flags ||
+        m_bindings.size() != other.m_bindings.size() ||
+        m_bindingFlags != other.m_bindingFlags ||
+        m_immutableSamplers != other.m_immutableSamplers) {
+        return false;
+    }
+
+    for (size_t i = 0; i < m_bindings.size(); i++) {
+        const VkDescriptorSetLayoutBinding &a = m_bindings[i];
+        const VkDescriptorSetLayoutBinding &b = other.m_bindings[i];
+        if (a.binding != b.binding || a.descriptorType != b.descriptorType ||
+            a.descriptorCount != b.descriptorCount ||
+            a.stageFlags != b.stageFlags ||
+            (a.pImmutableSamplers == nullptr) !=
+                (b.pImmutableSamplers == nullptr)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+DescriptorAllocator::DescriptorAllocator(Renderer &renderer)
+    : m_renderer(renderer) {}
+DescriptorAllocator::~DescriptorAllocator() {}
+
+void DescriptorAllocator::create() {
+    LOG("=Create descriptor allocator=");
+    m_persistentPools.m_flags = 0;
+    m_updateAfterBindPools.m_flags =
+        VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+    m_swapchainPools.m_flags = 0;
+}
+
+void DescriptorAllocator::destroy() {
+    LOG("=Destroy descriptor allocator, %u pools=", m_poolCount);
+    destroyPools(m_persistentPools);
+    destroyPools(m_updateAfterBindPools);
+    destroyPools(m_swapchainPools);
+
+    for (auto &layout : m_layouts) {
+        for (auto &updateTemplate : layout.m_updateTemplates) {
+            vkDestroyDescriptorUpdateTemplate(m_renderer.getDevice(),
+                                              updateTemplate.m_handle,
+                                              m_renderer.getAllocator());
+        }
+        vkDestroyDescriptorSetLayout(m_renderer.getDevice(), layout.m_handle,
+                                     m_renderer.getAllocator());
+    }
+    m_layouts.clear();
+}
+
+VkDescriptorSetLayout DescriptorAllocator::getLayout(
+    const VkDescriptorSetLayoutCreateInfo &createInfo) {
+    const VkStructureType bindingFlagsType =
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+    const VkDescriptorSetLayoutBindingFlagsCreateInfoEXT *bindingFlagsCi =
+        nullptr;
+    for (auto next = static_cast<const VkBaseInStructure *>(createInfo.pNext);
+         next != nullptr; next = next->pNext) {
+        THROW_IF(next->sType != bindingFlagsType,
+                 "Unsupported structure %d chained to a set layout",
+                 next->sType);
+        bindingFlagsCi = reinterpret_cast<
+            const VkDescriptorSetLayoutBindingFlagsCreateInfoEXT *>(next);
+    }
+    THROW_IF(bindingFlagsCi != nullptr &&
+                 bindingFlagsCi->bindingCount != createInfo.bindingCount,
+             "Binding flag count %u differs from binding count %u",
+             bindingFlagsCi->bindingCount, createInfo.bindingCount);
+
+    // Bindings in any order describe the same layout
+    std::vector<uint32_t> order(createInfo.bindingCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [&createInfo](uint32_t a, uint32_t b) {
+                  return createInfo.pBindings[a].binding <
+                         createInfo.pBindings[b].binding;
+              });
+
+    Layout layout;
+    layout.m_flags = createInfo.flags;
+    uint64_t hash = 14695981039346656037ull;
+    hashCombine(hash, layout.m_flags);
+    for (uint32_t i : order) {
+        VkDescriptorSetLayoutBinding binding = createInfo.pBindings[i];
+        const VkDescriptorBindingFlagsEXT flags =
+            bindingFlagsCi != nullptr ? bindingFlagsCi->pBindingFlags[i] : 0;
+
+        hashCombine(hash, binding.binding);
+        hashCombine(hash, binding.descriptorType);
+        hashCombine(hash, binding.descriptorCount);
+        hashCombine(hash, binding.stageFlags);
+        hashCombine(hash, flags);
+        if (binding.pImmutableSamplers != nullptr) {
+            for (uint32_t j = 0; j < binding.descriptorCount; j++) {
+                const VkSampler sampler = binding.pImmutableSamplers[j];
+                uint64_t handle = 0;
+                std::memcpy(&handle, &sampler, sizeof(sampler));
+                hashCombine(hash, handle);
+                layout.m_immutableSamplers.push_back(sampler);
+            }
+        }
+
+        layout.m_bindings.push_back(binding);
+        layout.m_bindingFlags.push_back(flags);
+    }
+    layout.m_hash = hash;
+
+    for (const auto &cached : m_layouts) {
+        if (cached.m_hash == layout.m_hash && cached == layout) {
+            return cached.m_handle;
+        }
+    }
+
+    VK_CHECK(vkCreateDescriptorSetLayout(m_renderer.getDevice(), &createInfo,
+                                         m_renderer.getAllocator(),
+                                         &layout.m_handle));
+    // Point to the copied samplers instead of the caller's
+    size_t samplerOffset = 0;
+    for (auto &binding : layout.m_bindings) {
+        if (binding.pImmutableSamplers != nullptr) {
+            binding.pImmutableSamplers =
+                layout.m_immutableSamplers.data() + samplerOffset;
+            samplerOffset += binding.descriptorCount;
+        }
+    }
+    m_layouts.push_back(std::move(layout));
+
+    return m_layouts.back().m_handle;
+}
+
+VkDescriptorUpdateTemplate DescriptorAllocator::getUpdateTemplate(
+    VkDescriptorSetLayout layout,
+    const std::vector<VkDescriptorUpdateTemplateEntry> &entries) {
+    Layout &cached = findLayout(layout);
+    for (const auto &updateTemplate : cached.m_updateTemplates) {
+        if (std::equal(updateTemplate.m_entries.begin(),
+                       updateTemplate.m_entries.end(), entries.begin(),
+                       entries.end(), isSameEntry)) {
+            return updateTemplate.m_handle;
+        }
+    }
+
+    VkDescriptorUpdateTemplateCreateInfo updateTemplateCi = {};
+    updateTemplateCi.sType =
+        VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+    updateTemplateCi.descriptorUpdateEntryCount =
+        static_cast<uint32_t>(entries.size());
+    updateTemplateCi.pDescriptorUpdateEntries = entries.data();
+    updateTemplateCi.templateType =
+        VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+    updateTemplateCi.descriptorSetLayout = layout;
+
+    UpdateTemplate updateTemplate;
+    updateTemplate.m_entries = entries;
+    VK_CHECK(vkCreateDescriptorUpdateTemplate(
+        m_renderer.getDevice(), &updateTemplateCi, m_renderer.getAllocator(),
+        &updateTemplate.m_handle));
+    cached.m_updateTemplates.push_back(std::move(updateTemplate));
+
+    return cached.m_updateTemplates.back().m_handle;
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout) {
+    const Layout &cached = findLayout(layout);
+    const bool updateAfterBind =
+        (cached.m_flags &
+         VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT) != 0;
+
+    return allocate(updateAfterBind ? m_updateAfterBindPools
+                                    : m_persistentPools,
+                    cached);
+}
+
+VkDescriptorSet
+DescriptorAllocator::allocateSwapchain(VkDescriptorSetLayout layout) {
+    const Layout &cached = findLayout(layout);
+    THROW_IF((cached.m_flags &
+              VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT) !=
+                 0,
+             "Update after bind sets cannot be allocated per swapchain");
+
+    return allocate(m_swapchainPools, cached);
+}
+
+void DescriptorAllocator::resetSwapchain() { resetPools(m_swapchainPools); }
+
+DescriptorAllocator::Layout &
+DescriptorAllocator::findLayout(VkDescriptorSetLayout handle) {
+    for (auto &layout : m_layouts) {
+        if (layout.m_handle == handle) {
+            return layout;
+        }
+    }
+    THROW_IF(true, "Set layout was not created by the descriptor allocator");
+
+    return m_layouts.front();
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(PoolList &pools,
+                                              const Layout &layout) {
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    if (pools.m_usedPools.empty() == false) {
+        const VkResult result =
+            tryAllocate(pools.m_usedPools.back(), layout, set);
+        if (result == VK_SUCCESS) {
+            return set;
+        }
+        THROW_IF(isPoolFull(result) == false,
+                 "Failed to allocate a descriptor set, resulted in %d",
+                 result);
+    }
+
+    // A reset pool may still be too small for this layout
+    if (pools.m_freePools.empty() == false) {
+        pools.m_usedPools.push_back(pools.m_freePools.back());
+        pools.m_freePools.pop_back();
+        const VkResult result =
+            tryAllocate(pools.m_usedPools.back(), layout, set);
+        if (result == VK_SUCCESS) {
+            return set;
+        }
+        THROW_IF(isPoolFull(result) == false,
+                 "Failed to allocate a descriptor set, resulted in %d",
+                 result);
+    }
+
+    pools.m_usedPools.push_back(createPool(pools.m_flags, layout));
+    const VkResult result = tryAllocate(pools.m_usedPools.back(), layout, set);
+    THROW_IF(result != VK_SUCCESS,
+             "Failed to allocate a descriptor set from a new pool, resulted "
+             "in %d",
+             result);
+
+    return set;
+}
+
+VkResult DescriptorAllocator::tryAllocate(VkDescriptorPool pool,
+                                          const Layout &layout,
+                                          VkDescriptorSet &set) const {
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout.m_handle;
+
+    return vkAllocateDescriptorSets(m_renderer.getDevice(), &allocInfo, &set);
+}
+
+VkDescriptorPool
+DescriptorAllocator::createPool(VkDescriptorPoolCreateFlags flags,
+                                const Layout &layout) {
+    // Descriptors per set of the usual mix
+    std::vector<VkDescriptorPoolSize> poolSizes = {
+        {VK_DESCRIPTOR_TYPE_SAMPLER, 1},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2},
+        {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 4},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4},
+    };
+    for (auto &poolSize : poolSizes) {
+        poolSize.descriptorCount *= s_setsPerPool;
+    }
+
+    // Large layouts, e.g. descriptor arrays, get a pool they fit in
+    for (const auto &binding : layout.m_bindings) {
+        auto poolSize = std::find_if(
+            poolSizes.begin(), poolSizes.end(),
+            [&binding](const VkDescriptorPoolSize &size) {
+                return size.type == binding.descriptorType;
+            });
+        if (poolSize == poolSizes.end()) {
+            poolSizes.push_back({binding.descriptorType, 0});
+            poolSize = poolSizes.end() - 1;
+        }
+        poolSize->descriptorCount =
+            std::max(poolSize->descriptorCount, binding.descriptorCount);
+    }
+
+    VkDescriptorPoolCreateInfo descriptorPoolCI = {};
+    descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolCI.flags = flags;
+    descriptorPoolCI.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    descriptorPoolCI.pPoolSizes = poolSizes.data();
+    descriptorPoolCI.maxSets = s_setsPerPool;
+
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateDescriptorPool(m_renderer.getDevice(), &descriptorPoolCI,
+                                    m_renderer.getAllocator(), &pool));
+    m_poolCount++;
+    LOG("Created descriptor pool %u", m_poolCount);
+
+    return pool;
+}
+
+void DescriptorAllocator::resetPools(PoolList &pools) {
+    for (auto &pool : pools.m_usedPools) {
+        VK_CHECK(vkResetDescriptorPool(m_renderer.getDevice(), pool, 0));
+        pools.m_freePools.push_back(pool);
+    }
+    pools.m_usedPools.clear();
+}
+
+void DescriptorAllocator::destroyPools(PoolList &pools) {
+    for (auto *list : {&pools.m_usedPools, &pools.m_freePools}) {
+        for (auto &pool : *list) {
+            vkDestroyDescriptorPool(m_renderer.getDevice(), pool,
+                                    m_renderer.getAllocator());
+        }
+        m_poolCount -= static_cast<uint32_t>(list->size());
+        list->clear();
+    }
+}
+
+Logger &DescriptorAllocator::getLogger() { return m_renderer.getLogger(); }
+} // namespace vulkan_proto
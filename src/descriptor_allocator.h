@@ -0,0 +1,87 @@
+#pragma once
+
+#include "headers.h"
+
+namespace vulkan_proto {
+
+struct Renderer;
+struct Logger;
+
+// Hands out descriptor sets from pools that are created as they fill up, so
+// sets can be allocated at any time without knowing the total count up
+// front. Persistent sets live until the allocator is destroyed. Swapchain
+// sets, e.g. of images sized like the swapchain, live until the swapchain is
+// recreated, which resets all their pools at once. Set layouts are cached
+// by their bindings, so each unique layout is created only once. Update
+// templates are cached with their layouts, and write all the descriptors of
+// a set from one packed struct.
+struct DescriptorAllocator {
+    // A new pool has room for this many sets of the usual mix of descriptors
+    static constexpr uint32_t s_setsPerPool = 64;
+
+    struct PoolList {
+        VkDescriptorPoolCreateFlags m_flags = 0;
+        // Sets are allocated from the last one
+        std::vector<VkDescriptorPool> m_usedPools;
+        // Reset pools waiting for reuse
+        std::vector<VkDescriptorPool> m_freePools;
+    };
+
+    struct UpdateTemplate {
+        std::vector<VkDescriptorUpdateTemplateEntry> m_entries;
+        VkDescriptorUpdateTemplate m_handle = VK_NULL_HANDLE;
+    };
+
+    struct Layout {
+        uint64_t m_hash = 0;
+        VkDescriptorSetLayoutCreateFlags m_flags = 0;
+        // Sorted by binding, immutable samplers are stored separately
+        std::vector<VkDescriptorSetLayoutBinding> m_bindings;
+        std::vector<VkDescriptorBindingFlagsEXT> m_bindingFlags;
+        std::vector<VkSampler> m_immutableSamplers;
+        VkDescriptorSetLayout m_handle = VK_NULL_HANDLE;
+        std::vector<UpdateTemplate> m_updateTemplates;
+
+        bool operator==(const Layout &other) const;
+    };
+
+    const Renderer &m_renderer;
+    std::vector<Layout> m_layouts;
+    PoolList m_persistentPools;
+    // For layouts created with the update after bind pool flag
+    PoolList m_updateAfterBindPools;
+    PoolList m_swapchainPools;
+    uint32_t m_poolCount = 0;
+
+    DescriptorAllocator(Renderer &renderer);
+    ~DescriptorAllocator();
+    void create();
+    void destroy();
+    // Returns the cached layout equal to the create info, creating it if
+    // needed. The layouts are owned by the allocator.
+    VkDescriptorSetLayout
+    getLayout(const VkDescriptorSetLayoutCreateInfo &createInfo);
+    // Returns the cached template of the entries, creating it if needed.
+    // The offsets & strides of the entries are into the struct that is passed
+    // to vkUpdateDescriptorSetWithTemplate.
+    VkDescriptorUpdateTemplate getUpdateTemplate(
+        VkDescriptorSetLayout layout,
+        const std::vector<VkDescriptorUpdateTemplateEntry> &entries);
+    VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+    // The set must not be in use when the swapchain sets are reset
+    VkDescriptorSet allocateSwapchain(VkDescriptorSetLayout layout);
+    // Frees every swapchain set, the pools are kept for the new ones
+    void resetSwapchain();
+    Logger &getLogger();
+
+  private:
+    Layout &findLayout(VkDescriptorSetLayout handle);
+    VkDescriptorSet allocate(PoolList &pools, const Layout &layout);
+    VkResult tryAllocate(VkDescriptorPool pool, const Layout &layout,
+                         VkDescriptorSet &set) const;
+    VkDescriptorPool createPool(VkDescriptorPoolCreateFlags flags,
+                                const Layout &layout);
+    void resetPools(PoolList &pools);
+    void destroyPools(PoolList &pools);
+};
+} // namespace vulkan_proto
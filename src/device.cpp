@@ -135,10 +135,27 @@ void Device::create() {
     };
 
     auto checkFeatureSupport = [](const VkPhysicalDevice &device) {
-        VkPhysicalDeviceFeatures features;
-        vkGetPhysicalDeviceFeatures(device, &features);
-        return features.geometryShader && features.tessellationShader &&
-               features.samplerAnisotropy;
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+        if (properties.apiVersion < VK_API_VERSION_1_1) {
+            return false;
+        }
+
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+        indexingFeatures.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        VkPhysicalDeviceFeatures2 features = {};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &indexingFeatures;
+        vkGetPhysicalDeviceFeatures2(device, &features);
+
+        return features.features.geometryShader &&
+               features.features.tessellationShader &&
+               features.features.samplerAnisotropy &&
+               features.features.shaderSampledImageArrayDynamicIndexing &&
+               indexingFeatures.runtimeDescriptorArray &&
+               indexingFeatures.descriptorBindingPartiallyBound &&
+               indexingFeatures.descriptorBindingSampledImageUpdateAfterBind;
     };
 
     auto evaluateDevice = [&deviceCount, &devices, &checkExtensionSupport,
@@ -236,9 +253,29 @@ void Device::create() {
     deviceFeatures.geometryShader = VK_TRUE;
     deviceFeatures.tessellationShader = VK_TRUE;
     deviceFeatures.samplerAnisotropy = VK_TRUE;
+    // The texture table is indexed by the material of the draw, which is
+    // dynamically uniform, so non-uniform indexing is not needed
+    deviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+
+    // Enabled when supported, only cluster culling needs these
+    VkPhysicalDeviceFeatures supportedFeatures = {};
+    vkGetPhysicalDeviceFeatures(m_device, &supportedFeatures);
+    m_multiDrawIndirect = supportedFeatures.multiDrawIndirect &&
+                          supportedFeatures.drawIndirectFirstInstance;
+    deviceFeatures.multiDrawIndirect = m_multiDrawIndirect;
+    deviceFeatures.drawIndirectFirstInstance = m_multiDrawIndirect;
+
+    // For the bindless texture table
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+    indexingFeatures.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+    indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+    indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
 
     VkDeviceCreateInfo deviceCi = {};
     deviceCi.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    deviceCi.pNext = &indexingFeatures;
     deviceCi.pQueueCreateInfos = qcis.data();
     deviceCi.queueCreateInfoCount = static_cast<uint32_t>(qcis.size());
     deviceCi.pEnabledFeatures = &deviceFeatures;
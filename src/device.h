@@ -16,8 +16,12 @@ struct Device {
     VkPhysicalDeviceMemoryProperties m_memProps = {};
     int m_graphicsFI = -1;
     int m_presentFI = -1;
-    std::array<const char *, 1> m_requiredExtensions = {
-        VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    // Optional multiDrawIndirect & drawIndirectFirstInstance, for drawing
+    // many meshlets with one call
+    bool m_multiDrawIndirect = false;
+    std::array<const char *, 2> m_requiredExtensions = {
+        VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+        VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME};
 
     Device(Renderer &renderer);
     ~Device();
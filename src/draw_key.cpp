@@ -0,0 +1,77 @@
+#include "draw_key.h"
+#include <algorithm>
+
+namespace {
+uint64_t mask(uint32_t bits) { return (uint64_t(1) << bits) - 1; }
+} // namespace
+
+namespace vulkan_proto {
+uint64_t DrawKey::make(uint32_t pipeline, VkIndexType indexType,
+                       uint32_t material, uint32_t mesh) {
+    THROW_IF(pipeline > mask(s_pipelineBits) ||
+                 material > mask(s_materialBits) || mesh > mask(s_meshBits),
+             "Draw key field out of range: pipeline %u, material %u, mesh %u",
+             pipeline, material, mesh);
+    THROW_IF(indexType != VK_INDEX_TYPE_UINT16 &&
+                 indexType != VK_INDEX_TYPE_UINT32,
+             "Draw key index type %d is not 16 or 32 bit", indexType);
+
+    const uint64_t indexBit = indexType == VK_INDEX_TYPE_UINT32 ? 1 : 0;
+    return uint64_t(pipeline)
+               << (s_indexTypeBits + s_materialBits + s_meshBits) |
+           indexBit << (s_materialBits + s_meshBits) |
+           uint64_t(material) << s_meshBits | uint64_t(mesh);
+}
+
+uint32_t DrawKey::getPipeline(uint64_t key) {
+    return static_cast<uint32_t>(
+        key >> (s_indexTypeBits + s_materialBits + s_meshBits));
+}
+
+VkIndexType DrawKey::getIndexType(uint64_t key) {
+    return (key >> (s_materialBits + s_meshBits)) & mask(s_indexTypeBits)
+               ? VK_INDEX_TYPE_UINT32
+               : VK_INDEX_TYPE_UINT16;
+}
+
+uint32_t DrawKey::getMaterial(uint64_t key) {
+    return static_cast<uint32_t>((key >> s_meshBits) & mask(s_materialBits));
+}
+
+uint32_t DrawKey::getMesh(uint64_t key) {
+    return static_cast<uint32_t>(key & mask(s_meshBits));
+}
+
+void radixSort(std::vector<DrawKey> &keys, std::vector<DrawKey> &scratch) {
+    scratch.resize(keys.size());
+
+    // Histograms of all passes in one sweep over the keys
+    std::array<std::array<uint32_t, 256>, 8> counts = {};
+    for (const auto &key : keys) {
+        for (uint32_t pass = 0; pass < 8; pass++) {
+            counts[pass][(key.m_key >> (pass * 8)) & 0xff]++;
+        }
+    }
+
+    const uint32_t size = static_cast<uint32_t>(keys.size());
+    for (uint32_t pass = 0; pass < 8; pass++) {
+        std::array<uint32_t, 256> &count = counts[pass];
+        const uint32_t shift = pass * 8;
+        if (size == 0 || count[(keys[0].m_key >> shift) & 0xff] == size) {
+            continue;
+        }
+
+        uint32_t offset = 0;
+        for (auto &c : count) {
+            const uint32_t n = c;
+            c = offset;
+            offset += n;
+        }
+
+        for (const auto &key : keys) {
+            scratch[count[(key.m_key >> shift) & 0xff]++] = key;
+        }
+        keys.swap(scratch);
+    }
+}
+} // namespace vulkan_proto
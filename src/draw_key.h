@@ -0,0 +1,38 @@
+#pragma once
+
+#include "headers.h"
+
+namespace vulkan_proto {
+// Sort key of a draw. The most significant fields are the most expensive
+// state to change, so draws sorted by key change each state at most once
+// per unique value:
+// bits 33..40 pipeline, 32 index type, 16..31 material, 0..15 mesh
+// The index type rebinds the index buffer of the geometry pool, so it comes
+// before the material. The material picks the textures of the bindless
+// table, so draws with the same textures follow each other. There is no
+// depth field, the keys are sorted when the command buffers are recorded,
+// not when the camera moves.
+struct DrawKey {
+    static constexpr uint32_t s_pipelineBits = 8;
+    static constexpr uint32_t s_indexTypeBits = 1;
+    static constexpr uint32_t s_materialBits = 16;
+    static constexpr uint32_t s_meshBits = 16;
+
+    uint64_t m_key = 0;
+    // What the key was made for, e.g. an index to the batches
+    uint32_t m_index = 0;
+
+    // 16 or 32 bit indices
+    static uint64_t make(uint32_t pipeline, VkIndexType indexType,
+                         uint32_t material, uint32_t mesh);
+    static uint32_t getPipeline(uint64_t key);
+    static VkIndexType getIndexType(uint64_t key);
+    static uint32_t getMaterial(uint64_t key);
+    static uint32_t getMesh(uint64_t key);
+};
+
+// Stable least significant digit radix sort by key, one byte per pass.
+// Passes where every key has the same byte are skipped. The scratch vector
+// is resized as needed and can be reused between sorts.
+void radixSort(std::vector<DrawKey> &keys, std::vector<DrawKey> &scratch);
+} // namespace vulkan_proto
@@ -0,0 +1,34 @@
+#include "frustum.h"
+
+namespace vulkan_proto {
+void Frustum::update(const glm::mat4 &viewProjection) {
+    // Gribb & Hartmann, with clip space depth in [0, w]
+    auto row = [&viewProjection](int i) {
+        return glm::vec4(viewProjection[0][i], viewProjection[1][i],
+                         viewProjection[2][i], viewProjection[3][i]);
+    };
+
+    m_planes[0] = row(3) + row(0);
+    m_planes[1] = row(3) - row(0);
+    m_planes[2] = row(3) + row(1);
+    m_planes[3] = row(3) - row(1);
+    m_planes[4] = row(2);
+    m_planes[5] = row(3) - row(2);
+
+    for (auto &plane : m_planes) {
+        plane /= glm::length(glm::vec3(plane.x, plane.y, plane.z));
+    }
+}
+
+glm::vec4 transformBoundingSphere(const glm::vec4 &sphere,
+                                  const glm::mat4 &transform) {
+    const glm::vec4 center =
+        transform * glm::vec4(sphere.x, sphere.y, sphere.z, 1.0f);
+    const float scale =
+        std::max(glm::length(glm::vec3(transform[0])),
+                 std::max(glm::length(glm::vec3(transform[1])),
+                          glm::length(glm::vec3(transform[2]))));
+
+    return glm::vec4(center.x, center.y, center.z, sphere.w * scale);
+}
+} // namespace vulkan_proto
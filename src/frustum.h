@@ -0,0 +1,19 @@
+#pragma once
+
+#include "headers.h"
+
+namespace vulkan_proto {
+// View frustum as six inward facing planes with normalized normals, in the
+// order left, right, bottom, top, near, far
+struct Frustum {
+    std::array<glm::vec4, 6> m_planes = {};
+
+    void update(const glm::mat4 &viewProjection);
+};
+
+// Transforms a bounding sphere to the space of 'transform'. The radius is
+// scaled by the largest axis scale, so the result stays conservative under
+// non-uniform scaling.
+glm::vec4 transformBoundingSphere(const glm::vec4 &sphere,
+                                  const glm::mat4 &transform);
+} // namespace vulkan_proto
@@ -0,0 +1,258 @@
+#include "geometry_pool.h"
+#include "renderer.h"
+
+namespace vulkan_proto {
+void FreeListAllocator::reset(uint32_t capacity) {
+    m_freeRanges.clear();
+    m_capacity = capacity;
+    m_freeCount = capacity;
+    if (capacity > 0) {
+        m_freeRanges[0] = capacity;
+    }
+}
+
+bool FreeListAllocator::allocate(uint32_t count, uint32_t &offset) {
+    if (count == 0) {
+        offset = 0;
+        return true;
+    }
+
+    for (auto it = m_freeRanges.begin(); it != m_freeRanges.end(); ++it) {
+        if (it->second >= count) {
+            offset = it->first;
+            const uint32_t remaining = it->second - count;
+            m_freeRanges.erase(it);
+            if (remaining > 0) {
+                m_freeRanges[offset + count] = remaining;
+            }
+            m_freeCount -= count;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void FreeListAllocator::free(uint32_t offset, uint32_t count) {
+    if (count == 0) {
+        return;
+    }
+    m_freeCount += count;
+
+    auto next = m_freeRanges.lower_bound(offset);
+    // Merge with the following range
+    if (next != m_freeRanges.end() && offset + count == next->first) {
+        count += next->second;
+        next = m_freeRanges.erase(next);
+    }
+
+    // Merge with the preceding range
+    if (next != m_freeRanges.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            prev->second += count;
+            return;
+        }
+    }
+
+    m_freeRanges[offset] = count;
+}
+
+GeometryPool::GeometryPool(Renderer &renderer) : m_renderer(renderer) {}
+GeometryPool::~GeometryPool() {}
+
+void GeometryPool::create(uint32_t vertexCapacity, uint32_t indexCapacity,
+                          VkDeviceSize vertexStride) {
+    LOG("=Create geometry pool=");
+    m_vertexStride = vertexStride;
+    m_vertexAllocator.reset(vertexCapacity);
+    m_indexAllocator.reset(getIndexUnits(VK_INDEX_TYPE_UINT32, indexCapacity));
+
+    m_renderer.createBuffer(vertexStride * vertexCapacity,
+                            VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_vertexBuffer,
+                            m_vertexMemory);
+
+    m_renderer.createBuffer(sizeof(uint16_t) * m_indexAllocator.m_capacity,
+                            VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_indexBuffer,
+                            m_indexMemory);
+}
+
+void GeometryPool::destroy() {
+    LOG("=Destroy geometry pool=");
+    vkDestroyBuffer(m_renderer.getDevice(), m_indexBuffer,
+                    m_renderer.getAllocator());
+    vkFreeMemory(m_renderer.getDevice(), m_indexMemory,
+                 m_renderer.getAllocator());
+
+    vkDestroyBuffer(m_renderer.getDevice(), m_vertexBuffer,
+                    m_renderer.getAllocator());
+    vkFreeMemory(m_renderer.getDevice(), m_vertexMemory,
+                 m_renderer.getAllocator());
+
+    m_vertexBuffer = VK_NULL_HANDLE;
+    m_indexBuffer = VK_NULL_HANDLE;
+    m_vertexMemory = VK_NULL_HANDLE;
+    m_indexMemory = VK_NULL_HANDLE;
+    m_vertexAllocator.reset(0);
+    m_indexAllocator.reset(0);
+}
+
+GeometryPool::Allocation GeometryPool::allocate(const void *vertices,
+                                                uint32_t vertexCount,
+                                                const uint32_t *indices,
+                                                uint32_t indexCount) {
+    Staging staging = createStaging(vertexCount, indexCount);
+    if (vertexCount > 0) {
+        memcpy(staging.vertices, vertices, m_vertexStride * vertexCount);
+    }
+    if (indexCount > 0) {
+        memcpy(staging.indices, indices, sizeof(uint32_t) * indexCount);
+    }
+    return allocate(staging);
+}
+
+GeometryPool::Staging GeometryPool::createStaging(uint32_t vertexCount,
+                                                  uint32_t indexCount) const {
+    Staging staging;
+    staging.vertexCount = vertexCount;
+    staging.indexCount = indexCount;
+    const VkDeviceSize indexOffset = getStagingIndexOffset(vertexCount);
+    const VkDeviceSize size = indexOffset + sizeof(uint32_t) * indexCount;
+    if (vertexCount == 0 && indexCount == 0) {
+        return staging;
+    }
+
+    m_renderer.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                            staging.buffer, staging.memory);
+    void *data = nullptr;
+    VK_CHECK(vkMapMemory(m_renderer.getDevice(), staging.memory, 0, size, 0,
+                         &data));
+    staging.vertices = static_cast<uint8_t *>(data);
+    staging.indices = reinterpret_cast<uint32_t *>(staging.vertices +
+                                                   indexOffset);
+    return staging;
+}
+
+GeometryPool::Allocation GeometryPool::allocate(Staging &staging) {
+    const uint32_t vertexCount = staging.vertexCount;
+    const uint32_t indexCount = staging.indexCount;
+    Allocation allocation = {};
+    uint32_t vertexOffset = 0;
+    if (!m_vertexAllocator.allocate(vertexCount, vertexOffset)) {
+        destroyStaging(staging);
+        THROW_IF(true,
+                 "Geometry pool is out of vertex space: %u requested, %u of "
+                 "%u free. Increase \"geometry_pool\" \"vertices\" in the "
+                 "input.",
+                 vertexCount, m_vertexAllocator.m_freeCount,
+                 m_vertexAllocator.m_capacity);
+    }
+
+    // The indices are relative to the vertex offset, so only the vertex
+    // count decides. Primitive restart is off, 0xffff is an index like any.
+    if (vertexCount <= 1u << 16) {
+        allocation.indexType = VK_INDEX_TYPE_UINT16;
+    }
+    const uint32_t indexUnits =
+        getIndexUnits(allocation.indexType, indexCount);
+    uint32_t indexOffset = 0;
+    if (!m_indexAllocator.allocate(indexUnits, indexOffset)) {
+        m_vertexAllocator.free(vertexOffset, vertexCount);
+        destroyStaging(staging);
+        THROW_IF(true,
+                 "Geometry pool is out of index space: %u requested, %u of %u "
+                 "free in 16 bit units. Increase \"geometry_pool\" "
+                 "\"indices\" in the input.",
+                 indexUnits, m_indexAllocator.m_freeCount,
+                 m_indexAllocator.m_capacity);
+    }
+
+    allocation.vertexOffset = static_cast<int32_t>(vertexOffset);
+    allocation.vertexCount = vertexCount;
+    allocation.indexCount = indexCount;
+
+    VkDeviceSize indexSize = sizeof(uint32_t) * indexCount;
+    if (allocation.indexType == VK_INDEX_TYPE_UINT16) {
+        allocation.firstIndex = indexOffset;
+        // Front to back, each index is written below where it was read.
+        // Through bytes, the two widths alias.
+        uint8_t *bytes = reinterpret_cast<uint8_t *>(staging.indices);
+        for (uint32_t i = 0; i < indexCount; i++) {
+            uint32_t index = 0;
+            memcpy(&index, bytes + sizeof(uint32_t) * i, sizeof(index));
+            const uint16_t shortIndex = static_cast<uint16_t>(index);
+            memcpy(bytes + sizeof(uint16_t) * i, &shortIndex,
+                   sizeof(shortIndex));
+        }
+        indexSize = sizeof(uint16_t) * indexCount;
+    } else {
+        allocation.firstIndex = indexOffset / 2;
+    }
+
+    // One submit for both copies
+    std::array<VkBufferCopy, 2> regions = {};
+    regions[0].srcOffset = 0;
+    regions[0].dstOffset = m_vertexStride * vertexOffset;
+    regions[0].size = m_vertexStride * vertexCount;
+    regions[1].srcOffset = getStagingIndexOffset(vertexCount);
+    regions[1].dstOffset = sizeof(uint16_t) * indexOffset;
+    regions[1].size = indexSize;
+    if (staging.buffer != VK_NULL_HANDLE) {
+        vkUnmapMemory(m_renderer.getDevice(), staging.memory);
+        VkCommandBuffer commandBuffer = m_renderer.beginSingleTimeCommands();
+        if (regions[0].size > 0) {
+            vkCmdCopyBuffer(commandBuffer, staging.buffer, m_vertexBuffer, 1,
+                            &regions[0]);
+        }
+        if (regions[1].size > 0) {
+            vkCmdCopyBuffer(commandBuffer, staging.buffer, m_indexBuffer, 1,
+                            &regions[1]);
+        }
+        m_renderer.endSingleTimeCommands(commandBuffer);
+        staging.vertices = nullptr;
+        staging.indices = nullptr;
+    }
+    destroyStaging(staging);
+
+    return allocation;
+}
+
+void GeometryPool::destroyStaging(Staging &staging) const {
+    // Freeing the memory also unmaps it
+    vkFreeMemory(m_renderer.getDevice(), staging.memory,
+                 m_renderer.getAllocator());
+    vkDestroyBuffer(m_renderer.getDevice(), staging.buffer,
+                    m_renderer.getAllocator());
+    staging = Staging();
+}
+
+void GeometryPool::free(Allocation &allocation) {
+    m_vertexAllocator.free(static_cast<uint32_t>(allocation.vertexOffset),
+                           allocation.vertexCount);
+    const uint32_t indexOffset = allocation.indexType == VK_INDEX_TYPE_UINT16
+                                     ? allocation.firstIndex
+                                     : 2 * allocation.firstIndex;
+    m_indexAllocator.free(
+        indexOffset,
+        getIndexUnits(allocation.indexType, allocation.indexCount));
+    allocation = Allocation();
+}
+
+uint32_t GeometryPool::getIndexUnits(VkIndexType indexType, uint32_t count) {
+    // Rounded up to even, see GeometryPool
+    return indexType == VK_INDEX_TYPE_UINT16 ? (count + 1) & ~1u : 2 * count;
+}
+
+VkDeviceSize GeometryPool::getStagingIndexOffset(uint32_t vertexCount) const {
+    return (m_vertexStride * vertexCount + 3) & ~VkDeviceSize(3);
+}
+
+Logger &GeometryPool::getLogger() { return m_renderer.getLogger(); }
+} // namespace vulkan_proto
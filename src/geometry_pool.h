@@ -0,0 +1,90 @@
+#pragma once
+
+#include "headers.h"
+
+namespace vulkan_proto {
+
+struct Renderer;
+struct Logger;
+
+// First fit allocator over a range of elements. Freed ranges are merged with
+// their neighbours, so the pool can be refilled after streaming meshes out.
+struct FreeListAllocator {
+    // Offset -> size of each free range
+    std::map<uint32_t, uint32_t> m_freeRanges;
+    uint32_t m_capacity = 0;
+    uint32_t m_freeCount = 0;
+
+    void reset(uint32_t capacity);
+    bool allocate(uint32_t count, uint32_t &offset);
+    void free(uint32_t offset, uint32_t count);
+};
+
+// One large vertex buffer and one large index buffer shared by all meshes.
+// Meshes are sub-allocated from these, so the whole scene can be drawn with
+// the buffers bound only once per index type.
+//
+// Allocations with at most 65536 vertices store 16 bit indices, the others
+// 32 bit. Both live in the same buffer, which is allocated in 16 bit units.
+// Every range is an even number of units, so the 32 bit ones stay aligned.
+// The buffer is bound at offset zero with the type of the allocation, and
+// firstIndex counts indices of that type.
+struct GeometryPool {
+    struct Allocation {
+        int32_t vertexOffset = 0;
+        uint32_t vertexCount = 0;
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+    };
+
+    // Host visible memory of one upload, mapped so the vertices & indices
+    // can be decoded straight into it. Created & filled on any thread, the
+    // upload takes the queue & the allocators, so it must not overlap
+    // another.
+    struct Staging {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        uint32_t vertexCount = 0;
+        uint32_t indexCount = 0;
+        // In the vertex format
+        uint8_t *vertices = nullptr;
+        // 32 bit, narrowed in place when the allocation takes 16 bit ones
+        uint32_t *indices = nullptr;
+    };
+
+    const Renderer &m_renderer;
+
+    VkBuffer m_vertexBuffer = VK_NULL_HANDLE;
+    VkBuffer m_indexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_vertexMemory = VK_NULL_HANDLE;
+    VkDeviceMemory m_indexMemory = VK_NULL_HANDLE;
+
+    FreeListAllocator m_vertexAllocator;
+    // In 16 bit units
+    FreeListAllocator m_indexAllocator;
+    VkDeviceSize m_vertexStride = 0;
+
+    GeometryPool(Renderer &renderer);
+    ~GeometryPool();
+    // The index capacity is in 32 bit indices, twice as many 16 bit ones
+    // fit
+    void create(uint32_t vertexCapacity, uint32_t indexCapacity,
+                VkDeviceSize vertexStride);
+    void destroy();
+    Allocation allocate(const void *vertices, uint32_t vertexCount,
+                        const uint32_t *indices, uint32_t indexCount);
+    Staging createStaging(uint32_t vertexCount, uint32_t indexCount) const;
+    // Uploads the filled staging memory & destroys it
+    Allocation allocate(Staging &staging);
+    void destroyStaging(Staging &staging) const;
+    void free(Allocation &allocation);
+    Logger &getLogger();
+
+  private:
+    // Range of the indices in 16 bit units
+    static uint32_t getIndexUnits(VkIndexType indexType, uint32_t count);
+    // Of the indices in the staging memory, after the vertices
+    VkDeviceSize getStagingIndexOffset(uint32_t vertexCount) const;
+};
+} // namespace vulkan_proto
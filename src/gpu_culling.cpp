@@ -0,0 +1,360 @@
+#include "gpu_culling.h"
+#include "renderer.h"
+
+namespace vulkan_proto {
+GpuCulling::GpuCulling(Renderer &renderer)
+    : m_renderer(renderer), m_pipeline(renderer) {}
+GpuCulling::~GpuCulling() {}
+
+void GpuCulling::create(bool enabled, bool occlusion,
+                        const std::vector<Object> &objects,
+                        const std::vector<VkDrawIndexedIndirectCommand> &draws,
+                        const std::vector<float> &lodErrors,
+                        const VkDescriptorBufferInfo &cameraBuffer,
+                        const VkDescriptorImageInfo &hiZPyramid) {
+    LOG("=Create GPU culling=");
+    THROW_IF(objects.empty() || draws.empty(), "Nothing to cull");
+    THROW_IF(lodErrors.size() != draws.size(),
+             "Expected an error for each of the %zu draws, got %zu",
+             draws.size(), lodErrors.size());
+
+    m_enabled = enabled;
+    m_occlusion = enabled && occlusion;
+    m_objectCount = static_cast<uint32_t>(objects.size());
+    m_drawCount = static_cast<uint32_t>(draws.size());
+    m_lodCount = 1;
+    for (const auto &object : objects) {
+        m_lodCount = std::max(m_lodCount, object.lodCount);
+    }
+
+    // Each phase has its own draw commands and instance list
+    const VkDeviceSize drawsSize = sizeof(draws[0]) * draws.size();
+    m_renderer.createStagedBuffer(drawsSize * getPhaseCount(),
+                                  VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                  m_drawCommandBuffer);
+
+    const VkDeviceSize visibleSize =
+        sizeof(uint32_t) * objects.size() * m_lodCount * getPhaseCount();
+    m_renderer.createStagedBuffer(visibleSize,
+                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                  m_visibleInstanceBuffer);
+
+    if (m_enabled == false) {
+        // Everything is drawn at full detail, so the commands and the
+        // instance list are static. Objects are in the instance order of the
+        // batches.
+        std::vector<uint32_t> visibleInstances(objects.size());
+        for (size_t i = 0; i < objects.size(); i++) {
+            visibleInstances[i] = objects[i].transformIndex;
+        }
+        uploadDraws(draws, visibleInstances);
+
+        return;
+    }
+
+    // The shader counts the instances up from zero
+    std::vector<VkDrawIndexedIndirectCommand> drawTemplates;
+    for (uint32_t phase = 0; phase < getPhaseCount(); phase++) {
+        for (auto draw : draws) {
+            draw.instanceCount = 0;
+            drawTemplates.push_back(draw);
+        }
+    }
+    m_renderer.createStagedBuffer(drawsSize * getPhaseCount(),
+                                  VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                  m_drawTemplateBuffer);
+    m_renderer.copyCPUToGPU(
+        reinterpret_cast<const void *>(drawTemplates.data()),
+        drawsSize * getPhaseCount(), m_drawTemplateBuffer.stagingMemory,
+        m_drawTemplateBuffer.stagingBuffer, m_drawTemplateBuffer.buffer);
+
+    const VkDeviceSize objectsSize = sizeof(objects[0]) * objects.size();
+    m_renderer.createStagedBuffer(
+        objectsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, m_objectBuffer);
+    m_renderer.copyCPUToGPU(reinterpret_cast<const void *>(objects.data()),
+                            objectsSize, m_objectBuffer.stagingMemory,
+                            m_objectBuffer.stagingBuffer,
+                            m_objectBuffer.buffer);
+
+    // Nothing was visible before the first frame
+    const std::vector<uint32_t> visibility(objects.size(), 0);
+    const VkDeviceSize visibilitySize = sizeof(visibility[0]) * objects.size();
+    m_renderer.createStagedBuffer(visibilitySize,
+                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                  m_visibilityBuffer);
+    m_renderer.copyCPUToGPU(reinterpret_cast<const void *>(visibility.data()),
+                            visibilitySize, m_visibilityBuffer.stagingMemory,
+                            m_visibilityBuffer.stagingBuffer,
+                            m_visibilityBuffer.buffer);
+
+    const VkDeviceSize lodErrorsSize = sizeof(lodErrors[0]) * lodErrors.size();
+    m_renderer.createStagedBuffer(lodErrorsSize,
+                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                  m_lodErrorBuffer);
+    m_renderer.copyCPUToGPU(reinterpret_cast<const void *>(lodErrors.data()),
+                            lodErrorsSize, m_lodErrorBuffer.stagingMemory,
+                            m_lodErrorBuffer.stagingBuffer,
+                            m_lodErrorBuffer.buffer);
+
+    m_renderer.createBuffer(sizeof(Statistics),
+                            VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                            m_statisticsBuffer, m_statisticsMemory);
+
+    createDescriptors(cameraBuffer, hiZPyramid);
+
+    // objectCount, drawCount, phase, occlusion & lodCount of cull_cs.glsl
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = 5 * sizeof(uint32_t);
+
+    m_pipeline.create(
+        m_renderer.getProgramInput().at("compute_shaders").at("cull"),
+        {m_descriptorSetLayout}, {pushConstantRange});
+}
+
+void GpuCulling::destroy() {
+    LOG("=Destroy GPU culling=");
+    m_pipeline.destroy();
+
+    // The layout & set are owned by the descriptor allocator
+    m_descriptorSetLayout = VK_NULL_HANDLE;
+    m_descriptorSet = VK_NULL_HANDLE;
+
+    vkDestroyBuffer(m_renderer.getDevice(), m_statisticsBuffer,
+                    m_renderer.getAllocator());
+    vkFreeMemory(m_renderer.getDevice(), m_statisticsMemory,
+                 m_renderer.getAllocator());
+    m_statisticsBuffer = VK_NULL_HANDLE;
+    m_statisticsMemory = VK_NULL_HANDLE;
+
+    m_renderer.destroyStagedBuffer(m_objectBuffer);
+    m_renderer.destroyStagedBuffer(m_drawTemplateBuffer);
+    m_renderer.destroyStagedBuffer(m_drawCommandBuffer);
+    m_renderer.destroyStagedBuffer(m_visibleInstanceBuffer);
+    m_renderer.destroyStagedBuffer(m_visibilityBuffer);
+    m_renderer.destroyStagedBuffer(m_lodErrorBuffer);
+
+    m_objectCount = 0;
+    m_drawCount = 0;
+    m_lodCount = 1;
+}
+
+void GpuCulling::updateHiZPyramid(
+    const VkDescriptorImageInfo &hiZPyramid) const {
+    if (m_enabled == false) {
+        return;
+    }
+
+    const VkDescriptorUpdateTemplate updateTemplate =
+        m_renderer.getDescriptorAllocator().getUpdateTemplate(
+            m_descriptorSetLayout,
+            {{5, 0, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, 0}});
+    vkUpdateDescriptorSetWithTemplate(m_renderer.getDevice(), m_descriptorSet,
+                                      updateTemplate, &hiZPyramid);
+}
+
+void GpuCulling::uploadDraws(
+    const std::vector<VkDrawIndexedIndirectCommand> &draws,
+    const std::vector<uint32_t> &visibleInstances) const {
+    THROW_IF(m_enabled, "Draws are built by the culling shader");
+    THROW_IF(draws.size() != m_drawCount, "Expected %u draws, got %zu",
+             m_drawCount, draws.size());
+    THROW_IF(visibleInstances.size() > m_objectCount * m_lodCount,
+             "More visible instances than objects");
+
+    m_renderer.copyCPUToGPU(reinterpret_cast<const void *>(draws.data()),
+                            sizeof(draws[0]) * draws.size(),
+                            m_drawCommandBuffer.stagingMemory,
+                            m_drawCommandBuffer.stagingBuffer,
+                            m_drawCommandBuffer.buffer);
+
+    // Nothing may be visible, but the draw commands then draw nothing
+    if (visibleInstances.empty() == false) {
+        m_renderer.copyCPUToGPU(
+            reinterpret_cast<const void *>(visibleInstances.data()),
+            sizeof(visibleInstances[0]) * visibleInstances.size(),
+            m_visibleInstanceBuffer.stagingMemory,
+            m_visibleInstanceBuffer.stagingBuffer,
+            m_visibleInstanceBuffer.buffer);
+    }
+}
+
+void GpuCulling::recordCommands(VkCommandBuffer commandBuffer,
+                                uint32_t phase) const {
+    if (m_enabled == false) {
+        return;
+    }
+
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+
+    if (phase == 0) {
+        // The previous frame must be done reading the draw commands and the
+        // instance list before they are overwritten
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                                 VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT |
+                                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+        VkBufferCopy copyRegion = {};
+        copyRegion.srcOffset = 0;
+        copyRegion.dstOffset = 0;
+        copyRegion.size = sizeof(VkDrawIndexedIndirectCommand) * m_drawCount *
+                          getPhaseCount();
+        vkCmdCopyBuffer(commandBuffer, m_drawTemplateBuffer.buffer,
+                        m_drawCommandBuffer.buffer, 1, &copyRegion);
+        vkCmdFillBuffer(commandBuffer, m_statisticsBuffer, 0,
+                        sizeof(Statistics), 0);
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask =
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                             &barrier, 0, nullptr, 0, nullptr);
+    } else {
+        // The visibility & the statistics written by the first phase
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask =
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                             &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    const uint32_t pushConstants[5] = {m_objectCount, m_drawCount, phase,
+                                       m_occlusion ? 1u : 0u, m_lodCount};
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      m_pipeline.m_handle);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            m_pipeline.m_layout, 0, 1, &m_descriptorSet, 0,
+                            nullptr);
+    vkCmdPushConstants(commandBuffer, m_pipeline.m_layout,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants),
+                       pushConstants);
+    // Must match local_size_x of the shader
+    const uint32_t groupSize = 64;
+    vkCmdDispatch(commandBuffer, (m_objectCount + groupSize - 1) / groupSize,
+                  1, 1);
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask =
+        VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                             VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    if (phase + 1 == getPhaseCount()) {
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0,
+                             nullptr, 0, nullptr);
+    }
+}
+
+GpuCulling::Statistics GpuCulling::getStatistics() const {
+    Statistics statistics;
+    if (m_enabled == false) {
+        statistics.visibleCount = m_objectCount;
+        statistics.firstPhaseCount = m_objectCount;
+        return statistics;
+    }
+
+    // Only valid once the last submitted frame has finished
+    void *data = nullptr;
+    VK_CHECK(vkMapMemory(m_renderer.getDevice(), m_statisticsMemory, 0,
+                         sizeof(Statistics), 0, &data));
+    memcpy(&statistics, data, sizeof(statistics));
+    vkUnmapMemory(m_renderer.getDevice(), m_statisticsMemory);
+
+    return statistics;
+}
+
+void GpuCulling::createDescriptors(const VkDescriptorBufferInfo &cameraBuffer,
+                                   const VkDescriptorImageInfo &hiZPyramid) {
+    // Camera
+    // layout (set = 0, binding = 0)
+    // Objects, draw commands, visible instances & statistics
+    // layout (set = 0, binding = 1..4)
+    // Hi-Z pyramid
+    // layout (set = 0, binding = 5)
+    // Visibility of the last frame
+    // layout (set = 0, binding = 6)
+    // Errors of the levels of detail
+    // layout (set = 0, binding = 7)
+    std::array<VkDescriptorSetLayoutBinding, 8> bindings;
+    for (uint32_t i = 0; i < static_cast<uint32_t>(bindings.size()); i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[i].pImmutableSamplers = nullptr;
+    }
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    bindings[5].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = {};
+    descriptorSetLayoutCI.sType =
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptorSetLayoutCI.bindingCount = static_cast<uint32_t>(bindings.size());
+    descriptorSetLayoutCI.pBindings = bindings.data();
+
+    DescriptorAllocator &descriptorAllocator =
+        m_renderer.getDescriptorAllocator();
+    m_descriptorSetLayout =
+        descriptorAllocator.getLayout(descriptorSetLayoutCI);
+
+    m_descriptorSet = descriptorAllocator.allocate(m_descriptorSetLayout);
+
+    Descriptors descriptors;
+    descriptors.camera = cameraBuffer;
+    descriptors.objects = m_objectBuffer.descriptor;
+    descriptors.drawCommands = m_drawCommandBuffer.descriptor;
+    descriptors.visibleInstances = m_visibleInstanceBuffer.descriptor;
+    descriptors.statistics.buffer = m_statisticsBuffer;
+    descriptors.statistics.offset = 0;
+    descriptors.statistics.range = sizeof(Statistics);
+    descriptors.hiZPyramid = hiZPyramid;
+    descriptors.visibility = m_visibilityBuffer.descriptor;
+    descriptors.lodErrors = m_lodErrorBuffer.descriptor;
+
+    const std::array<size_t, 8> offsets = {
+        offsetof(Descriptors, camera),
+        offsetof(Descriptors, objects),
+        offsetof(Descriptors, drawCommands),
+        offsetof(Descriptors, visibleInstances),
+        offsetof(Descriptors, statistics),
+        offsetof(Descriptors, hiZPyramid),
+        offsetof(Descriptors, visibility),
+        offsetof(Descriptors, lodErrors)};
+
+    std::vector<VkDescriptorUpdateTemplateEntry> entries(bindings.size());
+    for (uint32_t i = 0; i < static_cast<uint32_t>(entries.size()); i++) {
+        entries[i].dstBinding = i;
+        entries[i].dstArrayElement = 0;
+        entries[i].descriptorCount = 1;
+        entries[i].descriptorType = bindings[i].descriptorType;
+        entries[i].offset = offsets[i];
+        entries[i].stride = 0;
+    }
+
+    vkUpdateDescriptorSetWithTemplate(
+        m_renderer.getDevice(), m_descriptorSet,
+        descriptorAllocator.getUpdateTemplate(m_descriptorSetLayout, entries),
+        &descriptors);
+}
+
+Logger &GpuCulling::getLogger() { return m_renderer.getLogger(); }
+} // namespace vulkan_proto
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "buffer.h"
+#include "compute_pipeline.h"
+#include "headers.h"
+
+namespace vulkan_proto {
+
+struct Renderer;
+struct Logger;
+
+// Builds the indirect draw commands of the instance batches on the GPU. A
+// compute shader tests the bounding sphere of each instance against the view
+// frustum and appends the visible ones to the instance list of their batch.
+// When disabled, the draw commands and the instance list are filled once with
+// every instance and nothing is recorded per frame.
+//
+// With occlusion culling the frame is drawn in two phases, each with its own
+// draw commands and instance list. The first phase draws what was visible
+// last frame. The second one tests everything against the Hi-Z pyramid built
+// from the depth of the first phase, and draws the instances that became
+// visible.
+//
+// Every batch has one draw per level of detail of its mesh. Each visible
+// instance picks the coarsest level whose error, projected to the screen at
+// the distance of the instance, is below the pixel threshold of the camera.
+struct GpuCulling {
+    // Matches ObjectData of cull_cs.glsl, std430
+    struct Object {
+        // World space center in xyz, radius in w
+        glm::vec4 boundingSphere = glm::vec4(0.0f);
+        // Draw of the first level of the batch, the others follow it
+        uint32_t firstDraw = 0;
+        uint32_t lodCount = 1;
+        uint32_t transformIndex = 0;
+        // Where the instances of the batch start in the instance list
+        uint32_t firstInstance = 0;
+        // World size of an object space unit, for the errors of the levels
+        float lodScale = 1.0f;
+        uint32_t padding[3] = {};
+    };
+
+    // Matches Statistics of cull_cs.glsl
+    struct Statistics {
+        // Visible at the end of the frame
+        uint32_t visibleCount = 0;
+        uint32_t firstPhaseCount = 0;
+        uint32_t secondPhaseCount = 0;
+        // Inside the frustum, but behind the Hi-Z pyramid
+        uint32_t occludedCount = 0;
+    };
+
+    // Descriptors of the set, in the order of the bindings
+    struct Descriptors {
+        VkDescriptorBufferInfo camera = {};
+        VkDescriptorBufferInfo objects = {};
+        VkDescriptorBufferInfo drawCommands = {};
+        VkDescriptorBufferInfo visibleInstances = {};
+        VkDescriptorBufferInfo statistics = {};
+        VkDescriptorImageInfo hiZPyramid = {};
+        VkDescriptorBufferInfo visibility = {};
+        VkDescriptorBufferInfo lodErrors = {};
+    };
+
+    const Renderer &m_renderer;
+    ComputePipeline m_pipeline;
+    bool m_enabled = false;
+    bool m_occlusion = false;
+
+    uint32_t m_objectCount = 0;
+    uint32_t m_drawCount = 0;
+    // Most levels of any object
+    uint32_t m_lodCount = 1;
+
+    Buffer m_objectBuffer;
+    // Draw commands with zero instances, copied over the draw commands at the
+    // start of each frame
+    Buffer m_drawTemplateBuffer;
+    Buffer m_drawCommandBuffer;
+    // Indices to the model matrices. Each phase has m_lodCount lists of
+    // m_objectCount instances, one per level. Each batch has a fixed range in
+    // every list, which the vertex shader gets as a push constant and
+    // offsets with gl_InstanceIndex.
+    Buffer m_visibleInstanceBuffer;
+    // Per object, whether it was visible at the end of the last frame
+    Buffer m_visibilityBuffer;
+    // Per draw, the error of its level
+    Buffer m_lodErrorBuffer;
+
+    // Host visible Statistics, for logging only
+    VkBuffer m_statisticsBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_statisticsMemory = VK_NULL_HANDLE;
+
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSet m_descriptorSet = VK_NULL_HANDLE;
+
+    GpuCulling(Renderer &renderer);
+    ~GpuCulling();
+    void create(bool enabled, bool occlusion,
+                const std::vector<Object> &objects,
+                const std::vector<VkDrawIndexedIndirectCommand> &draws,
+                const std::vector<float> &lodErrors,
+                const VkDescriptorBufferInfo &cameraBuffer,
+                const VkDescriptorImageInfo &hiZPyramid);
+    void destroy();
+    // The pyramid is recreated with the swapchain
+    void updateHiZPyramid(const VkDescriptorImageInfo &hiZPyramid) const;
+    uint32_t getPhaseCount() const { return m_occlusion ? 2 : 1; }
+    // Replaces the draw commands and the visible instances with ones culled
+    // elsewhere, only when the culling shader is disabled
+    void uploadDraws(const std::vector<VkDrawIndexedIndirectCommand> &draws,
+                     const std::vector<uint32_t> &visibleInstances) const;
+    // Records the culling dispatch of a phase, must be recorded outside a
+    // render pass. The draw commands of phase p start at p * m_drawCount.
+    void recordCommands(VkCommandBuffer commandBuffer, uint32_t phase) const;
+    Statistics getStatistics() const;
+    // Where the instances of a batch start in the instance list of a phase
+    // and a level
+    uint32_t getFirstInstance(uint32_t phase, uint32_t lod,
+                              uint32_t batchFirstInstance) const {
+        return (phase * m_lodCount + lod) * m_objectCount + batchFirstInstance;
+    }
+    Logger &getLogger();
+
+  private:
+    void createDescriptors(const VkDescriptorBufferInfo &cameraBuffer,
+                           const VkDescriptorImageInfo &hiZPyramid);
+};
+} // namespace vulkan_proto
@@ -0,0 +1,98 @@
+#include "gpu_timer.h"
+#include "renderer.h"
+
+namespace vulkan_proto {
+GpuTimer::GpuTimer(Renderer &renderer) : m_renderer(renderer) {}
+GpuTimer::~GpuTimer() {}
+
+void GpuTimer::create(uint32_t commandBufferCount, bool recycle) {
+    LOG("=Create GPU timer=");
+    if (recycle) {
+        destroy();
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_renderer.getPhysicalDevice(), &properties);
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(m_renderer.getPhysicalDevice(),
+                                             &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(
+        m_renderer.getPhysicalDevice(), &queueFamilyCount,
+        queueFamilies.data());
+    const uint32_t validBits =
+        queueFamilies[m_renderer.getGraphicsFamilyIndex()].timestampValidBits;
+
+    if (validBits == 0 || properties.limits.timestampPeriod <= 0.0f) {
+        LOG("Timestamps are not supported by the graphics queue, GPU times "
+            "are not measured");
+        return;
+    }
+
+    m_timestampPeriod = properties.limits.timestampPeriod;
+    m_timestampMask =
+        validBits >= 64 ? ~uint64_t(0) : (uint64_t(1) << validBits) - 1;
+    m_commandBufferCount = commandBufferCount;
+
+    VkQueryPoolCreateInfo queryPoolCi = {};
+    queryPoolCi.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolCi.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolCi.queryCount = 2 * m_commandBufferCount;
+
+    VK_CHECK(vkCreateQueryPool(m_renderer.getDevice(), &queryPoolCi,
+                               m_renderer.getAllocator(), &m_queryPool));
+}
+
+void GpuTimer::destroy() {
+    LOG("=Destroy GPU timer=");
+    vkDestroyQueryPool(m_renderer.getDevice(), m_queryPool,
+                       m_renderer.getAllocator());
+    m_queryPool = VK_NULL_HANDLE;
+    m_commandBufferCount = 0;
+    m_timestampPeriod = 0.0f;
+    m_timestampMask = 0;
+}
+
+void GpuTimer::begin(VkCommandBuffer commandBuffer, uint32_t index) const {
+    if (isSupported() == false) {
+        return;
+    }
+
+    vkCmdResetQueryPool(commandBuffer, m_queryPool, 2 * index, 2);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                        m_queryPool, 2 * index);
+}
+
+void GpuTimer::end(VkCommandBuffer commandBuffer, uint32_t index) const {
+    if (isSupported() == false) {
+        return;
+    }
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        m_queryPool, 2 * index + 1);
+}
+
+bool GpuTimer::getMilliseconds(uint32_t index, double &milliseconds) const {
+    if (isSupported() == false || index >= m_commandBufferCount) {
+        return false;
+    }
+
+    std::array<uint64_t, 2> timestamps = {};
+    const VkResult result = vkGetQueryPoolResults(
+        m_renderer.getDevice(), m_queryPool, 2 * index, 2,
+        sizeof(timestamps), timestamps.data(), sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT);
+    if (result == VK_NOT_READY) {
+        return false;
+    }
+    VK_CHECK(result);
+
+    const uint64_t ticks = (timestamps[1] - timestamps[0]) & m_timestampMask;
+    milliseconds = ticks * static_cast<double>(m_timestampPeriod) * 1e-6;
+
+    return true;
+}
+
+Logger &GpuTimer::getLogger() { return m_renderer.getLogger(); }
+} // namespace vulkan_proto
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "headers.h"
+
+namespace vulkan_proto {
+
+struct Renderer;
+struct Logger;
+
+// Measures the GPU time of whole command buffers with timestamp queries. Each
+// command buffer has its own pair of queries, so the prerecorded command
+// buffers of the swapchain images never overwrite each other's results.
+struct GpuTimer {
+    const Renderer &m_renderer;
+    VkQueryPool m_queryPool = VK_NULL_HANDLE;
+    uint32_t m_commandBufferCount = 0;
+    // Nanoseconds per timestamp tick, zero if timestamps are not supported
+    float m_timestampPeriod = 0.0f;
+    uint64_t m_timestampMask = 0;
+
+    GpuTimer(Renderer &renderer);
+    ~GpuTimer();
+    void create(uint32_t commandBufferCount, bool recycle = false);
+    void destroy();
+    // Record at the start & the end of the command buffer, outside of render
+    // passes
+    void begin(VkCommandBuffer commandBuffer, uint32_t index) const;
+    void end(VkCommandBuffer commandBuffer, uint32_t index) const;
+    // False if the command buffer has not finished since it was submitted
+    bool getMilliseconds(uint32_t index, double &milliseconds) const;
+    bool isSupported() const { return m_timestampPeriod > 0.0f; }
+    Logger &getLogger();
+};
+} // namespace vulkan_proto
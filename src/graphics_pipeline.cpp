@@ -1,22 +1,19 @@
 #include "graphics_pipeline.h"
-#include "DirStackFileIncluder.h"
 #include "logger.h"
 #include "renderer.h"
-#include <glslang/SPIRV/GlslangToSpv.h>
-
-bool vulkan_proto::GraphicsPipeline::glslangInitialized = false;
 
 namespace vulkan_proto {
 GraphicsPipeline::GraphicsPipeline(Renderer &renderer) : m_renderer(renderer) {}
 GraphicsPipeline::~GraphicsPipeline() {}
 
-void GraphicsPipeline::create(bool recycle) {
+void GraphicsPipeline::create(const nlohmann::json &shaders,
+                              DepthMode depthMode, bool recycle,
+                              const PipelineTarget &target) {
     LOG("=Create graphics pipeline=");
     if (recycle) {
         destroy(recycle);
     }
 
-    auto shaders = m_renderer.getProgramInput().at("shaders");
     const uint32_t numShaderStages = static_cast<uint32_t>(shaders.size());
     m_shaderModules.resize(numShaderStages);
     std::vector<VkPipelineShaderStageCreateInfo> shaderCIs(numShaderStages);
@@ -54,10 +51,11 @@ void GraphicsPipeline::create(bool recycle) {
     for (const auto &it : shaders) {
         setShaderStage(it.at("type").get<std::string>());
 
-        VkShaderModule sm = createShaderModuleFromGLSL(
-            std::string(m_renderer.getDataPath() +
-                        it.at("path").get<std::string>()),
-            stage);
+        VkShaderModule sm =
+            m_renderer.getShaderCompiler().createShaderModuleFromGLSL(
+                std::string(m_renderer.getDataPath() +
+                            it.at("path").get<std::string>()),
+                stage);
         THROW_IF(sm == VK_NULL_HANDLE,
                  "Shader module is VK_NULL_HANDLE for shader file %s",
                  it.at("path").get<std::string>().c_str());
@@ -78,27 +76,19 @@ void GraphicsPipeline::create(bool recycle) {
         ++shaderStageIndex;
     }
 
-    // Vertex input binding
+    // Vertex input binding, the layout of the geometry pool
     VkVertexInputBindingDescription inputBinding = {};
     inputBinding.binding = 0;
-    inputBinding.stride = 32;
+    inputBinding.stride = getVertexStride(m_renderer.getVertexFormat());
     inputBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
-    std::vector<VkVertexInputAttributeDescription> inputAttributes(3);
-    inputAttributes[0].location = 0;
-    inputAttributes[0].binding = inputBinding.binding;
-    inputAttributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-    inputAttributes[0].offset = 0;
-
-    inputAttributes[1].location = 1;
-    inputAttributes[1].binding = inputBinding.binding;
-    inputAttributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-    inputAttributes[1].offset = 12;
+    std::vector<VkVertexInputAttributeDescription> inputAttributes;
+    getVertexAttributes(m_renderer.getVertexFormat(), inputAttributes);
 
-    inputAttributes[2].location = 2;
-    inputAttributes[2].binding = inputBinding.binding;
-    inputAttributes[2].format = VK_FORMAT_R32G32_SFLOAT;
-    inputAttributes[2].offset = 24;
+    // Depth only needs the position
+    if (depthMode == DepthMode::DepthOnly) {
+        inputAttributes.resize(1);
+    }
 
     VkPipelineVertexInputStateCreateInfo vertexInputCI = {};
     vertexInputCI.sType =
@@ -119,8 +109,10 @@ void GraphicsPipeline::create(bool recycle) {
     colBlendAttch.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
     colBlendAttch.alphaBlendOp = VK_BLEND_OP_ADD;
     colBlendAttch.colorWriteMask =
-        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-        VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        depthMode == DepthMode::DepthOnly
+            ? 0
+            : VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                  VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
 
     VkPipelineColorBlendStateCreateInfo colorBlendingCI = {};
     colorBlendingCI.sType =
@@ -140,10 +132,12 @@ void GraphicsPipeline::create(bool recycle) {
     pipelineLayoutCI.setLayoutCount =
         static_cast<uint32_t>(m_renderer.getDescriptorSetLayouts().size());
     pipelineLayoutCI.pSetLayouts = m_renderer.getDescriptorSetLayouts().data();
+    const std::vector<VkPushConstantRange> &pushConstantRanges =
+        target.pushConstantRanges.empty() ? m_renderer.getPushConstantRanges()
+                                          : target.pushConstantRanges;
     pipelineLayoutCI.pushConstantRangeCount =
-        static_cast<uint32_t>(m_renderer.getPushConstantRanges().size());
-    pipelineLayoutCI.pPushConstantRanges =
-        m_renderer.getPushConstantRanges().data();
+        static_cast<uint32_t>(pushConstantRanges.size());
+    pipelineLayoutCI.pPushConstantRanges = pushConstantRanges.data();
 
     VK_CHECK(vkCreatePipelineLayout(m_renderer.getDevice(), &pipelineLayoutCI,
                                     m_renderer.getAllocator(), &m_layout));
@@ -176,6 +170,14 @@ void GraphicsPipeline::create(bool recycle) {
     viewPortStateCI.scissorCount = 1;
     viewPortStateCI.pScissors = &scissor;
 
+    const std::array<VkDynamicState, 2> dynamicStates = {
+        VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamicStateCI = {};
+    dynamicStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicStateCI.dynamicStateCount =
+        static_cast<uint32_t>(dynamicStates.size());
+    dynamicStateCI.pDynamicStates = dynamicStates.data();
+
     // Rasterizer
     VkPipelineRasterizationStateCreateInfo rasterizerStateCI = {};
     rasterizerStateCI.sType =
@@ -225,8 +227,10 @@ void GraphicsPipeline::create(bool recycle) {
     depthStencilCI.sType =
         VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
     depthStencilCI.depthTestEnable = true;
-    depthStencilCI.depthWriteEnable = true;
-    depthStencilCI.depthCompareOp = VK_COMPARE_OP_LESS;
+    depthStencilCI.depthWriteEnable = depthMode != DepthMode::DepthEqual;
+    depthStencilCI.depthCompareOp = depthMode == DepthMode::DepthEqual
+                                        ? VK_COMPARE_OP_EQUAL
+                                        : VK_COMPARE_OP_LESS;
     depthStencilCI.depthBoundsTestEnable = false;
     depthStencilCI.minDepthBounds = 0.0f;
     depthStencilCI.maxDepthBounds = 1.0f;
@@ -246,9 +250,12 @@ void GraphicsPipeline::create(bool recycle) {
     pipelineCI.pMultisampleState = &multisamplingStateCI;
     pipelineCI.pDepthStencilState = &depthStencilCI;
     pipelineCI.pColorBlendState = &colorBlendingCI;
-    pipelineCI.pDynamicState = nullptr;
+    pipelineCI.pDynamicState =
+        target.dynamicViewport ? &dynamicStateCI : nullptr;
     pipelineCI.layout = m_layout;
-    pipelineCI.renderPass = m_renderer.getRenderPass();
+    pipelineCI.renderPass = target.renderPass != VK_NULL_HANDLE
+                                ? target.renderPass
+                                : m_renderer.getRenderPass();
     pipelineCI.subpass = 0;
     pipelineCI.basePipelineHandle = VK_NULL_HANDLE;
     pipelineCI.basePipelineIndex = -1;
@@ -267,10 +274,6 @@ void GraphicsPipeline::create(bool recycle) {
 
 void GraphicsPipeline::destroy(bool recycle) {
     LOG("=Destroy graphics pipeline=");
-    if (!recycle && glslangInitialized) {
-        glslang::FinalizeProcess();
-        glslangInitialized = false;
-    }
     vkDestroyPipelineLayout(m_renderer.getDevice(), m_layout,
                             m_renderer.getAllocator());
     vkDestroyPipeline(m_renderer.getDevice(), m_handle,
@@ -287,119 +290,4 @@ void GraphicsPipeline::destroy(bool recycle) {
 }
 
 Logger &GraphicsPipeline::getLogger() { return m_renderer.getLogger(); }
-
-VkShaderModule GraphicsPipeline::createShaderModule(const uint32_t *code,
-                                                    uint32_t bytes) {
-    VkShaderModuleCreateInfo createInfo = {};
-    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = bytes;
-    createInfo.pCode = code;
-
-    VkShaderModule shaderModule = VK_NULL_HANDLE;
-    VK_CHECK(vkCreateShaderModule(m_renderer.getDevice(), &createInfo,
-                                  m_renderer.getAllocator(), &shaderModule));
-
-    return shaderModule;
-}
-
-VkShaderModule
-GraphicsPipeline::createShaderModuleFromSpirV(const char *fName) {
-    std::ifstream file(fName, std::ios::ate | std::ios::binary);
-    THROW_IF(file.is_open() == false, "Failed to open file!");
-    const uint32_t fileSize = (uint32_t)file.tellg();
-    std::vector<char> buffer(fileSize);
-    file.seekg(0);
-    file.read(buffer.data(), fileSize);
-    file.close();
-
-    return createShaderModule(reinterpret_cast<uint32_t *>(buffer.data()),
-                              static_cast<uint32_t>(buffer.size()));
-}
-
-VkShaderModule
-GraphicsPipeline::createShaderModuleFromGLSL(std::string &&filename,
-                                             EShLanguage shaderStage) {
-    LOG("=Creating shader module from %s=", filename.c_str());
-    // Initialize only once per process
-    if (!glslangInitialized) {
-        glslang::InitializeProcess();
-        glslangInitialized = true;
-    }
-
-    std::filesystem::path f{filename.c_str()};
-    THROW_IF(!std::filesystem::exists(f), "File %s does not exist",
-             filename.c_str());
-    std::ifstream file(filename.c_str(), std::ios::in);
-    THROW_IF(!file.is_open(), "Problem opening file %s", filename.c_str());
-
-    std::string sourceStr((std::istreambuf_iterator<char>(file)),
-                          std::istreambuf_iterator<char>());
-
-    const char *sourceCStr = sourceStr.c_str();
-    std::string pathStr(filename.substr(0, filename.find_last_of("/")));
-    DirStackFileIncluder includer;
-    includer.pushExternalLocalDirectory(pathStr);
-
-    glslang::TShader shader(shaderStage);
-    shader.setStrings(&sourceCStr, 1);
-
-    // Specify Vulkan/SpirV environment
-    // Get these from somewhere?
-    const int defaultVersion = 100;
-    const int clientInputSemanticsVersion = 100;
-    glslang::EShTargetClientVersion vulkanVersion =
-        glslang::EShTargetVulkan_1_0;
-    glslang::EShTargetLanguageVersion targetVersion = glslang::EShTargetSpv_1_0;
-
-    shader.setEnvInput(glslang::EShSourceGlsl, shaderStage,
-                       glslang::EShClientVulkan, clientInputSemanticsVersion);
-    shader.setEnvClient(glslang::EShClientVulkan, vulkanVersion);
-    shader.setEnvTarget(glslang::EShTargetSpv, targetVersion);
-
-    TBuiltInResource resources = DefaultTBuiltInResource;
-    EShMessages messages = (EShMessages)(EShMsgSpvRules | EShMsgVulkanRules);
-    std::string tempStr;
-
-    if (!shader.preprocess(&resources, defaultVersion, ENoProfile, false, false,
-                           messages, &tempStr, includer)) {
-        LOG("GLSL preprocessing failed for %s\n%s\n%s\n", filename.c_str(),
-            shader.getInfoLog(), shader.getInfoDebugLog());
-
-        return VK_NULL_HANDLE;
-    }
-
-    const char *preprocessedCStr = tempStr.c_str();
-    shader.setStrings(&preprocessedCStr, 1);
-
-    if (!shader.parse(&resources, defaultVersion, false, messages)) {
-        LOG("GLSL parse failed for %s\n%s\n%s\n", filename.c_str(),
-            shader.getInfoLog(), shader.getInfoDebugLog());
-
-        return VK_NULL_HANDLE;
-    }
-
-    glslang::TProgram program;
-    program.addShader(&shader);
-
-    if (!program.link(messages)) {
-        LOG("GLSL linking failed for %s\n%s\n%s\n", filename.c_str(),
-            shader.getInfoLog(), shader.getInfoDebugLog());
-
-        return VK_NULL_HANDLE;
-    }
-
-    std::vector<uint32_t> spirvCode;
-    spv::SpvBuildLogger logger;
-    glslang::SpvOptions spvOptions;
-    glslang::GlslangToSpv(*program.getIntermediate(shaderStage), spirvCode,
-                          &logger, &spvOptions);
-
-    if (logger.getAllMessages().length() > 0) {
-        LOG(logger.getAllMessages().c_str());
-    }
-
-    return createShaderModule(
-        spirvCode.data(),
-        static_cast<uint32_t>(spirvCode.size() * sizeof(spirvCode[0])));
-}
 } // namespace vulkan_proto
@@ -6,13 +6,19 @@
 #include "util.h"
 #include <GLFW/glfw3.h>
 #include <array>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <cstring>
+#include <exception>
 #include <filesystem>
 #include <fstream>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <string>
@@ -0,0 +1,304 @@
+#include "hiz_pyramid.h"
+#include "renderer.h"
+
+namespace vulkan_proto {
+HiZPyramid::HiZPyramid(Renderer &renderer)
+    : m_renderer(renderer), m_pipeline(renderer) {}
+HiZPyramid::~HiZPyramid() {}
+
+void HiZPyramid::create(bool recycle) {
+    LOG("=Create Hi-Z pyramid=");
+    if (recycle) {
+        destroy();
+    }
+
+    createImage();
+    createDescriptors();
+
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = 4 * sizeof(int32_t);
+
+    m_pipeline.create(
+        m_renderer.getProgramInput().at("compute_shaders").at("hiz"),
+        {m_descriptorSetLayout}, {pushConstantRange});
+}
+
+void HiZPyramid::destroy() {
+    LOG("=Destroy Hi-Z pyramid=");
+    m_pipeline.destroy();
+
+    // The layout & sets are owned by the descriptor allocator, the sets are
+    // freed when the swapchain is recreated
+    m_descriptorSetLayout = VK_NULL_HANDLE;
+    m_descriptorSets.clear();
+
+    vkDestroySampler(m_renderer.getDevice(), m_sampler,
+                     m_renderer.getAllocator());
+    m_sampler = VK_NULL_HANDLE;
+
+    for (auto &view : m_levelViews) {
+        vkDestroyImageView(m_renderer.getDevice(), view,
+                           m_renderer.getAllocator());
+    }
+    m_levelViews.clear();
+    vkDestroyImageView(m_renderer.getDevice(), m_view,
+                       m_renderer.getAllocator());
+    m_view = VK_NULL_HANDLE;
+
+    vkDestroyImage(m_renderer.getDevice(), m_image, m_renderer.getAllocator());
+    vkFreeMemory(m_renderer.getDevice(), m_memory, m_renderer.getAllocator());
+    m_image = VK_NULL_HANDLE;
+    m_memory = VK_NULL_HANDLE;
+
+    m_descriptor = {};
+    m_width = 0;
+    m_height = 0;
+    m_levelCount = 0;
+}
+
+void HiZPyramid::recordCommands(VkCommandBuffer commandBuffer) const {
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask =
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask =
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      m_pipeline.m_handle);
+
+    // Must match local_size_x & local_size_y of the shader
+    const uint32_t groupSize = 8;
+    const VkExtent2D extent = m_renderer.getSwapchainExtent();
+    int32_t sizes[4] = {static_cast<int32_t>(extent.width),
+                        static_cast<int32_t>(extent.height),
+                        static_cast<int32_t>(m_width),
+                        static_cast<int32_t>(m_height)};
+
+    for (uint32_t level = 0; level < m_levelCount; level++) {
+        // Each level reads the one written before it, the first one also
+        // waits for the previous frame to be done with the pyramid
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                             &barrier, 0, nullptr, 0, nullptr);
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                                m_pipeline.m_layout, 0, 1,
+                                &m_descriptorSets[level], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, m_pipeline.m_layout,
+                           VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(sizes),
+                           sizes);
+        vkCmdDispatch(commandBuffer, (sizes[2] + groupSize - 1) / groupSize,
+                      (sizes[3] + groupSize - 1) / groupSize, 1);
+
+        sizes[0] = sizes[2];
+        sizes[1] = sizes[3];
+        sizes[2] = std::max(sizes[2] / 2, 1);
+        sizes[3] = std::max(sizes[3] / 2, 1);
+    }
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier,
+                         0, nullptr, 0, nullptr);
+}
+
+void HiZPyramid::createImage() {
+    auto previousPowerOfTwo = [](uint32_t value) {
+        uint32_t power = 1;
+        while (power * 2 <= value) {
+            power *= 2;
+        }
+        return power;
+    };
+
+    const VkExtent2D extent = m_renderer.getSwapchainExtent();
+    m_width = previousPowerOfTwo(extent.width);
+    m_height = previousPowerOfTwo(extent.height);
+    m_levelCount = 1;
+    while ((std::max(m_width, m_height) >> m_levelCount) > 0) {
+        m_levelCount++;
+    }
+
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = m_width;
+    imageInfo.extent.height = m_height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = m_levelCount;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = VK_FORMAT_R32_SFLOAT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
+                      VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    VK_CHECK(vkCreateImage(m_renderer.getDevice(), &imageInfo,
+                           m_renderer.getAllocator(), &m_image));
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(m_renderer.getDevice(), m_image,
+                                 &memRequirements);
+
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = m_renderer.findMemoryType(
+        memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    VK_CHECK(vkAllocateMemory(m_renderer.getDevice(), &allocInfo,
+                              m_renderer.getAllocator(), &m_memory));
+    VK_CHECK(vkBindImageMemory(m_renderer.getDevice(), m_image, m_memory, 0));
+
+    VkImageViewCreateInfo imageViewCi = {};
+    imageViewCi.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    imageViewCi.image = m_image;
+    imageViewCi.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    imageViewCi.format = VK_FORMAT_R32_SFLOAT;
+    imageViewCi.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    imageViewCi.subresourceRange.baseMipLevel = 0;
+    imageViewCi.subresourceRange.levelCount = m_levelCount;
+    imageViewCi.subresourceRange.baseArrayLayer = 0;
+    imageViewCi.subresourceRange.layerCount = 1;
+    VK_CHECK(vkCreateImageView(m_renderer.getDevice(), &imageViewCi,
+                               m_renderer.getAllocator(), &m_view));
+
+    m_levelViews.resize(m_levelCount);
+    for (uint32_t level = 0; level < m_levelCount; level++) {
+        imageViewCi.subresourceRange.baseMipLevel = level;
+        imageViewCi.subresourceRange.levelCount = 1;
+        VK_CHECK(vkCreateImageView(m_renderer.getDevice(), &imageViewCi,
+                                   m_renderer.getAllocator(),
+                                   &m_levelViews[level]));
+    }
+
+    VkSamplerCreateInfo samplerCi = {};
+    samplerCi.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerCi.magFilter = VK_FILTER_NEAREST;
+    samplerCi.minFilter = VK_FILTER_NEAREST;
+    samplerCi.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCi.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCi.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCi.anisotropyEnable = VK_FALSE;
+    samplerCi.maxAnisotropy = 1.0f;
+    samplerCi.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    samplerCi.unnormalizedCoordinates = VK_FALSE;
+    samplerCi.compareEnable = VK_FALSE;
+    samplerCi.compareOp = VK_COMPARE_OP_ALWAYS;
+    samplerCi.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerCi.mipLodBias = 0.0f;
+    samplerCi.minLod = 0.0f;
+    samplerCi.maxLod = static_cast<float>(m_levelCount);
+    VK_CHECK(vkCreateSampler(m_renderer.getDevice(), &samplerCi,
+                             m_renderer.getAllocator(), &m_sampler));
+
+    m_descriptor.sampler = m_sampler;
+    m_descriptor.imageView = m_view;
+    m_descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    // The pyramid stays in general layout, it is both written and sampled.
+    // Until the first build it reads as the far plane, which culls nothing.
+    VkCommandBuffer commandBuffer = m_renderer.beginSingleTimeCommands();
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = m_image;
+    barrier.subresourceRange = imageViewCi.subresourceRange;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = m_levelCount;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &barrier);
+
+    VkClearColorValue clearColor = {};
+    clearColor.float32[0] = 1.0f;
+    vkCmdClearColorImage(commandBuffer, m_image, VK_IMAGE_LAYOUT_GENERAL,
+                         &clearColor, 1, &barrier.subresourceRange);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr,
+                         0, nullptr, 1, &barrier);
+    m_renderer.endSingleTimeCommands(commandBuffer);
+}
+
+void HiZPyramid::createDescriptors() {
+    // Source level, or the depth buffer for level 0
+    // layout (set = 0, binding = 0)
+    // Destination level
+    // layout (set = 0, binding = 1)
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings;
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[0].pImmutableSamplers = nullptr;
+
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[1].pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = {};
+    descriptorSetLayoutCI.sType =
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptorSetLayoutCI.bindingCount = static_cast<uint32_t>(bindings.size());
+    descriptorSetLayoutCI.pBindings = bindings.data();
+
+    DescriptorAllocator &descriptorAllocator =
+        m_renderer.getDescriptorAllocator();
+    m_descriptorSetLayout =
+        descriptorAllocator.getLayout(descriptorSetLayoutCI);
+
+    m_descriptorSets.resize(m_levelCount);
+    for (auto &set : m_descriptorSets) {
+        set = descriptorAllocator.allocateSwapchain(m_descriptorSetLayout);
+    }
+
+    std::vector<LevelDescriptors> levelDescriptors(m_levelCount);
+    for (uint32_t level = 0; level < m_levelCount; level++) {
+        VkDescriptorImageInfo &source = levelDescriptors[level].source;
+        source.sampler = m_sampler;
+        if (level == 0) {
+            source.imageView = m_renderer.getDepthView();
+            source.imageLayout =
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        } else {
+            source.imageView = m_levelViews[level - 1];
+            source.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        }
+
+        VkDescriptorImageInfo &destination =
+            levelDescriptors[level].destination;
+        destination.sampler = VK_NULL_HANDLE;
+        destination.imageView = m_levelViews[level];
+        destination.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    }
+
+    const VkDescriptorUpdateTemplate updateTemplate =
+        descriptorAllocator.getUpdateTemplate(
+            m_descriptorSetLayout,
+            {{0, 0, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+              offsetof(LevelDescriptors, source), 0},
+             {1, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+              offsetof(LevelDescriptors, destination), 0}});
+    for (uint32_t level = 0; level < m_levelCount; level++) {
+        vkUpdateDescriptorSetWithTemplate(
+            m_renderer.getDevice(), m_descriptorSets[level], updateTemplate,
+            &levelDescriptors[level]);
+    }
+}
+
+Logger &HiZPyramid::getLogger() { return m_renderer.getLogger(); }
+} // namespace vulkan_proto
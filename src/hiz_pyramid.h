@@ -0,0 +1,56 @@
+#pragma once
+
+#include "compute_pipeline.h"
+#include "headers.h"
+
+namespace vulkan_proto {
+
+struct Renderer;
+struct Logger;
+
+// Hierarchical depth: a mip chain of the depth buffer where each texel holds
+// the farthest depth of the texels it covers. Level 0 is the largest power of
+// two that fits in the swapchain extent.
+struct HiZPyramid {
+    // Descriptors of one level, in the order of the bindings
+    struct LevelDescriptors {
+        VkDescriptorImageInfo source = {};
+        VkDescriptorImageInfo destination = {};
+    };
+
+    const Renderer &m_renderer;
+    ComputePipeline m_pipeline;
+
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    uint32_t m_levelCount = 0;
+
+    VkImage m_image = VK_NULL_HANDLE;
+    VkDeviceMemory m_memory = VK_NULL_HANDLE;
+    // All levels, for sampling
+    VkImageView m_view = VK_NULL_HANDLE;
+    // One per level, for writing
+    std::vector<VkImageView> m_levelViews;
+    // Nearest, clamped to the edges
+    VkSampler m_sampler = VK_NULL_HANDLE;
+    // Sampler & view of the whole pyramid, in general layout
+    VkDescriptorImageInfo m_descriptor = {};
+
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    // One per level, reads the level above or the depth buffer
+    std::vector<VkDescriptorSet> m_descriptorSets;
+
+    HiZPyramid(Renderer &renderer);
+    ~HiZPyramid();
+    void create(bool recycle = false);
+    void destroy();
+    // Builds the pyramid from the depth buffer, which must be in
+    // VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+    void recordCommands(VkCommandBuffer commandBuffer) const;
+    Logger &getLogger();
+
+  private:
+    void createImage();
+    void createDescriptors();
+};
+} // namespace vulkan_proto
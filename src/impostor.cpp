@@ -0,0 +1,365 @@
+#include "impostor.h"
+#include "renderer.h"
+
+namespace {
+float signNotZero(float value) { return value < 0.0f ? -1.0f : 1.0f; }
+
+// Unit vector of a point in [-1, 1]^2 of the octahedral map, the upper
+// hemisphere in the middle diamond and the lower folded over the corners.
+// Same as octDecode of impostor_vs.glsl.
+glm::vec3 octDecode(const glm::vec2 &point) {
+    glm::vec3 direction(point.x, point.y,
+                        1.0f - std::abs(point.x) - std::abs(point.y));
+    if (direction.z < 0.0f) {
+        const float x = (1.0f - std::abs(point.y)) * signNotZero(point.x);
+        const float y = (1.0f - std::abs(point.x)) * signNotZero(point.y);
+        direction.x = x;
+        direction.y = y;
+    }
+    return glm::normalize(direction);
+}
+
+// Orthographic object to clip space matrix looking at the bounding sphere
+// from the given direction. The sphere fills the viewport and the depth
+// range, and the tile is upright like the quad of impostor_vs.glsl.
+glm::mat4 getCaptureMatrix(const glm::vec3 &direction,
+                           const glm::vec4 &boundingSphere) {
+    const glm::vec3 worldUp = std::abs(direction.z) > 0.99f
+                                  ? glm::vec3(0.0f, 1.0f, 0.0f)
+                                  : glm::vec3(0.0f, 0.0f, 1.0f);
+    const glm::vec3 right = glm::normalize(glm::cross(worldUp, direction));
+    const glm::vec3 up = glm::cross(direction, right);
+
+    const glm::vec3 center(boundingSphere);
+    const float inverseRadius =
+        boundingSphere.w > 0.0f ? 1.0f / boundingSphere.w : 1.0f;
+    // Rows, the clip space y points down and nearer is smaller
+    const glm::vec4 x(right * inverseRadius,
+                      -glm::dot(right, center) * inverseRadius);
+    const glm::vec4 y(-up * inverseRadius,
+                      glm::dot(up, center) * inverseRadius);
+    const glm::vec4 z(-0.5f * direction * inverseRadius,
+                      0.5f + 0.5f * glm::dot(direction, center) *
+                                 inverseRadius);
+    return glm::transpose(
+        glm::mat4(x, y, z, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)));
+}
+} // namespace
+
+namespace vulkan_proto {
+Impostors::Impostors(Renderer &renderer)
+    : m_renderer(renderer), m_pipeline(renderer),
+      m_capturePipeline(renderer) {}
+Impostors::~Impostors() {}
+
+void Impostors::create(const nlohmann::json &settings,
+                       GeometryPool &geometryPool, uint32_t atlasCount) {
+    m_enabled = settings.value("enabled", false);
+    if (m_enabled == false) {
+        return;
+    }
+
+    LOG("=Create impostors=");
+    createRenderPass();
+    createDepth();
+    m_atlases.resize(atlasCount);
+    for (auto &atlas : m_atlases) {
+        createAtlas(atlas);
+    }
+
+    // Not quantized, the corners are exact in every vertex format
+    const VertexFormat format = m_renderer.getVertexFormat();
+    const uint32_t stride = getVertexStride(format);
+    std::vector<uint8_t> vertices(4 * stride);
+    for (uint32_t i = 0; i < 4; i++) {
+        const glm::vec2 corner(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f);
+        encodeVertex(format, VertexQuantization(),
+                     glm::vec3(corner.x, corner.y, 0.0f), corner,
+                     &vertices[i * stride]);
+    }
+    const uint32_t indices[6] = {0, 1, 2, 2, 1, 3};
+    m_quad = geometryPool.allocate(vertices.data(), 4, indices, 6);
+
+    LOG("%u impostor atlases of %ux%u views, %ux%u pixels each", atlasCount,
+        s_gridSize, s_gridSize, s_atlasSize, s_atlasSize);
+}
+
+void Impostors::destroy(GeometryPool &geometryPool) {
+    if (m_enabled == false) {
+        return;
+    }
+
+    LOG("=Destroy impostors=");
+    m_pipeline.destroy();
+    geometryPool.free(m_quad);
+
+    const VkDevice device = m_renderer.getDevice();
+    for (auto &atlas : m_atlases) {
+        vkDestroyFramebuffer(device, atlas.framebuffer,
+                             m_renderer.getAllocator());
+        vkDestroyImageView(device, atlas.view, m_renderer.getAllocator());
+        vkDestroyImage(device, atlas.image, m_renderer.getAllocator());
+        vkFreeMemory(device, atlas.memory, m_renderer.getAllocator());
+    }
+    m_atlases.clear();
+
+    vkDestroyImageView(device, m_depthView, m_renderer.getAllocator());
+    vkDestroyImage(device, m_depthImage, m_renderer.getAllocator());
+    vkFreeMemory(device, m_depthMemory, m_renderer.getAllocator());
+    m_depthView = VK_NULL_HANDLE;
+    m_depthImage = VK_NULL_HANDLE;
+    m_depthMemory = VK_NULL_HANDLE;
+
+    vkDestroyRenderPass(device, m_renderPass, m_renderer.getAllocator());
+    m_renderPass = VK_NULL_HANDLE;
+    m_enabled = false;
+}
+
+void Impostors::createPipeline(bool recycle) {
+    m_pipeline.create(
+        m_renderer.getProgramInput().at("impostors").at("shaders"),
+        GraphicsPipeline::DepthMode::Default, recycle);
+}
+
+void Impostors::capture(
+    const std::vector<Capture> &captures, const GeometryPool &geometryPool,
+    const std::array<VkDescriptorSet, 2> &descriptorSets) {
+    THROW_IF(captures.size() != m_atlases.size(),
+             "%zu impostor captures for %zu atlases", captures.size(),
+             m_atlases.size());
+    LOG("=Capture impostors=");
+
+    // Only needed here, each tile sets its own viewport
+    PipelineTarget target;
+    target.renderPass = m_renderPass;
+    target.dynamicViewport = true;
+    target.pushConstantRanges.emplace_back();
+    target.pushConstantRanges.back().stageFlags =
+        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    target.pushConstantRanges.back().offset = 0;
+    target.pushConstantRanges.back().size = sizeof(CaptureConstants);
+
+    m_capturePipeline.create(
+        m_renderer.getProgramInput().at("impostors").at("capture_shaders"),
+        GraphicsPipeline::DepthMode::Default, false, target);
+
+    VkCommandBuffer commandBuffer = m_renderer.beginSingleTimeCommands();
+
+    std::array<VkClearValue, 2> clearValues = {};
+    clearValues[0].color = {0.0f, 0.0f, 0.0f, 0.0f};
+    clearValues[1].depthStencil = {1.0f, 0};
+
+    VkRenderPassBeginInfo renderPassInfo = {};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = m_renderPass;
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = {s_atlasSize, s_atlasSize};
+    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+    renderPassInfo.pClearValues = clearValues.data();
+
+    const VkDeviceSize offsets[] = {0};
+    for (size_t i = 0; i < captures.size(); i++) {
+        const Capture &capture = captures[i];
+        renderPassInfo.framebuffer = m_atlases[i].framebuffer;
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                             VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          m_capturePipeline.m_handle);
+        vkCmdBindDescriptorSets(
+            commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+            m_capturePipeline.m_layout, 0,
+            static_cast<uint32_t>(descriptorSets.size()),
+            descriptorSets.data(), 0, nullptr);
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1,
+                               &geometryPool.m_vertexBuffer, offsets);
+        vkCmdBindIndexBuffer(commandBuffer, geometryPool.m_indexBuffer, 0,
+                             capture.indexType);
+
+        CaptureConstants constants;
+        constants.materialIndex = capture.materialIndex;
+        const glm::mat4 dequantization =
+            glm::scale(glm::translate(glm::mat4(1.0f),
+                                      capture.quantization.offset),
+                       capture.quantization.scale);
+        for (uint32_t y = 0; y < s_gridSize; y++) {
+            for (uint32_t x = 0; x < s_gridSize; x++) {
+                VkViewport viewport = {};
+                viewport.x = static_cast<float>(x * s_tileSize);
+                viewport.y = static_cast<float>(y * s_tileSize);
+                viewport.width = static_cast<float>(s_tileSize);
+                viewport.height = static_cast<float>(s_tileSize);
+                viewport.minDepth = 0.0f;
+                viewport.maxDepth = 1.0f;
+                VkRect2D scissor = {};
+                scissor.offset = {static_cast<int32_t>(x * s_tileSize),
+                                  static_cast<int32_t>(y * s_tileSize)};
+                scissor.extent = {s_tileSize, s_tileSize};
+                vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+                vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+                // Direction at the center of the tile
+                const glm::vec2 point =
+                    (glm::vec2(x, y) + 0.5f) / static_cast<float>(s_gridSize) *
+                        2.0f -
+                    1.0f;
+                // The stored positions are mapped to object space first
+                constants.viewProjection =
+                    getCaptureMatrix(octDecode(point), capture.boundingSphere) *
+                    dequantization;
+                vkCmdPushConstants(commandBuffer, m_capturePipeline.m_layout,
+                                   VK_SHADER_STAGE_VERTEX_BIT |
+                                       VK_SHADER_STAGE_FRAGMENT_BIT,
+                                   0, sizeof(constants), &constants);
+                vkCmdDrawIndexed(commandBuffer, capture.indexCount, 1,
+                                 capture.firstIndex, capture.vertexOffset, 0);
+            }
+        }
+        vkCmdEndRenderPass(commandBuffer);
+    }
+
+    m_renderer.endSingleTimeCommands(commandBuffer);
+    m_capturePipeline.destroy();
+}
+
+float Impostors::getTexelSize(const glm::vec4 &boundingSphere) {
+    return 2.0f * boundingSphere.w / static_cast<float>(s_tileSize);
+}
+
+void Impostors::createRenderPass() {
+    VkAttachmentDescription colorAttchDes = {};
+    colorAttchDes.flags = 0;
+    colorAttchDes.format = VK_FORMAT_R8G8B8A8_UNORM;
+    colorAttchDes.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttchDes.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttchDes.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttchDes.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttchDes.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttchDes.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    colorAttchDes.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkAttachmentDescription depthAttchDes = {};
+    depthAttchDes.flags = 0;
+    depthAttchDes.format = m_renderer.getDepthFormat();
+    depthAttchDes.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthAttchDes.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttchDes.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttchDes.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttchDes.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttchDes.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthAttchDes.finalLayout =
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    std::array<VkAttachmentDescription, 2> attachments = {colorAttchDes,
+                                                          depthAttchDes};
+
+    VkAttachmentReference colorAttchRef = {};
+    colorAttchRef.attachment = 0;
+    colorAttchRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference depthAttchRef = {};
+    depthAttchRef.attachment = 1;
+    depthAttchRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass = {};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorAttchRef;
+    subpass.pDepthStencilAttachment = &depthAttchRef;
+
+    // The depth is shared, so each capture waits for the previous one to be
+    // done with it. The atlas is sampled afterwards.
+    std::array<VkSubpassDependency, 2> dependencies = {};
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[0].srcAccessMask =
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dstStageMask =
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[0].dstAccessMask =
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask =
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    VkRenderPassCreateInfo renderPassCi = {};
+    renderPassCi.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassCi.attachmentCount = static_cast<uint32_t>(attachments.size());
+    renderPassCi.pAttachments = attachments.data();
+    renderPassCi.subpassCount = 1;
+    renderPassCi.pSubpasses = &subpass;
+    renderPassCi.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassCi.pDependencies = dependencies.data();
+
+    VK_CHECK(vkCreateRenderPass(m_renderer.getDevice(), &renderPassCi,
+                                m_renderer.getAllocator(), &m_renderPass));
+}
+
+void Impostors::createAtlas(Atlas &atlas) {
+    m_renderer.createImage(
+        s_atlasSize, s_atlasSize, 1, VK_FORMAT_R8G8B8A8_UNORM,
+        VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, atlas.image, atlas.memory);
+
+    VkImageViewCreateInfo imageViewCi = {};
+    imageViewCi.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    imageViewCi.image = atlas.image;
+    imageViewCi.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    imageViewCi.format = VK_FORMAT_R8G8B8A8_UNORM;
+    imageViewCi.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    imageViewCi.subresourceRange.baseMipLevel = 0;
+    imageViewCi.subresourceRange.levelCount = 1;
+    imageViewCi.subresourceRange.baseArrayLayer = 0;
+    imageViewCi.subresourceRange.layerCount = 1;
+    VK_CHECK(vkCreateImageView(m_renderer.getDevice(), &imageViewCi,
+                               m_renderer.getAllocator(), &atlas.view));
+
+    const VkImageView attachments[] = {atlas.view, m_depthView};
+    VkFramebufferCreateInfo framebufferCi = {};
+    framebufferCi.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferCi.renderPass = m_renderPass;
+    framebufferCi.width = s_atlasSize;
+    framebufferCi.height = s_atlasSize;
+    framebufferCi.layers = 1;
+    framebufferCi.attachmentCount = 2;
+    framebufferCi.pAttachments = attachments;
+    VK_CHECK(vkCreateFramebuffer(m_renderer.getDevice(), &framebufferCi,
+                                 m_renderer.getAllocator(),
+                                 &atlas.framebuffer));
+
+    atlas.descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    atlas.descriptor.imageView = atlas.view;
+}
+
+void Impostors::createDepth() {
+    m_renderer.createImage(s_atlasSize, s_atlasSize, 1,
+                           m_renderer.getDepthFormat(), VK_IMAGE_TILING_OPTIMAL,
+                           VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_depthImage,
+                           m_depthMemory);
+
+    VkImageViewCreateInfo imageViewCi = {};
+    imageViewCi.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    imageViewCi.image = m_depthImage;
+    imageViewCi.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    imageViewCi.format = m_renderer.getDepthFormat();
+    imageViewCi.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    imageViewCi.subresourceRange.baseMipLevel = 0;
+    imageViewCi.subresourceRange.levelCount = 1;
+    imageViewCi.subresourceRange.baseArrayLayer = 0;
+    imageViewCi.subresourceRange.layerCount = 1;
+    VK_CHECK(vkCreateImageView(m_renderer.getDevice(), &imageViewCi,
+                               m_renderer.getAllocator(), &m_depthView));
+}
+
+Logger &Impostors::getLogger() { return m_renderer.getLogger(); }
+} // namespace vulkan_proto
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "geometry_pool.h"
+#include "graphics_pipeline.h"
+#include "headers.h"
+#include "vertex_format.h"
+
+namespace vulkan_proto {
+
+struct Renderer;
+struct Logger;
+
+// Camera facing quads that stand in for distant instances. Each batch has an
+// atlas of s_gridSize x s_gridSize tiles, each an orthographic view of the
+// mesh from one direction of an octahedral map of the whole sphere. The
+// atlases are rendered once at load time.
+//
+// The quad is drawn in the object space plane of the tile nearest to the
+// camera direction, through the center of the bounding sphere, so it lines
+// up with the mesh it replaces even under non-uniform scale.
+struct Impostors {
+    static constexpr uint32_t s_gridSize = 8;
+    static constexpr uint32_t s_tileSize = 64;
+    static constexpr uint32_t s_atlasSize = s_gridSize * s_tileSize;
+
+    // What is captured into one atlas
+    struct Capture {
+        // Object space, see Mesh
+        glm::vec4 boundingSphere = glm::vec4(0.0f);
+        // Full detail range in the geometry pool
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        int32_t vertexOffset = 0;
+        VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+        // Material textures of the mesh
+        uint32_t materialIndex = 0;
+        // Of the positions in the geometry pool
+        VertexQuantization quantization;
+    };
+
+    // Matches CaptureConstants of impostor_capture_vs.glsl. The view
+    // projection includes the dequantization of the positions.
+    struct CaptureConstants {
+        glm::mat4 viewProjection = glm::mat4(1.0f);
+        uint32_t materialIndex = 0;
+    };
+
+    struct Atlas {
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkFramebuffer framebuffer = VK_NULL_HANDLE;
+        // For the texture table, readable once captured
+        VkDescriptorImageInfo descriptor = {};
+    };
+
+    const Renderer &m_renderer;
+    bool m_enabled = false;
+    // Draws the quads in the main pass
+    GraphicsPipeline m_pipeline;
+    // Only exists while capturing
+    GraphicsPipeline m_capturePipeline;
+
+    std::vector<Atlas> m_atlases;
+    // Shared by every capture, they run one after the other
+    VkImage m_depthImage = VK_NULL_HANDLE;
+    VkDeviceMemory m_depthMemory = VK_NULL_HANDLE;
+    VkImageView m_depthView = VK_NULL_HANDLE;
+    VkRenderPass m_renderPass = VK_NULL_HANDLE;
+
+    // Corners in the xy of the positions, in [-1, 1]
+    GeometryPool::Allocation m_quad;
+
+    Impostors(Renderer &renderer);
+    ~Impostors();
+    // Allocates the atlases and the quad, does nothing unless enabled in the
+    // settings
+    void create(const nlohmann::json &settings, GeometryPool &geometryPool,
+                uint32_t atlasCount);
+    void destroy(GeometryPool &geometryPool);
+    // Needs the swapchain render pass & the descriptor set layouts of the
+    // renderer
+    void createPipeline(bool recycle = false);
+    // Renders every atlas, waits for the queue to idle. The descriptor sets
+    // are those of the main pass, for the material textures.
+    void capture(const std::vector<Capture> &captures,
+                 const GeometryPool &geometryPool,
+                 const std::array<VkDescriptorSet, 2> &descriptorSets);
+    // The size of one atlas texel on the mesh, in the units of the sphere
+    static float getTexelSize(const glm::vec4 &boundingSphere);
+    Logger &getLogger();
+
+  private:
+    void createRenderPass();
+    void createAtlas(Atlas &atlas);
+    void createDepth();
+};
+} // namespace vulkan_proto
@@ -33,7 +33,9 @@ void Instance::create() {
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "nengine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    // 1.1 for vkGetPhysicalDeviceFeatures2 & maintenance3, which descriptor
+    // indexing depends on
+    appInfo.apiVersion = VK_API_VERSION_1_1;
 
     VkInstanceCreateInfo instanceCi = {};
     instanceCi.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
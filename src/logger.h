@@ -6,6 +6,8 @@ struct Logger {
     std::chrono::steady_clock::time_point m_startingTime;
     std::stringstream m_timeSS;
     std::ofstream m_fileStream;
+    // Meshes log while loading on several threads
+    std::mutex m_mutex;
 
     Logger(const char *fName) {
         m_startingTime = std::chrono::steady_clock::now();
@@ -59,6 +61,7 @@ struct Logger {
 
     void log(std::string msg) {
 #ifndef NDEBUG
+        std::lock_guard<std::mutex> lock(m_mutex);
         formatTime();
         std::cout << m_timeSS.str().c_str() << " " << msg.c_str() << std::endl;
         if (m_fileStream.is_open()) {
@@ -0,0 +1,37 @@
+#include "mapped_file.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace vulkan_proto {
+MappedFile::~MappedFile() { close(); }
+
+bool MappedFile::open(const char *filename) {
+    close();
+    const int file = ::open(filename, O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+    struct stat status = {};
+    if (fstat(file, &status) == 0 && status.st_size > 0) {
+        const size_t size = static_cast<size_t>(status.st_size);
+        void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (data != MAP_FAILED) {
+            m_data = static_cast<const char *>(data);
+            m_size = size;
+            madvise(data, m_size, MADV_SEQUENTIAL);
+        }
+    }
+    ::close(file);
+    return m_data != nullptr;
+}
+
+void MappedFile::close() {
+    if (m_data != nullptr) {
+        munmap(const_cast<char *>(m_data), m_size);
+    }
+    m_data = nullptr;
+    m_size = 0;
+}
+} // namespace vulkan_proto
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "headers.h"
+
+namespace vulkan_proto {
+// Read only view of a whole file, unmapped when destroyed or closed. Pages
+// are read in ahead, the files are meant to be read front to back.
+struct MappedFile {
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // False when the file cannot be opened or mapped, or is empty
+    bool open(const char *filename);
+    void close();
+};
+} // namespace vulkan_proto
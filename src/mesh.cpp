@@ -1,114 +1,324 @@
 #include "mesh.h"
+#include "mesh_cache.h"
+#include "obj_loader.h"
+#include "overdraw.h"
 #include "renderer.h"
-#include <glm/gtx/hash.hpp>
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tinyobjloader/tiny_obj_loader.h>
-
-namespace std {
-template <> struct hash<vulkan_proto::Mesh::Vertex> {
-    size_t operator()(vulkan_proto::Mesh::Vertex const &vertex) const {
-        return ((hash<glm::vec3>()(vertex.position) ^
-                 (hash<glm::vec3>()(vertex.color) << 1)) >>
-                1) ^
-               (hash<glm::vec2>()(vertex.texCoord) << 1);
+#include "simplifier.h"
+#include "vertex_cache.h"
+#include "vertex_fetch.h"
+
+namespace {
+using vulkan_proto::Mesh;
+
+// Vertices are compared & hashed as raw bytes, which needs them to be
+// tightly packed. Unlike with operator==, 0.0 and -0.0 differ.
+static_assert(sizeof(Mesh::Vertex) == 5 * sizeof(float),
+              "Mesh::Vertex must have no padding");
+
+// Finalizer of MurmurHash3, every input bit affects every output bit
+uint64_t mix(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdull;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ull;
+    value ^= value >> 33;
+    return value;
+}
+
+uint64_t hashVertex(const Mesh::Vertex &vertex) {
+    // The last word is half padding, which is zero
+    uint64_t words[(sizeof(Mesh::Vertex) + 7) / sizeof(uint64_t)] = {};
+    memcpy(words, &vertex, sizeof(Mesh::Vertex));
+    uint64_t hash = sizeof(Mesh::Vertex);
+    for (uint64_t word : words) {
+        hash = (hash ^ mix(word)) * 0x9e3779b97f4a7c15ull;
+    }
+    return mix(hash);
+}
+
+// Open addressing hash set of vertex indices with linear probing. Sized for
+// the worst case of every corner being unique, so it never grows.
+struct VertexTable {
+    std::vector<uint32_t> m_slots;
+    uint64_t m_mask = 0;
+
+    explicit VertexTable(size_t cornerCount) {
+        // At most three quarters full
+        size_t capacity = 16;
+        while (capacity * 3 < cornerCount * 4) {
+            capacity *= 2;
+        }
+        m_slots.assign(capacity, ~0u);
+        m_mask = capacity - 1;
+    }
+
+    // Index of the vertex, appended to the vertices when not found
+    uint32_t findOrInsert(const Mesh::Vertex &vertex,
+                          std::vector<Mesh::Vertex> &vertices) {
+        for (uint64_t slot = hashVertex(vertex) & m_mask;;
+             slot = (slot + 1) & m_mask) {
+            const uint32_t index = m_slots[slot];
+            if (index == ~0u) {
+                m_slots[slot] = static_cast<uint32_t>(vertices.size());
+                vertices.push_back(vertex);
+                return m_slots[slot];
+            }
+            if (memcmp(&vertices[index], &vertex, sizeof(vertex)) == 0) {
+                return index;
+            }
+        }
     }
 };
-} // namespace std
+} // namespace
 
 namespace vulkan_proto {
 Mesh::Mesh(Renderer &renderer) : m_renderer(renderer) {}
 Mesh::~Mesh() {}
 
-void Mesh::create(const char *filename) {
-    LOG("=Create mesh=");
+void Mesh::create(const char *filename, GeometryPool &geometryPool,
+                  const MeshSettings &settings) {
+    load(filename, geometryPool, settings);
+    upload(geometryPool);
+}
+
+void Mesh::load(const char *filename, GeometryPool &geometryPool,
+                const MeshSettings &settings) {
+    LOG("=Load mesh %s=", filename);
     std::filesystem::path f{filename};
     THROW_IF(!std::filesystem::exists(f), "File %s does not exist", filename);
 
-    auto moveData =
-        [this](std::vector<auto> &data, VkBuffer &buffer,
-               VkDeviceMemory &memory, VkBufferUsageFlags usage) {
-            VkDeviceSize bufferSize = sizeof(data[0]) * data.size();
-            m_renderer.createBuffer(bufferSize, usage,
-                                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer,
-                                    memory);
-
-            VkBuffer stagingBuffer = VK_NULL_HANDLE;
-            VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
-            m_renderer.createBuffer(bufferSize,
-                                    VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                    stagingBuffer, stagingMemory);
-
-            m_renderer.copyCPUToGPU(reinterpret_cast<const void *>(data.data()),
-                                    bufferSize, stagingMemory, stagingBuffer,
-                                    buffer);
-
-            vkFreeMemory(m_renderer.getDevice(), stagingMemory,
-                         m_renderer.getAllocator());
-            vkDestroyBuffer(m_renderer.getDevice(), stagingBuffer,
-                            m_renderer.getAllocator());
-        };
-
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string err;
-    std::string warn;
-    std::unordered_map<Vertex, uint32_t> uniqueVertices = {};
-
-    THROW_IF(
-        !tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename),
-        "Failed to load model %s", filename);
-
-    for (const auto &shape : shapes) {
-        for (const auto &index : shape.mesh.indices) {
-            Vertex vertex = {};
-            vertex.position = {attrib.vertices[3 * index.vertex_index + 0],
-                               attrib.vertices[3 * index.vertex_index + 1],
-                               attrib.vertices[3 * index.vertex_index + 2]};
-            vertex.texCoord = {
-                attrib.texcoords[2 * index.texcoord_index + 0],
-                1.0f - attrib.texcoords[2 * index.texcoord_index + 1]};
-            vertex.color = {1.0f, 1.0f, 1.0f};
-
-            if (uniqueVertices.count(vertex) == 0) {
-                uniqueVertices[vertex] =
-                    static_cast<uint32_t>(m_vertices.size());
-                m_vertices.push_back(vertex);
-            }
+    MeshCacheKey key = getMeshCacheKey(filename, settings);
+    if (settings.cache &&
+        readMeshCache(filename, key, settings.retention, geometryPool, *this,
+                      m_staging)) {
+        LOG("Loaded from the cache, %u vertices, %zu triangles in %zu "
+            "meshlets, %zu levels of detail",
+            m_staging.vertexCount, m_lods[0].m_indexCount / 3,
+            m_meshlets.size(), m_lods.size());
+        LOG("%zu bytes in system memory", getMemorySize());
+        return;
+    }
 
-            m_indices.push_back(uniqueVertices[vertex]);
+    std::vector<uint8_t> vertexData;
+    std::vector<uint32_t> indices;
+    build(filename, settings, vertexData, indices);
+    if (settings.cache) {
+        key.contentHash = hashFile(filename);
+        if (!writeMeshCache(filename, key, settings.retention, *this,
+                            vertexData, indices)) {
+            LOG("Could not write the cache of %s", filename);
         }
     }
 
-    moveData(m_vertices, m_vertexBuffer, m_vertexMemory,
-             VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-                 VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-    moveData(m_indices, m_indexBuffer, m_indexMemory,
-             VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-                 VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+    m_staging = geometryPool.createStaging(
+        static_cast<uint32_t>(m_vertices.size()),
+        static_cast<uint32_t>(indices.size()));
+    if (!vertexData.empty()) {
+        memcpy(m_staging.vertices, vertexData.data(), vertexData.size());
+    }
+    if (!indices.empty()) {
+        memcpy(m_staging.indices, indices.data(),
+               sizeof(uint32_t) * indices.size());
+    }
+    retain(settings.retention);
+}
+
+void Mesh::upload(GeometryPool &geometryPool) {
+    m_geometry = geometryPool.allocate(m_staging);
+    for (auto &lod : m_lods) {
+        lod.m_firstIndex += m_geometry.firstIndex;
+    }
+    LOG("%s bit indices",
+        m_geometry.indexType == VK_INDEX_TYPE_UINT16 ? "16" : "32");
 }
 
-void Mesh::destroy() {
+void Mesh::destroy(GeometryPool &geometryPool) {
     LOG("=Destroy mesh=");
-    vkDestroyBuffer(m_renderer.getDevice(), m_indexBuffer,
-                    m_renderer.getAllocator());
-    vkFreeMemory(m_renderer.getDevice(), m_indexMemory,
-                 m_renderer.getAllocator());
-
-    vkDestroyBuffer(m_renderer.getDevice(), m_vertexBuffer,
-                    m_renderer.getAllocator());
-    vkFreeMemory(m_renderer.getDevice(), m_vertexMemory,
-                 m_renderer.getAllocator());
-
-    m_vertexBuffer = VK_NULL_HANDLE;
-    m_indexBuffer = VK_NULL_HANDLE;
-    m_vertexMemory = VK_NULL_HANDLE;
-    m_indexMemory = VK_NULL_HANDLE;
+    // Left when a load failed before the upload
+    geometryPool.destroyStaging(m_staging);
+    geometryPool.free(m_geometry);
     m_vertices.clear();
+    m_positions.clear();
     m_indices.clear();
+    m_meshlets.clear();
+    m_lods.clear();
+}
+
+void Mesh::getPositions(std::vector<glm::vec3> &positions) const {
+    if (m_vertices.empty()) {
+        positions = m_positions;
+        return;
+    }
+    positions.resize(m_vertices.size());
+    for (size_t i = 0; i < m_vertices.size(); i++) {
+        positions[i] = m_vertices[i].position;
+    }
+}
+
+void Mesh::retain(MeshRetention retention) {
+    // Swapped with empty vectors, clear keeps the memory
+    const size_t indexSize = sizeof(uint32_t) * m_indices.size();
+    const size_t allSize = sizeof(Vertex) * m_vertices.size() + indexSize;
+    const size_t positionsSize =
+        sizeof(glm::vec3) * m_vertices.size() + indexSize;
+    if (retention == MeshRetention::Positions) {
+        std::vector<glm::vec3> positions;
+        getPositions(positions);
+        m_positions.swap(positions);
+    }
+    if (retention != MeshRetention::All) {
+        std::vector<Vertex>().swap(m_vertices);
+    }
+    if (retention == MeshRetention::Discard) {
+        std::vector<uint32_t>().swap(m_indices);
+    }
+    LOG("%zu bytes in system memory, vertices & indices take %zu, positions "
+        "& indices %zu",
+        getMemorySize(), allSize, positionsSize);
+}
+
+size_t Mesh::getMemorySize() const {
+    return sizeof(Vertex) * m_vertices.capacity() +
+           sizeof(glm::vec3) * m_positions.capacity() +
+           sizeof(uint32_t) * m_indices.capacity() +
+           sizeof(Meshlet) * m_meshlets.capacity() +
+           sizeof(Lod) * m_lods.capacity();
 }
 
 Logger &Mesh::getLogger() { return m_renderer.getLogger(); }
+
+void Mesh::build(const char *filename, const MeshSettings &settings,
+                 std::vector<uint8_t> &vertexData,
+                 std::vector<uint32_t> &indices) {
+    ObjMesh obj;
+    loadObj(filename, settings.parseThreadCount, obj);
+    if (obj.concavePolygonCount > 0) {
+        LOG("Warning: %u concave polygons in %s are fanned into triangles "
+            "that cover the wrong area",
+            obj.concavePolygonCount, filename);
+    }
+
+    // One lookup per corner, corners with the same vertex share it
+    VertexTable uniqueVertices(obj.indices.size());
+    m_vertices.reserve(obj.positions.size());
+    m_indices.reserve(obj.indices.size());
+    for (const auto &index : obj.indices) {
+        Vertex vertex = {};
+        vertex.position = obj.positions[index.position];
+        if (index.texCoord >= 0) {
+            const glm::vec2 &texCoord = obj.texCoords[index.texCoord];
+            vertex.texCoord = {texCoord.x, 1.0f - texCoord.y};
+        }
+
+        m_indices.push_back(uniqueVertices.findOrInsert(vertex, m_vertices));
+    }
+
+    // Sphere around the bounding box, cheap and good enough for culling
+    glm::vec3 minimum(std::numeric_limits<float>::max());
+    glm::vec3 maximum(std::numeric_limits<float>::lowest());
+    for (const auto &vertex : m_vertices) {
+        minimum = glm::min(minimum, vertex.position);
+        maximum = glm::max(maximum, vertex.position);
+    }
+    m_boundingBoxMin = minimum;
+    m_boundingBoxMax = maximum;
+
+    const glm::vec3 center = 0.5f * (minimum + maximum);
+    float radius = 0.0f;
+    for (const auto &vertex : m_vertices) {
+        radius = std::max(radius, glm::length(vertex.position - center));
+    }
+    m_boundingSphere = glm::vec4(center.x, center.y, center.z, radius);
+
+    std::vector<glm::vec3> positions(m_vertices.size());
+    for (size_t i = 0; i < positions.size(); i++) {
+        positions[i] = m_vertices[i].position;
+    }
+    const uint32_t vertexCount = static_cast<uint32_t>(m_vertices.size());
+    const VertexCacheStatistics fileOrder =
+        analyzeVertexCache(m_indices.data(), m_indices.size(), vertexCount);
+    buildMeshlets(positions, m_indices, m_meshlets);
+    LOG("%zu vertices, %zu triangles in %zu meshlets", m_vertices.size(),
+        m_indices.size() / 3, m_meshlets.size());
+    const OverdrawStatistics cacheOverdraw =
+        estimateOverdraw(m_indices.data(), m_indices.size(), positions);
+    optimizeMeshletOverdraw(positions, m_indices, m_meshlets,
+                            settings.overdrawThreshold);
+    const VertexCacheStatistics meshletOrder =
+        analyzeVertexCache(m_indices.data(), m_indices.size(), vertexCount);
+    const OverdrawStatistics meshletOverdraw =
+        estimateOverdraw(m_indices.data(), m_indices.size(), positions);
+    LOG("Vertex cache of %u entries, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f",
+        s_vertexCacheSize, fileOrder.acmr, meshletOrder.acmr, fileOrder.atvr,
+        meshletOrder.atvr);
+    LOG("Overdraw %.3f -> %.3f", cacheOverdraw.overdraw,
+        meshletOverdraw.overdraw);
+
+    // Every level is simplified from the full mesh, so its error is
+    // measured against it. The levels follow the full mesh in the index
+    // list of the pool.
+    indices = m_indices;
+    std::vector<uint32_t> lodIndices;
+    m_lods.assign(1, Lod());
+    m_lods[0].m_indexCount = static_cast<uint32_t>(m_indices.size());
+    const uint32_t lodCount = std::min(settings.lodCount, s_maxLodCount);
+    while (m_lods.size() < lodCount) {
+        const Lod &previous = m_lods.back();
+        const float error = simplifyMesh(
+            positions, m_indices, previous.m_indexCount / 6 * 3, lodIndices);
+        // Locked borders & seams can keep the mesh from getting smaller
+        if (lodIndices.empty() ||
+            lodIndices.size() > previous.m_indexCount / 4 * 3) {
+            break;
+        }
+        // Levels are not split into meshlets, so they are ordered as a whole
+        optimizeVertexCache(lodIndices.data(), lodIndices.size(), vertexCount);
+        optimizeOverdraw(lodIndices.data(), lodIndices.size(),
+                         positions.data(), vertexCount,
+                         settings.overdrawThreshold);
+
+        Lod lod;
+        lod.m_firstIndex = static_cast<uint32_t>(indices.size());
+        lod.m_indexCount = static_cast<uint32_t>(lodIndices.size());
+        lod.m_error = std::max(error, previous.m_error);
+        m_lods.push_back(lod);
+        indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+    }
+    LOG("%zu levels of detail, the coarsest has %u triangles and an error of "
+        "%g",
+        m_lods.size(), m_lods.back().m_indexCount / 3, m_lods.back().m_error);
+
+    // The vertices are renumbered in the order the full mesh and then the
+    // levels first fetch them. The positions are stale from here on.
+    const uint32_t stride = getVertexStride(settings.vertexFormat);
+    const VertexFetchStatistics fileFetch = analyzeVertexFetch(
+        m_indices.data(), m_indices.size(), vertexCount, stride);
+    std::vector<uint32_t> remap;
+    optimizeVertexFetch(indices.data(), indices.size(), vertexCount, remap);
+    std::vector<Vertex> vertices(m_vertices.size());
+    for (size_t i = 0; i < m_vertices.size(); i++) {
+        vertices[remap[i]] = m_vertices[i];
+    }
+    m_vertices.swap(vertices);
+    std::copy(indices.begin(), indices.begin() + m_indices.size(),
+              m_indices.begin());
+    const VertexFetchStatistics useFetch = analyzeVertexFetch(
+        m_indices.data(), m_indices.size(), vertexCount, stride);
+    LOG("Vertex fetch of %llu -> %llu bytes, overfetch %.3f -> %.3f",
+        static_cast<unsigned long long>(fileFetch.bytesFetched),
+        static_cast<unsigned long long>(useFetch.bytesFetched),
+        fileFetch.overfetch, useFetch.overfetch);
+
+    // Only the position and texture coordinates are stored
+    m_quantization = getVertexQuantization(
+        settings.vertexFormat, m_boundingBoxMin, m_boundingBoxMax);
+    vertexData.resize(m_vertices.size() * stride);
+    for (size_t i = 0; i < m_vertices.size(); i++) {
+        encodeVertex(settings.vertexFormat, m_quantization,
+                     m_vertices[i].position, m_vertices[i].texCoord,
+                     &vertexData[i * stride]);
+    }
+    LOG("%zu bytes of vertices, %zu unpacked", vertexData.size(),
+        m_vertices.size() * sizeof(Vertex));
+}
 } // namespace vulkan_proto
@@ -1,38 +1,117 @@
 #pragma once
 
+#include "geometry_pool.h"
 #include "headers.h"
+#include "meshlet.h"
+#include "overdraw.h"
+#include "vertex_format.h"
 
 namespace vulkan_proto {
 
 struct Renderer;
 struct Logger;
 
+// What a mesh keeps in system memory once uploaded, the geometry pool has
+// the copy that is drawn
+enum class MeshRetention {
+    // Only the bounds, meshlets & levels
+    Discard,
+    // Positions & indices of the full mesh, for CPU culling or picking
+    Positions,
+    // Vertices & indices of the full mesh
+    All,
+};
+
+// How every mesh is built, from the settings of the renderer
+struct MeshSettings {
+    // Levels of detail, counting the full mesh
+    uint32_t lodCount = 1;
+    // See optimizeOverdraw
+    float overdrawThreshold = s_overdrawThreshold;
+    // Of the vertices in the geometry pool
+    VertexFormat vertexFormat = VertexFormat::Compact;
+    // Read & write the processed mesh in a cache file, see mesh_cache.h
+    bool cache = true;
+    // Meshes that are software occluders keep at least their positions
+    MeshRetention retention = MeshRetention::Discard;
+    // Threads that parse the OBJ file, one per core when zero
+    uint32_t parseThreadCount = 0;
+};
+
 struct Mesh {
     struct Vertex {
         glm::vec3 position;
-        glm::vec3 color;
         glm::vec2 texCoord;
 
         bool operator==(const Vertex &o) const {
-            return position == o.position && color == o.color &&
-                   texCoord == o.texCoord;
+            return position == o.position && texCoord == o.texCoord;
         }
     };
 
+    // A simplified version of the mesh, indexing the same vertices
+    struct Lod {
+        // Range in the index buffer of the geometry pool
+        uint32_t m_firstIndex = 0;
+        uint32_t m_indexCount = 0;
+        // Object space distance from the full mesh, see simplifyMesh
+        float m_error = 0.0f;
+    };
+
+    static constexpr uint32_t s_maxLodCount = 8;
+
     const Renderer &m_renderer;
 
-    VkBuffer m_vertexBuffer = VK_NULL_HANDLE;
-    VkBuffer m_indexBuffer = VK_NULL_HANDLE;
-    VkDeviceMemory m_vertexMemory = VK_NULL_HANDLE;
-    VkDeviceMemory m_indexMemory = VK_NULL_HANDLE;
+    // Location of the mesh in the shared vertex and index buffers
+    GeometryPool::Allocation m_geometry;
+    // Object space center in xyz, radius in w
+    glm::vec4 m_boundingSphere = glm::vec4(0.0f);
+    glm::vec3 m_boundingBoxMin = glm::vec3(0.0f);
+    glm::vec3 m_boundingBoxMax = glm::vec3(0.0f);
+    // Of the positions in the geometry pool
+    VertexQuantization m_quantization;
 
+    // Full precision, the geometry pool has them in the vertex format. What
+    // is kept after the load depends on the MeshRetention: the vertices,
+    // only their positions or neither, and the indices with either.
     std::vector<Vertex> m_vertices;
+    std::vector<glm::vec3> m_positions;
+    // Ordered by meshlet
     std::vector<uint32_t> m_indices;
+    std::vector<Meshlet> m_meshlets;
+    // From the full mesh to the coarsest, every level has about half the
+    // triangles of the previous one and a larger error
+    std::vector<Lod> m_lods;
 
     Mesh(Renderer &renderer);
     ~Mesh();
-    void create(const char *filename);
-    void destroy();
+    // Loads & uploads the mesh
+    void create(const char *filename, GeometryPool &geometryPool,
+                const MeshSettings &settings);
+    // Reads the cache or processes the source file into staging memory of
+    // the pool, without the queue, so several meshes can load at once.
+    // Upload follows, on one thread.
+    void load(const char *filename, GeometryPool &geometryPool,
+              const MeshSettings &settings);
+    void upload(GeometryPool &geometryPool);
+    void destroy(GeometryPool &geometryPool);
+    // Empty when the mesh kept neither vertices nor positions
+    void getPositions(std::vector<glm::vec3> &positions) const;
+    // Bytes of system memory held by the mesh
+    size_t getMemorySize() const;
     Logger &getLogger();
+
+  private:
+    // From load until upload. The vertices are in the vertex format, the
+    // indices hold every level.
+    GeometryPool::Staging m_staging;
+
+    // Loads & processes the source file. The vertex data is in the vertex
+    // format, the indices hold every level & the levels are relative to
+    // them.
+    void build(const char *filename, const MeshSettings &settings,
+               std::vector<uint8_t> &vertexData,
+               std::vector<uint32_t> &indices);
+    // Drops the copies the retention does not keep
+    void retain(MeshRetention retention);
 };
 } // namespace vulkan_proto
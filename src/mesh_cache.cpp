@@ -0,0 +1,363 @@
+#include "mesh_cache.h"
+#include "mapped_file.h"
+#include "mesh_codec.h"
+
+namespace {
+using vulkan_proto::Mesh;
+using vulkan_proto::MeshCacheKey;
+using vulkan_proto::MeshRetention;
+using vulkan_proto::Meshlet;
+using vulkan_proto::VertexQuantization;
+
+constexpr char s_magic[8] = {'V', 'P', 'M', 'E', 'S', 'H', 0, 0};
+constexpr size_t s_sectionAlignment = 16;
+
+struct Header {
+    char magic[8] = {};
+    uint32_t version = 0;
+    uint32_t pathLength = 0;
+    MeshCacheKey key;
+    glm::vec4 boundingSphere = glm::vec4(0.0f);
+    glm::vec3 boundingBoxMin = glm::vec3(0.0f);
+    glm::vec3 boundingBoxMax = glm::vec3(0.0f);
+    VertexQuantization quantization;
+    uint32_t vertexCount = 0;
+    uint32_t vertexStride = 0;
+    uint32_t indexCount = 0;
+    uint32_t meshletCount = 0;
+    uint32_t lodCount = 0;
+    // What the retained part holds, see getRetainedStride
+    uint32_t retention = 0;
+    // Encoded sizes
+    uint32_t vertexDataSize = 0;
+    uint32_t indicesSize = 0;
+    uint32_t retainedSize = 0;
+};
+
+// Where each part of the file starts, see s_meshCacheVersion
+struct Layout {
+    size_t path = 0;
+    size_t vertexData = 0;
+    size_t indices = 0;
+    size_t retained = 0;
+    size_t meshlets = 0;
+    size_t lods = 0;
+    size_t size = 0;
+};
+
+size_t align(size_t offset) {
+    return (offset + s_sectionAlignment - 1) & ~(s_sectionAlignment - 1);
+}
+
+Layout getLayout(const Header &header) {
+    Layout layout;
+    layout.path = sizeof(Header);
+    layout.vertexData = align(layout.path + header.pathLength);
+    layout.indices = align(layout.vertexData + header.vertexDataSize);
+    layout.retained = align(layout.indices + header.indicesSize);
+    layout.meshlets = align(layout.retained + header.retainedSize);
+    layout.lods =
+        align(layout.meshlets + sizeof(Meshlet) * header.meshletCount);
+    layout.size = layout.lods + sizeof(Mesh::Lod) * header.lodCount;
+    return layout;
+}
+
+// Positions for MeshRetention::Positions, whole vertices for All
+size_t getRetainedStride(MeshRetention retention) {
+    switch (retention) {
+    case MeshRetention::Positions:
+        return sizeof(glm::vec3);
+    case MeshRetention::All:
+        return sizeof(Mesh::Vertex);
+    default:
+        return 0;
+    }
+}
+
+uint64_t rotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// The round & avalanche of xxHash64 over four lanes of 8 byte words. Not
+// xxHash64 itself, the tail & merge are simpler.
+constexpr uint64_t s_prime1 = 0x9e3779b185ebca87ull;
+constexpr uint64_t s_prime2 = 0xc2b2ae3d27d4eb4full;
+
+uint64_t hashRound(uint64_t lane, uint64_t word) {
+    return rotateLeft(lane + word * s_prime2, 31) * s_prime1;
+}
+
+uint64_t hashBytes(const char *data, size_t size) {
+    uint64_t lanes[4] = {s_prime1 + s_prime2, s_prime2, 0, 0 - s_prime1};
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (size_t lane = 0; lane < 4; lane++) {
+            uint64_t word = 0;
+            memcpy(&word, data + i + 8 * lane, sizeof(word));
+            lanes[lane] = hashRound(lanes[lane], word);
+        }
+    }
+
+    uint64_t hash = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7) +
+                    rotateLeft(lanes[2], 12) + rotateLeft(lanes[3], 18);
+    hash = hashRound(hash, size);
+    for (; i < size; i += 8) {
+        uint64_t word = 0;
+        memcpy(&word, data + i, std::min<size_t>(8, size - i));
+        hash = hashRound(hash, word);
+    }
+
+    hash ^= hash >> 33;
+    hash *= s_prime2;
+    hash ^= hash >> 29;
+    hash *= s_prime1;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+std::string getCachePath(const char *filename) {
+    return std::string(filename) + ".cache";
+}
+
+// Patches the modification time in the header of an existing cache, so a
+// touched source is hashed once rather than on every load. A failure only
+// costs that hash again.
+void writeModifiedTime(const std::string &cachePath, int64_t modifiedTime) {
+    std::fstream file(cachePath,
+                      std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(offsetof(Header, key) + offsetof(MeshCacheKey, modifiedTime));
+    file.write(reinterpret_cast<const char *>(&modifiedTime),
+               sizeof(modifiedTime));
+}
+} // namespace
+
+namespace vulkan_proto {
+MeshCacheKey getMeshCacheKey(const char *filename,
+                             const MeshSettings &settings) {
+    MeshCacheKey key;
+    std::error_code error;
+    key.modifiedTime = std::filesystem::last_write_time(filename, error)
+                           .time_since_epoch()
+                           .count();
+    key.sourceSize = std::filesystem::file_size(filename, error);
+    key.lodCount = settings.lodCount;
+    key.overdrawThreshold = settings.overdrawThreshold;
+    key.vertexFormat = static_cast<uint32_t>(settings.vertexFormat);
+    return key;
+}
+
+uint64_t hashFile(const char *filename) {
+    MappedFile file;
+    if (file.open(filename) == false) {
+        return 0;
+    }
+    return hashBytes(file.m_data, file.m_size);
+}
+
+bool readMeshCache(const char *filename, const MeshCacheKey &key,
+                   MeshRetention retention, GeometryPool &geometryPool,
+                   Mesh &mesh, GeometryPool::Staging &staging) {
+    const std::string cachePath = getCachePath(filename);
+    MappedFile file;
+    if (file.open(cachePath.c_str()) == false ||
+        file.m_size < sizeof(Header)) {
+        return false;
+    }
+
+    Header header;
+    memcpy(&header, file.m_data, sizeof(header));
+    const Layout layout = getLayout(header);
+    const size_t pathLength = strlen(filename);
+    // A cache keeps as much as the retention it was written for, or more
+    const bool valid =
+        memcmp(header.magic, s_magic, sizeof(s_magic)) == 0 &&
+        header.version == s_meshCacheVersion && layout.size == file.m_size &&
+        header.pathLength == pathLength &&
+        memcmp(file.m_data + layout.path, filename, pathLength) == 0 &&
+        header.vertexStride ==
+            getVertexStride(static_cast<VertexFormat>(key.vertexFormat)) &&
+        header.lodCount > 0 &&
+        header.retention <= static_cast<uint32_t>(MeshRetention::All) &&
+        header.retention >= static_cast<uint32_t>(retention);
+    if (valid == false) {
+        return false;
+    }
+
+    // A touched but unchanged source keeps its cache, with the new time
+    MeshCacheKey cachedKey = header.key;
+    const bool touched = cachedKey.modifiedTime != key.modifiedTime;
+    if (touched) {
+        cachedKey.modifiedTime = key.modifiedTime;
+        if (cachedKey.contentHash != hashFile(filename)) {
+            return false;
+        }
+    }
+    cachedKey.contentHash = key.contentHash;
+    if (memcmp(&cachedKey, &key, sizeof(key)) != 0) {
+        return false;
+    }
+
+    // Ranges are checked, so a corrupt cache cannot make the GPU read out
+    // of bounds. Decoding checks the indices.
+    std::vector<Mesh::Lod> lods(header.lodCount);
+    memcpy(lods.data(), file.m_data + layout.lods,
+           sizeof(Mesh::Lod) * lods.size());
+    std::vector<Meshlet> meshlets(header.meshletCount);
+    memcpy(meshlets.data(), file.m_data + layout.meshlets,
+           sizeof(Meshlet) * meshlets.size());
+    bool inRange = true;
+    for (const auto &lod : lods) {
+        inRange &= static_cast<uint64_t>(lod.m_firstIndex) + lod.m_indexCount <=
+                   header.indexCount;
+    }
+    for (const auto &meshlet : meshlets) {
+        inRange &= static_cast<uint64_t>(meshlet.m_firstIndex) +
+                       meshlet.m_indexCount <=
+                   lods[0].m_indexCount;
+    }
+    if (inRange == false) {
+        return false;
+    }
+
+    // Only what the retention keeps is decoded to system memory
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(file.m_data);
+    const MeshRetention cachedRetention =
+        static_cast<MeshRetention>(header.retention);
+    std::vector<Mesh::Vertex> vertices;
+    std::vector<glm::vec3> positions;
+    if (retention == MeshRetention::All ||
+        (retention == MeshRetention::Positions &&
+         cachedRetention == MeshRetention::All)) {
+        vertices.resize(header.vertexCount);
+        if (!decodeVertexBuffer(data + layout.retained, header.retainedSize,
+                                vertices.size(), sizeof(Mesh::Vertex),
+                                reinterpret_cast<uint8_t *>(vertices.data()))) {
+            return false;
+        }
+    } else if (retention == MeshRetention::Positions) {
+        positions.resize(header.vertexCount);
+        if (!decodeVertexBuffer(
+                data + layout.retained, header.retainedSize, positions.size(),
+                sizeof(glm::vec3),
+                reinterpret_cast<uint8_t *>(positions.data()))) {
+            return false;
+        }
+    }
+    if (retention == MeshRetention::Positions && !vertices.empty()) {
+        positions.resize(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++) {
+            positions[i] = vertices[i].position;
+        }
+        std::vector<Mesh::Vertex>().swap(vertices);
+    }
+
+    // The geometry goes straight to the staging memory
+    GeometryPool::Staging meshStaging =
+        geometryPool.createStaging(header.vertexCount, header.indexCount);
+    if (!decodeVertexBuffer(data + layout.vertexData, header.vertexDataSize,
+                            header.vertexCount, header.vertexStride,
+                            meshStaging.vertices) ||
+        !decodeIndexBuffer(data + layout.indices, header.indicesSize,
+                           header.indexCount, header.vertexCount,
+                           meshStaging.indices)) {
+        geometryPool.destroyStaging(meshStaging);
+        return false;
+    }
+
+    mesh.m_boundingSphere = header.boundingSphere;
+    mesh.m_boundingBoxMin = header.boundingBoxMin;
+    mesh.m_boundingBoxMax = header.boundingBoxMax;
+    mesh.m_quantization = header.quantization;
+    mesh.m_vertices.swap(vertices);
+    mesh.m_positions.swap(positions);
+    if (retention != MeshRetention::Discard) {
+        mesh.m_indices.assign(meshStaging.indices,
+                              meshStaging.indices + lods[0].m_indexCount);
+    }
+    mesh.m_meshlets.swap(meshlets);
+    mesh.m_lods.swap(lods);
+    staging = meshStaging;
+    if (touched) {
+        file.close();
+        writeModifiedTime(cachePath, key.modifiedTime);
+    }
+    return true;
+}
+
+bool writeMeshCache(const char *filename, const MeshCacheKey &key,
+                    MeshRetention retention, const Mesh &mesh,
+                    const std::vector<uint8_t> &vertexData,
+                    const std::vector<uint32_t> &indices) {
+    Header header;
+    memcpy(header.magic, s_magic, sizeof(s_magic));
+    header.version = s_meshCacheVersion;
+    header.pathLength = static_cast<uint32_t>(strlen(filename));
+    header.key = key;
+    header.boundingSphere = mesh.m_boundingSphere;
+    header.boundingBoxMin = mesh.m_boundingBoxMin;
+    header.boundingBoxMax = mesh.m_boundingBoxMax;
+    header.quantization = mesh.m_quantization;
+    header.vertexCount = static_cast<uint32_t>(mesh.m_vertices.size());
+    header.vertexStride = static_cast<uint32_t>(
+        vertexData.size() / std::max<size_t>(mesh.m_vertices.size(), 1));
+    header.indexCount = static_cast<uint32_t>(indices.size());
+    header.meshletCount = static_cast<uint32_t>(mesh.m_meshlets.size());
+    header.lodCount = static_cast<uint32_t>(mesh.m_lods.size());
+    header.retention = static_cast<uint32_t>(retention);
+
+    std::vector<uint8_t> encodedVertices;
+    encodeVertexBuffer(vertexData.data(), mesh.m_vertices.size(),
+                       header.vertexStride, encodedVertices);
+    std::vector<uint8_t> encodedIndices;
+    encodeIndexBuffer(indices.data(), indices.size(), encodedIndices);
+    std::vector<uint8_t> retained;
+    if (retention == MeshRetention::All) {
+        encodeVertexBuffer(
+            reinterpret_cast<const uint8_t *>(mesh.m_vertices.data()),
+            mesh.m_vertices.size(), sizeof(Mesh::Vertex), retained);
+    } else if (retention == MeshRetention::Positions) {
+        std::vector<glm::vec3> positions;
+        mesh.getPositions(positions);
+        encodeVertexBuffer(reinterpret_cast<const uint8_t *>(positions.data()),
+                           positions.size(), sizeof(glm::vec3), retained);
+    }
+    header.vertexDataSize = static_cast<uint32_t>(encodedVertices.size());
+    header.indicesSize = static_cast<uint32_t>(encodedIndices.size());
+    header.retainedSize = static_cast<uint32_t>(retained.size());
+    const Layout layout = getLayout(header);
+
+    std::vector<char> data(layout.size, 0);
+    memcpy(data.data(), &header, sizeof(header));
+    memcpy(&data[layout.path], filename, header.pathLength);
+    memcpy(&data[layout.vertexData], encodedVertices.data(),
+           encodedVertices.size());
+    memcpy(&data[layout.indices], encodedIndices.data(),
+           encodedIndices.size());
+    if (!retained.empty()) {
+        memcpy(&data[layout.retained], retained.data(), retained.size());
+    }
+    memcpy(&data[layout.meshlets], mesh.m_meshlets.data(),
+           sizeof(Meshlet) * mesh.m_meshlets.size());
+    memcpy(&data[layout.lods], mesh.m_lods.data(),
+           sizeof(Mesh::Lod) * mesh.m_lods.size());
+
+    const std::string cachePath = getCachePath(filename);
+    const std::string temporaryPath = cachePath + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!file) {
+            file.close();
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, cachePath, error);
+    if (error) {
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
+} // namespace vulkan_proto
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "headers.h"
+#include "mesh.h"
+
+namespace vulkan_proto {
+// Processed meshes are cached next to their source file, in <source>.cache,
+// so later loads skip parsing, deduplication and every optimization pass.
+// The file is a header followed by the vertices in the vertex format, the
+// indices of every level, what the MeshRetention keeps in system memory,
+// the meshlets and the levels, each aligned to 16 bytes. The first three
+// are compressed, see mesh_codec.h. Bump the version whenever the layout or
+// the processing changes.
+constexpr uint32_t s_meshCacheVersion = 5;
+
+// What a cache was built from. A cache is used when everything matches, or
+// everything but the modification time when the content hash still does.
+struct MeshCacheKey {
+    int64_t modifiedTime = 0;
+    uint64_t sourceSize = 0;
+    uint64_t contentHash = 0;
+    // Of the MeshSettings
+    uint32_t lodCount = 0;
+    float overdrawThreshold = 0.0f;
+    uint32_t vertexFormat = 0;
+    uint32_t padding = 0;
+};
+
+// Everything but the content hash, which needs the whole source read
+MeshCacheKey getMeshCacheKey(const char *filename,
+                             const MeshSettings &settings);
+// 64 bit hash of the contents of a file, several GB/s
+uint64_t hashFile(const char *filename);
+
+// Maps & decodes the cache of the source file, filling in the mesh except
+// its geometry pool allocation. The vertices & the indices of every level
+// are decoded into new staging memory of the pool, the levels are relative
+// to them. The mesh keeps what the retention asks for, a cache written for
+// less is rejected. False when the cache is missing, stale or corrupt, the
+// mesh is then untouched. A cache kept by the content hash gets the new
+// modification time written to it.
+bool readMeshCache(const char *filename, const MeshCacheKey &key,
+                   MeshRetention retention, GeometryPool &geometryPool,
+                   Mesh &mesh, GeometryPool::Staging &staging);
+
+// Writes the cache of the source file, from the mesh before the upload &
+// the retention. The levels of the mesh are relative to the indices, the
+// vertex data is in the vertex format. Written to a temporary file that
+// replaces the cache when complete, so readers never see half a cache.
+// False when the file cannot be written.
+bool writeMeshCache(const char *filename, const MeshCacheKey &key,
+                    MeshRetention retention, const Mesh &mesh,
+                    const std::vector<uint8_t> &vertexData,
+                    const std::vector<uint32_t> &indices);
+} // namespace vulkan_proto
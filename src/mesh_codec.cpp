@@ -0,0 +1,378 @@
+#include "mesh_codec.h"
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+// Sequences of the LZ77 stage are a token, the literals, a 16 bit offset
+// back into the output and the match length. The high half of the token is
+// the literal count, the low half the match length past the minimum, each
+// continued in 255 steps when 15. The last sequence has no match.
+constexpr size_t s_minMatch = 4;
+constexpr size_t s_maxOffset = 0xffff;
+constexpr uint32_t s_hashBits = 16;
+
+void appendLength(size_t length, std::vector<uint8_t> &output) {
+    for (; length >= 255; length -= 255) {
+        output.push_back(255);
+    }
+    output.push_back(static_cast<uint8_t>(length));
+}
+
+void appendSequence(const uint8_t *literals, size_t literalCount,
+                    size_t offset, size_t matchLength,
+                    std::vector<uint8_t> &output) {
+    const size_t extraLength =
+        matchLength > 0 ? matchLength - s_minMatch : 0;
+    output.push_back(
+        static_cast<uint8_t>(std::min<size_t>(literalCount, 15) << 4 |
+                             std::min<size_t>(extraLength, 15)));
+    if (literalCount >= 15) {
+        appendLength(literalCount - 15, output);
+    }
+    output.insert(output.end(), literals, literals + literalCount);
+    if (matchLength == 0) {
+        return;
+    }
+    output.push_back(static_cast<uint8_t>(offset));
+    output.push_back(static_cast<uint8_t>(offset >> 8));
+    if (extraLength >= 15) {
+        appendLength(extraLength - 15, output);
+    }
+}
+
+// Greedy, with the latest position of every hashed 4 bytes as the only
+// candidate. Runs of literals are skipped through faster the longer they
+// get, so data that does not compress costs little.
+void compressBlock(const uint8_t *input, size_t size,
+                   std::vector<uint8_t> &output) {
+    for (size_t i = 0; i < sizeof(uint32_t); i++) {
+        output.push_back(static_cast<uint8_t>(size >> (8 * i)));
+    }
+
+    // Position plus one, so zero is empty
+    std::vector<uint32_t> table(size_t(1) << s_hashBits, 0);
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + s_minMatch <= size) {
+        uint32_t sequence = 0;
+        memcpy(&sequence, input + i, sizeof(sequence));
+        const uint32_t hash = (sequence * 2654435761u) >> (32 - s_hashBits);
+        const size_t candidate = table[hash];
+        table[hash] = static_cast<uint32_t>(i + 1);
+        if (candidate == 0 || i - (candidate - 1) > s_maxOffset ||
+            memcmp(input + candidate - 1, input + i, s_minMatch) != 0) {
+            i += 1 + ((i - anchor) >> 6);
+            continue;
+        }
+
+        const size_t match = candidate - 1;
+        size_t length = s_minMatch;
+        while (i + length < size &&
+               input[match + length] == input[i + length]) {
+            length++;
+        }
+        appendSequence(input + anchor, i - anchor, i - match, length, output);
+        i += length;
+        anchor = i;
+    }
+    appendSequence(input + anchor, size - anchor, 0, 0, output);
+}
+
+// Copies in 16 byte steps, so up to 15 bytes past the end are read and
+// written. Both sides need room for that.
+constexpr size_t s_copyStep = 16;
+
+void wildCopy(uint8_t *out, const uint8_t *in, size_t length) {
+    const uint8_t *end = out + length;
+    do {
+        memcpy(out, in, s_copyStep);
+        out += s_copyStep;
+        in += s_copyStep;
+    } while (out < end);
+}
+
+bool readLength(const uint8_t *&data, const uint8_t *end, size_t limit,
+                size_t &length) {
+    for (;;) {
+        if (data == end || length > limit) {
+            return false;
+        }
+        const uint8_t byte = *data++;
+        length += byte;
+        if (byte != 255) {
+            return true;
+        }
+    }
+}
+
+bool decompressBlock(const uint8_t *data, size_t size, size_t maxSize,
+                     std::vector<uint8_t> &output) {
+    if (size < sizeof(uint32_t)) {
+        return false;
+    }
+    size_t outputSize = 0;
+    for (size_t i = 0; i < sizeof(uint32_t); i++) {
+        outputSize |= static_cast<size_t>(data[i]) << (8 * i);
+    }
+    if (outputSize > maxSize) {
+        return false;
+    }
+    // Room for the last wild copy, dropped at the end
+    output.resize(outputSize + s_copyStep);
+
+    const uint8_t *in = data + sizeof(uint32_t);
+    const uint8_t *end = data + size;
+    uint8_t *out = output.data();
+    uint8_t *outEnd = out + outputSize;
+    if (outputSize == 0) {
+        output.clear();
+        return end - in == 1 && *in == 0;
+    }
+    for (;;) {
+        if (in == end) {
+            return false;
+        }
+        const uint8_t token = *in++;
+        size_t literalCount = token >> 4;
+        if (literalCount == 15 &&
+            !readLength(in, end, outputSize, literalCount)) {
+            return false;
+        }
+        if (literalCount > static_cast<size_t>(end - in) ||
+            literalCount > static_cast<size_t>(outEnd - out)) {
+            return false;
+        }
+        if (static_cast<size_t>(end - in) >= literalCount + s_copyStep) {
+            wildCopy(out, in, literalCount);
+        } else {
+            memcpy(out, in, literalCount);
+        }
+        in += literalCount;
+        out += literalCount;
+        if (in == end) {
+            output.resize(outputSize);
+            return out == outEnd;
+        }
+
+        if (end - in < 2) {
+            return false;
+        }
+        const size_t offset = in[0] | static_cast<size_t>(in[1]) << 8;
+        in += 2;
+        size_t length = token & 15;
+        if (length == 15 && !readLength(in, end, outputSize, length)) {
+            return false;
+        }
+        length += s_minMatch;
+        if (offset == 0 || offset > static_cast<size_t>(out - output.data()) ||
+            length > static_cast<size_t>(outEnd - out)) {
+            return false;
+        }
+
+        // Overlapping matches repeat the last offset bytes. Once a step of
+        // them is written, the rest is copied from a whole number of
+        // repeats back, at least a step away.
+        const uint8_t *match = out - offset;
+        if (offset >= s_copyStep) {
+            wildCopy(out, match, length);
+        } else {
+            const size_t head = std::min(length, s_copyStep);
+            for (size_t i = 0; i < head; i++) {
+                out[i] = match[i];
+            }
+            if (length > head) {
+                const size_t distance =
+                    (s_copyStep + offset - 1) / offset * offset;
+                wildCopy(out + head, out + head - distance, length - head);
+            }
+        }
+        out += length;
+    }
+}
+
+// Vertices decoded at a time without SIMD
+constexpr size_t s_blockSize = 256;
+
+#if defined(__SSE2__)
+// Largest vertex decoded with SIMD
+constexpr size_t s_maxSimdVertexSize = 64;
+
+// Running sum of the 16 bytes, on top of the last sum of the previous ones
+// in every byte
+__m128i prefixSum(__m128i value, __m128i previous) {
+    value = _mm_add_epi8(value, _mm_slli_si128(value, 1));
+    value = _mm_add_epi8(value, _mm_slli_si128(value, 2));
+    value = _mm_add_epi8(value, _mm_slli_si128(value, 4));
+    value = _mm_add_epi8(value, _mm_slli_si128(value, 8));
+    return _mm_add_epi8(value, previous);
+}
+
+// The last byte in every byte
+__m128i broadcastLast(__m128i value) {
+    value = _mm_unpackhi_epi8(value, value);
+    value = _mm_unpackhi_epi16(value, value);
+    return _mm_shuffle_epi32(value, 0xff);
+}
+
+// The 4 words to the same bytes of 4 consecutive vertices
+void storeWords(__m128i words, size_t vertexSize, uint8_t *out) {
+    for (int i = 0; i < 4; i++) {
+        const int32_t word = _mm_cvtsi128_si32(words);
+        memcpy(out + i * vertexSize, &word, sizeof(word));
+        words = _mm_srli_si128(words, 4);
+    }
+}
+
+// Decodes 16 vertices at a time while at least 16 are left, returns how
+// many. Four streams are summed at once and transposed into 4 bytes of 16
+// vertices, so vertex sizes must be a multiple of 4.
+size_t decodeVertexBlocks(const uint8_t *streams, size_t vertexCount,
+                          size_t vertexSize, uint8_t *vertices) {
+    __m128i previous[s_maxSimdVertexSize];
+    for (size_t byte = 0; byte < vertexSize; byte++) {
+        previous[byte] = _mm_setzero_si128();
+    }
+
+    size_t first = 0;
+    for (; first + 16 <= vertexCount; first += 16) {
+        uint8_t *out = vertices + first * vertexSize;
+        for (size_t byte = 0; byte < vertexSize; byte += 4) {
+            __m128i sums[4];
+            for (size_t i = 0; i < 4; i++) {
+                const uint8_t *stream =
+                    streams + (byte + i) * vertexCount + first;
+                sums[i] = prefixSum(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(stream)),
+                    previous[byte + i]);
+                previous[byte + i] = broadcastLast(sums[i]);
+            }
+
+            const __m128i low01 = _mm_unpacklo_epi8(sums[0], sums[1]);
+            const __m128i high01 = _mm_unpackhi_epi8(sums[0], sums[1]);
+            const __m128i low23 = _mm_unpacklo_epi8(sums[2], sums[3]);
+            const __m128i high23 = _mm_unpackhi_epi8(sums[2], sums[3]);
+            storeWords(_mm_unpacklo_epi16(low01, low23), vertexSize,
+                       out + byte);
+            storeWords(_mm_unpackhi_epi16(low01, low23), vertexSize,
+                       out + 4 * vertexSize + byte);
+            storeWords(_mm_unpacklo_epi16(high01, high23), vertexSize,
+                       out + 8 * vertexSize + byte);
+            storeWords(_mm_unpackhi_epi16(high01, high23), vertexSize,
+                       out + 12 * vertexSize + byte);
+        }
+    }
+    return first;
+}
+#endif
+// Longest index in 7 bit groups
+constexpr size_t s_maxIndexBytes = 5;
+} // namespace
+
+namespace vulkan_proto {
+void encodeVertexBuffer(const uint8_t *vertices, size_t vertexCount,
+                        size_t vertexSize, std::vector<uint8_t> &output) {
+    std::vector<uint8_t> streams(vertexCount * vertexSize);
+    for (size_t byte = 0; byte < vertexSize; byte++) {
+        uint8_t *stream = streams.data() + byte * vertexCount;
+        uint8_t previous = 0;
+        for (size_t i = 0; i < vertexCount; i++) {
+            const uint8_t value = vertices[i * vertexSize + byte];
+            stream[i] = static_cast<uint8_t>(value - previous);
+            previous = value;
+        }
+    }
+    compressBlock(streams.data(), streams.size(), output);
+}
+
+bool decodeVertexBuffer(const uint8_t *data, size_t size, size_t vertexCount,
+                        size_t vertexSize, uint8_t *vertices) {
+    std::vector<uint8_t> streams;
+    if (!decompressBlock(data, size, vertexCount * vertexSize, streams) ||
+        streams.size() != vertexCount * vertexSize) {
+        return false;
+    }
+
+    size_t decoded = 0;
+#if defined(__SSE2__)
+    if (vertexSize % 4 == 0 && vertexSize <= s_maxSimdVertexSize) {
+        decoded = decodeVertexBlocks(streams.data(), vertexCount, vertexSize,
+                                     vertices);
+    }
+#endif
+
+    // A block of vertices at a time, small enough for the first level
+    // cache, so every stream is read in order and the running value of a
+    // byte stays in a register
+    std::vector<uint8_t> previous(vertexSize, 0);
+    if (decoded > 0) {
+        for (size_t byte = 0; byte < vertexSize; byte++) {
+            previous[byte] = vertices[(decoded - 1) * vertexSize + byte];
+        }
+    }
+    for (size_t first = decoded; first < vertexCount; first += s_blockSize) {
+        const size_t count = std::min(s_blockSize, vertexCount - first);
+        for (size_t byte = 0; byte < vertexSize; byte++) {
+            const uint8_t *stream =
+                streams.data() + byte * vertexCount + first;
+            uint8_t *out = vertices + first * vertexSize + byte;
+            uint8_t value = previous[byte];
+            for (size_t i = 0; i < count; i++) {
+                value = static_cast<uint8_t>(value + stream[i]);
+                out[i * vertexSize] = value;
+            }
+            previous[byte] = value;
+        }
+    }
+    return true;
+}
+
+void encodeIndexBuffer(const uint32_t *indices, size_t indexCount,
+                       std::vector<uint8_t> &output) {
+    std::vector<uint8_t> bytes;
+    bytes.reserve(indexCount * 2);
+    uint32_t previous = 0;
+    for (size_t i = 0; i < indexCount; i++) {
+        const int32_t delta = static_cast<int32_t>(indices[i] - previous);
+        uint32_t value = static_cast<uint32_t>(delta) << 1 ^
+                         static_cast<uint32_t>(delta >> 31);
+        for (; value >= 0x80; value >>= 7) {
+            bytes.push_back(static_cast<uint8_t>(value | 0x80));
+        }
+        bytes.push_back(static_cast<uint8_t>(value));
+        previous = indices[i];
+    }
+    compressBlock(bytes.data(), bytes.size(), output);
+}
+
+bool decodeIndexBuffer(const uint8_t *data, size_t size, size_t indexCount,
+                       uint32_t vertexCount, uint32_t *indices) {
+    std::vector<uint8_t> bytes;
+    if (!decompressBlock(data, size, indexCount * s_maxIndexBytes, bytes)) {
+        return false;
+    }
+
+    const uint8_t *in = bytes.data();
+    const uint8_t *end = in + bytes.size();
+    uint32_t previous = 0;
+    for (size_t i = 0; i < indexCount; i++) {
+        uint32_t value = 0;
+        for (uint32_t shift = 0;; shift += 7) {
+            if (in == end || shift >= 32) {
+                return false;
+            }
+            const uint8_t byte = *in++;
+            value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if (byte < 0x80) {
+                break;
+            }
+        }
+        previous += (value >> 1) ^ (0 - (value & 1));
+        if (previous >= vertexCount) {
+            return false;
+        }
+        indices[i] = previous;
+    }
+    return in == end;
+}
+} // namespace vulkan_proto
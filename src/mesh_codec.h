@@ -0,0 +1,29 @@
+#pragma once
+
+#include "headers.h"
+
+namespace vulkan_proto {
+// Compression of mesh data for storage, see mesh_cache.h. Both encodings
+// first turn the data into runs of small, repeating bytes and then
+// compress them with a byte oriented LZ77, whose decoder only copies bytes.
+//
+// Every block starts with its decoded size, decoding checks every read and
+// write against it, so corrupt data fails instead of overrunning.
+
+// Vertices are split into one stream per byte of the vertex, each holding
+// the difference to the same byte of the previous vertex. Neighbouring
+// vertices are close after optimizeVertexFetch, so the high bytes are
+// mostly zero. The encoding is appended to the output.
+void encodeVertexBuffer(const uint8_t *vertices, size_t vertexCount,
+                        size_t vertexSize, std::vector<uint8_t> &output);
+bool decodeVertexBuffer(const uint8_t *data, size_t size, size_t vertexCount,
+                        size_t vertexSize, uint8_t *vertices);
+
+// Indices are stored as the zigzag coded difference to the previous index,
+// in 7 bit groups. Triangles reuse recent vertices, so most take one byte.
+void encodeIndexBuffer(const uint32_t *indices, size_t indexCount,
+                       std::vector<uint8_t> &output);
+// Also fails when an index is not below the vertex count
+bool decodeIndexBuffer(const uint8_t *data, size_t size, size_t indexCount,
+                       uint32_t vertexCount, uint32_t *indices);
+} // namespace vulkan_proto
@@ -0,0 +1,212 @@
+#include "meshlet.h"
+#include "vertex_cache.h"
+#include <algorithm>
+#include <numeric>
+
+namespace {
+using vulkan_proto::Meshlet;
+
+void computeBounds(const std::vector<glm::vec3> &positions,
+                   const uint32_t *indices, Meshlet &meshlet) {
+    // Sphere around the bounding box, like the bounds of the whole mesh
+    glm::vec3 minimum(std::numeric_limits<float>::max());
+    glm::vec3 maximum(std::numeric_limits<float>::lowest());
+    for (uint32_t i = 0; i < meshlet.m_indexCount; i++) {
+        minimum = glm::min(minimum, positions[indices[i]]);
+        maximum = glm::max(maximum, positions[indices[i]]);
+    }
+    const glm::vec3 center = 0.5f * (minimum + maximum);
+    float radius = 0.0f;
+    for (uint32_t i = 0; i < meshlet.m_indexCount; i++) {
+        radius = std::max(radius, glm::length(positions[indices[i]] - center));
+    }
+    meshlet.m_boundingSphere = glm::vec4(center.x, center.y, center.z, radius);
+
+    // The cone axis is the average of the triangle normals, the cone angle
+    // the largest angle between the axis and a normal
+    std::vector<glm::vec3> normals;
+    glm::vec3 axis(0.0f);
+    for (uint32_t i = 0; i < meshlet.m_indexCount; i += 3) {
+        const glm::vec3 &p0 = positions[indices[i + 0]];
+        const glm::vec3 &p1 = positions[indices[i + 1]];
+        const glm::vec3 &p2 = positions[indices[i + 2]];
+        const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        const float length = glm::length(normal);
+        // Degenerate triangles are never drawn
+        if (length > 0.0f) {
+            normals.push_back(normal / length);
+            axis += normals.back();
+        }
+    }
+
+    const float axisLength = glm::length(axis);
+    if (axisLength <= 0.0f) {
+        return;
+    }
+    axis /= axisLength;
+
+    float minimumDot = 1.0f;
+    for (const auto &normal : normals) {
+        minimumDot = std::min(minimumDot, glm::dot(axis, normal));
+    }
+    // Normals more than 90 degrees apart face every direction between them
+    if (minimumDot <= 0.0f) {
+        return;
+    }
+    meshlet.m_cone = glm::vec4(axis.x, axis.y, axis.z,
+                               std::sqrt(1.0f - minimumDot * minimumDot));
+}
+} // namespace
+
+namespace vulkan_proto {
+void buildMeshlets(const std::vector<glm::vec3> &positions,
+                   std::vector<uint32_t> &indices,
+                   std::vector<Meshlet> &meshlets) {
+    meshlets.clear();
+    const uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+    const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+
+    // Vertices that only differ by texture coordinates are split at the
+    // seams. Triangles sharing a position are neighbours anyway, so the
+    // neighbours are found through the first vertex at each position.
+    std::vector<uint32_t> order(vertexCount);
+    std::iota(order.begin(), order.end(), 0);
+    auto lessPosition = [&positions](uint32_t a, uint32_t b) {
+        const glm::vec3 &pa = positions[a];
+        const glm::vec3 &pb = positions[b];
+        return pa.x != pb.x ? pa.x < pb.x
+                            : (pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z);
+    };
+    std::sort(order.begin(), order.end(), lessPosition);
+    std::vector<uint32_t> weldedVertices(vertexCount);
+    for (uint32_t i = 0; i < vertexCount; i++) {
+        const bool samePosition =
+            i > 0 && positions[order[i]] == positions[order[i - 1]];
+        weldedVertices[order[i]] =
+            samePosition ? weldedVertices[order[i - 1]] : order[i];
+    }
+
+    // Triangles of each welded vertex
+    std::vector<uint32_t> triangleOffsets(vertexCount + 1, 0);
+    for (uint32_t index : indices) {
+        triangleOffsets[weldedVertices[index] + 1]++;
+    }
+    std::partial_sum(triangleOffsets.begin(), triangleOffsets.end(),
+                     triangleOffsets.begin());
+    std::vector<uint32_t> vertexTriangles(indices.size());
+    std::vector<uint32_t> cursors(triangleOffsets.begin(),
+                                  triangleOffsets.end() - 1);
+    for (uint32_t i = 0; i < static_cast<uint32_t>(indices.size()); i++) {
+        vertexTriangles[cursors[weldedVertices[indices[i]]]++] = i / 3;
+    }
+
+    std::vector<bool> emitted(triangleCount, false);
+    // Whether each vertex is used by the current meshlet, and the welded
+    // vertices of the meshlet for finding the neighbours
+    std::vector<bool> inMeshlet(vertexCount, false);
+    std::vector<uint32_t> meshletVertices;
+    // Index of each vertex in meshletVertices, valid while in the meshlet
+    std::vector<uint32_t> localVertices(vertexCount);
+    std::vector<uint32_t> localIndices;
+    std::vector<uint32_t> meshletWeldedVertices;
+    std::vector<uint32_t> reordered;
+    reordered.reserve(indices.size());
+
+    auto newVertexCount = [&](uint32_t triangle) {
+        const uint32_t *t = &indices[3 * triangle];
+        return static_cast<uint32_t>(!inMeshlet[t[0]]) +
+               static_cast<uint32_t>(!inMeshlet[t[1]] && t[1] != t[0]) +
+               static_cast<uint32_t>(!inMeshlet[t[2]] && t[2] != t[0] &&
+                                     t[2] != t[1]);
+    };
+
+    Meshlet meshlet;
+    auto flush = [&]() {
+        if (meshlet.m_indexCount == 0) {
+            return;
+        }
+        meshlet.m_vertexCount = static_cast<uint32_t>(meshletVertices.size());
+
+        // The triangles are ordered for the vertex cache within the meshlet
+        // only, on the local vertices so the work is in the meshlet size
+        uint32_t *meshletIndices = &reordered[meshlet.m_firstIndex];
+        localIndices.resize(meshlet.m_indexCount);
+        for (uint32_t i = 0; i < meshlet.m_indexCount; i++) {
+            localIndices[i] = localVertices[meshletIndices[i]];
+        }
+        optimizeVertexCache(localIndices.data(), localIndices.size(),
+                            meshlet.m_vertexCount);
+        for (uint32_t i = 0; i < meshlet.m_indexCount; i++) {
+            meshletIndices[i] = meshletVertices[localIndices[i]];
+        }
+
+        computeBounds(positions, &reordered[meshlet.m_firstIndex], meshlet);
+        meshlets.push_back(meshlet);
+
+        for (uint32_t vertex : meshletVertices) {
+            inMeshlet[vertex] = false;
+        }
+        meshletVertices.clear();
+        meshletWeldedVertices.clear();
+        meshlet = Meshlet();
+        meshlet.m_firstIndex = static_cast<uint32_t>(reordered.size());
+    };
+
+    uint32_t nextSeed = 0;
+    for (uint32_t emittedCount = 0; emittedCount < triangleCount;
+         emittedCount++) {
+        uint32_t best = ~0u;
+        uint32_t bestNewVertices = 4;
+        for (uint32_t welded : meshletWeldedVertices) {
+            for (uint32_t i = triangleOffsets[welded];
+                 i < triangleOffsets[welded + 1] && bestNewVertices > 0; i++) {
+                const uint32_t triangle = vertexTriangles[i];
+                if (emitted[triangle]) {
+                    continue;
+                }
+                const uint32_t newVertices = newVertexCount(triangle);
+                if (newVertices < bestNewVertices) {
+                    best = triangle;
+                    bestNewVertices = newVertices;
+                }
+            }
+        }
+
+        // Start a new meshlet when no neighbour fits or none is left
+        if (best == ~0u ||
+            meshletVertices.size() + bestNewVertices > Meshlet::s_maxVertices) {
+            flush();
+            while (emitted[nextSeed]) {
+                nextSeed++;
+            }
+            best = nextSeed;
+        }
+
+        for (uint32_t k = 0; k < 3; k++) {
+            const uint32_t vertex = indices[3 * best + k];
+            if (inMeshlet[vertex] == false) {
+                inMeshlet[vertex] = true;
+                localVertices[vertex] =
+                    static_cast<uint32_t>(meshletVertices.size());
+                meshletVertices.push_back(vertex);
+                const uint32_t welded = weldedVertices[vertex];
+                if (std::find(meshletWeldedVertices.begin(),
+                              meshletWeldedVertices.end(),
+                              welded) == meshletWeldedVertices.end()) {
+                    meshletWeldedVertices.push_back(welded);
+                }
+            }
+            reordered.push_back(vertex);
+        }
+        emitted[best] = true;
+        meshlet.m_indexCount += 3;
+
+        if (meshlet.m_indexCount == 3 * Meshlet::s_maxTriangles) {
+            flush();
+        }
+    }
+    flush();
+
+    indices.swap(reordered);
+}
+} // namespace vulkan_proto
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "headers.h"
+
+namespace vulkan_proto {
+// A cluster of neighbouring triangles of a mesh, culled as a unit. The
+// triangles of a meshlet are contiguous in the index list of the mesh.
+struct Meshlet {
+    static constexpr uint32_t s_maxVertices = 64;
+    static constexpr uint32_t s_maxTriangles = 124;
+
+    // Object space center in xyz, radius in w
+    glm::vec4 m_boundingSphere = glm::vec4(0.0f);
+    // Object space axis of the normal cone in xyz, sine of the cone angle in
+    // w. Every triangle faces away from a viewer at v when
+    // dot(c - v, axis) >= w * length(c - v) + radius, where c is the center
+    // of the sphere. A w of 1 or more means the cone is too wide to cull.
+    glm::vec4 m_cone = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    // Range in the index list of the mesh
+    uint32_t m_firstIndex = 0;
+    uint32_t m_indexCount = 0;
+    // Unique vertices used by the triangles
+    uint32_t m_vertexCount = 0;
+};
+
+// Splits the triangles into meshlets of at most s_maxVertices vertices and
+// s_maxTriangles triangles. Each meshlet is grown greedily from its first
+// triangle, by taking the neighbouring triangle that adds the fewest new
+// vertices. The indices are reordered so each meshlet is contiguous, front
+// faces are counter clockwise. The triangles within each meshlet are then
+// ordered for the post-transform vertex cache, see optimizeVertexCache.
+void buildMeshlets(const std::vector<glm::vec3> &positions,
+                   std::vector<uint32_t> &indices,
+                   std::vector<Meshlet> &meshlets);
+} // namespace vulkan_proto
@@ -1,32 +1,26 @@
 #pragma once
 
 #include "headers.h"
-#include "mesh.h"
-#include "texture.h"
 
 namespace vulkan_proto {
 
 struct Renderer;
 struct Logger;
 
+// One entry of the scene description. The mesh and textures are owned by the
+// renderer and shared by every model that references the same files, so a
+// model only stores indices to them and the transforms of its instances.
 struct Model {
     const Renderer &m_renderer;
 
-    // TODO these should be pointers, so that multiple instances can use the
-    // same mesh and textures
-    Mesh m_mesh;
-    std::vector<Texture> m_textures;
+    std::string m_meshPath;
+    std::vector<std::string> m_texturePaths;
 
-    VkDescriptorSet m_descriptorSet = VK_NULL_HANDLE;
-    glm::mat4 m_modelMatrix = glm::mat4(1.0f);
-
-    struct Buffer {
-        VkDescriptorBufferInfo descriptor;
-        VkBuffer stagingBuffer;
-        VkBuffer buffer;
-        VkDeviceMemory stagingMemory;
-        VkDeviceMemory memory;
-    } m_uniformBuffer;
+    uint32_t m_meshIndex = ~0u;
+    std::vector<uint32_t> m_textureIndices;
+    std::vector<glm::mat4> m_modelMatrices;
+    // Rasterized by the software occlusion culler
+    bool m_occluder = false;
 
     Model(Renderer &renderer);
     ~Model();
@@ -34,4 +28,22 @@ struct Model {
     void destroy();
     Logger &getLogger();
 };
+
+// All the instances of models that share a mesh and a set of textures. These
+// are drawn with a single instanced draw call.
+struct InstanceBatch {
+    uint32_t m_meshIndex = ~0u;
+    std::vector<uint32_t> m_textureIndices;
+    uint32_t m_firstInstance = 0;
+    uint32_t m_instanceCount = 0;
+    // One draw per level of detail of the mesh, starting from the full mesh.
+    // With impostors the last level is the impostor quad.
+    uint32_t m_firstDraw = 0;
+    uint32_t m_lodCount = 1;
+    // Where the textures of the batch start in the material textures.
+    // Batches with the same textures share it.
+    uint32_t m_materialIndex = ~0u;
+    // The atlas of the batch, ~0u without impostors
+    uint32_t m_impostorMaterialIndex = ~0u;
+};
 } // namespace vulkan_proto
@@ -0,0 +1,427 @@
+#include "obj_loader.h"
+#include "mapped_file.h"
+#include <cmath>
+
+namespace {
+using vulkan_proto::ObjMesh;
+
+// What one thread parsed. Indices are absolute, except those of negative
+// indices, which are relative to the first attribute of the chunk until the
+// chunks are merged.
+struct Chunk {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texCoords;
+    std::vector<ObjMesh::Index> indices;
+    // Where the indices relative to the chunk are
+    std::vector<uint32_t> relativePositions;
+    std::vector<uint32_t> relativeTexCoords;
+    // First index & corner count of each polygon with more than three
+    std::vector<std::pair<uint32_t, uint32_t>> polygons;
+    // An index of zero or a number that could not be parsed
+    bool malformed = false;
+};
+
+bool isDigit(char c) { return static_cast<unsigned char>(c - '0') < 10; }
+
+bool isSpace(char c) { return c == ' ' || c == '\t'; }
+
+bool isLineEnd(char c) { return c == '\n' || c == '\r'; }
+
+uint64_t loadEightBytes(const char *p) {
+    uint64_t value = 0;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Digit test & conversion of eight characters at once in a 64 bit register,
+// as in fast_float. Assumes little endian.
+bool isEightDigits(uint64_t value) {
+    return ((value & 0xf0f0f0f0f0f0f0f0ull) |
+            (((value + 0x0606060606060606ull) & 0xf0f0f0f0f0f0f0f0ull) >>
+             4)) == 0x3333333333333333ull;
+}
+
+uint32_t parseEightDigits(uint64_t value) {
+    value -= 0x3030303030303030ull;
+    value = (value * 10) + (value >> 8);
+    value = (((value & 0x000000ff000000ffull) * 0x000f424000000064ull) +
+             (((value >> 16) & 0x000000ff000000ffull) *
+              0x0000271000000001ull)) >>
+            32;
+    return static_cast<uint32_t>(value);
+}
+
+// Accumulates digits into the mantissa while it has room for them, the
+// rest only scale the number. Returns the number of digits read.
+size_t parseDigits(const char *&p, const char *end, uint64_t &mantissa,
+                   int32_t &exponent, bool fraction) {
+    const char *start = p;
+    while (end - p >= 8 && isEightDigits(loadEightBytes(p))) {
+        if (mantissa < 100000000000ull) {
+            mantissa = mantissa * 100000000 +
+                       parseEightDigits(loadEightBytes(p));
+            exponent -= fraction ? 8 : 0;
+        } else {
+            exponent += fraction ? 0 : 8;
+        }
+        p += 8;
+    }
+    for (; p < end && isDigit(*p); p++) {
+        if (mantissa < 1000000000000000000ull) {
+            mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+            exponent -= fraction ? 1 : 0;
+        } else {
+            exponent += fraction ? 0 : 1;
+        }
+    }
+    return static_cast<size_t>(p - start);
+}
+
+// Decimal with an optional sign, fraction and exponent. Computed in double
+// from at most 19 significant digits, which is plenty for a float.
+bool parseFloat(const char *&p, const char *end, float &value) {
+    static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                    1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                    1e18, 1e19, 1e20, 1e21, 1e22};
+    const bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) {
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int32_t exponent = 0;
+    size_t digitCount = parseDigits(p, end, mantissa, exponent, false);
+    if (p < end && *p == '.') {
+        p++;
+        digitCount += parseDigits(p, end, mantissa, exponent, true);
+    }
+    if (digitCount == 0) {
+        return false;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        const bool negativeExponent = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+')) {
+            p++;
+        }
+        if (p == end || isDigit(*p) == false) {
+            return false;
+        }
+        int32_t written = 0;
+        for (; p < end && isDigit(*p); p++) {
+            written = std::min(written * 10 + (*p - '0'), 100000);
+        }
+        exponent += negativeExponent ? -written : written;
+    }
+
+    double result = static_cast<double>(mantissa);
+    if (exponent < 0) {
+        result = exponent >= -22 ? result / powers[-exponent]
+                                 : result * std::pow(10.0, exponent);
+    } else if (exponent > 0) {
+        result = exponent <= 22 ? result * powers[exponent]
+                                : result * std::pow(10.0, exponent);
+    }
+    value = static_cast<float>(negative ? -result : result);
+    return true;
+}
+
+bool parseInt(const char *&p, const char *end, int64_t &value) {
+    const bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) {
+        p++;
+    }
+    if (p == end || isDigit(*p) == false) {
+        return false;
+    }
+    value = 0;
+    for (; p < end && isDigit(*p); p++) {
+        value = std::min<int64_t>(value * 10 + (*p - '0'), INT32_MAX);
+    }
+    value = negative ? -value : value;
+    return true;
+}
+
+void skipSpaces(const char *&p, const char *end) {
+    while (p < end && isSpace(*p)) {
+        p++;
+    }
+}
+
+// Parses the floats of an attribute, missing ones stay zero
+template <int N>
+bool parseAttribute(const char *&p, const char *end, float (&values)[N]) {
+    for (int i = 0; i < N; i++) {
+        skipSpaces(p, end);
+        if (p == end || isLineEnd(*p)) {
+            return i > 0;
+        }
+        if (parseFloat(p, end, values[i]) == false) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// One corner of a face, v, v/vt, v//vn or v/vt/vn
+bool parseCorner(const char *&p, const char *end, Chunk &chunk,
+                 ObjMesh::Index &index, bool &relativePosition,
+                 bool &relativeTexCoord) {
+    // One based, negative ones count back from the last attribute so far
+    auto resolve = [](int64_t value, size_t count, bool &relative) {
+        relative = value < 0;
+        return static_cast<int32_t>(value < 0 ? static_cast<int64_t>(count) +
+                                                    value
+                                              : value - 1);
+    };
+
+    int64_t value = 0;
+    if (parseInt(p, end, value) == false || value == 0) {
+        return false;
+    }
+    index.position = resolve(value, chunk.positions.size(), relativePosition);
+    index.texCoord = -1;
+    relativeTexCoord = false;
+    if (p < end && *p == '/') {
+        p++;
+        if (p < end && *p != '/') {
+            if (parseInt(p, end, value) == false || value == 0) {
+                return false;
+            }
+            index.texCoord =
+                resolve(value, chunk.texCoords.size(), relativeTexCoord);
+        }
+        if (p < end && *p == '/') {
+            p++;
+            // Normals are not used
+            if (parseInt(p, end, value) == false) {
+                return false;
+            }
+        }
+    }
+    return p == end || isSpace(*p) || isLineEnd(*p);
+}
+
+void parseFace(const char *&p, const char *end, Chunk &chunk) {
+    const uint32_t firstIndex = static_cast<uint32_t>(chunk.indices.size());
+    ObjMesh::Index first;
+    ObjMesh::Index previous;
+    bool firstRelative[2] = {};
+    bool previousRelative[2] = {};
+    uint32_t cornerCount = 0;
+    while (true) {
+        skipSpaces(p, end);
+        if (p == end || isLineEnd(*p)) {
+            break;
+        }
+
+        ObjMesh::Index index;
+        bool relative[2] = {};
+        if (parseCorner(p, end, chunk, index, relative[0], relative[1]) ==
+            false) {
+            chunk.malformed = true;
+            return;
+        }
+
+        if (cornerCount >= 2) {
+            const ObjMesh::Index corners[3] = {first, previous, index};
+            const bool *relatives[3] = {firstRelative, previousRelative,
+                                        relative};
+            for (uint32_t i = 0; i < 3; i++) {
+                const uint32_t position =
+                    static_cast<uint32_t>(chunk.indices.size());
+                if (relatives[i][0]) {
+                    chunk.relativePositions.push_back(position);
+                }
+                if (relatives[i][1]) {
+                    chunk.relativeTexCoords.push_back(position);
+                }
+                chunk.indices.push_back(corners[i]);
+            }
+        }
+        if (cornerCount == 0) {
+            first = index;
+            firstRelative[0] = relative[0];
+            firstRelative[1] = relative[1];
+        }
+        previous = index;
+        previousRelative[0] = relative[0];
+        previousRelative[1] = relative[1];
+        cornerCount++;
+    }
+    if (cornerCount > 3) {
+        chunk.polygons.emplace_back(firstIndex, cornerCount);
+    }
+}
+
+// The fan of a polygon is right when every triangle faces the same way as
+// the polygon, whose normal is the sum of the edge cross products (Newell)
+bool isFanConvex(const ObjMesh &mesh, uint32_t firstIndex,
+                 uint32_t cornerCount) {
+    const ObjMesh::Index *indices = &mesh.indices[firstIndex];
+    // The first corner, then the second of every triangle, then the third
+    // of the last
+    auto getCorner = [&](uint32_t corner) {
+        const uint32_t index = corner == 0 ? 0
+                               : corner + 1 < cornerCount
+                                   ? 3 * (corner - 1) + 1
+                                   : 3 * (corner - 2) + 2;
+        return mesh.positions[indices[index].position];
+    };
+    glm::vec3 normal(0.0f);
+    for (uint32_t i = 0; i < cornerCount; i++) {
+        normal += glm::cross(getCorner(i), getCorner((i + 1) % cornerCount));
+    }
+    for (uint32_t i = 0; i + 2 < cornerCount; i++) {
+        const glm::vec3 &a = mesh.positions[indices[3 * i].position];
+        const glm::vec3 &b = mesh.positions[indices[3 * i + 1].position];
+        const glm::vec3 &c = mesh.positions[indices[3 * i + 2].position];
+        if (glm::dot(glm::cross(b - a, c - a), normal) < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void parseChunk(const char *p, const char *end, Chunk &chunk) {
+    while (p < end) {
+        skipSpaces(p, end);
+        if (end - p >= 2 && p[0] == 'v' && isSpace(p[1])) {
+            p++;
+            float values[3] = {};
+            chunk.malformed |= parseAttribute(p, end, values) == false;
+            chunk.positions.emplace_back(values[0], values[1], values[2]);
+        } else if (end - p >= 3 && p[0] == 'v' && p[1] == 't' &&
+                   isSpace(p[2])) {
+            p += 2;
+            float values[2] = {};
+            chunk.malformed |= parseAttribute(p, end, values) == false;
+            chunk.texCoords.emplace_back(values[0], values[1]);
+        } else if (end - p >= 2 && p[0] == 'f' && isSpace(p[1])) {
+            p++;
+            parseFace(p, end, chunk);
+        }
+
+        // Whatever is left of the line, comments and other statements
+        const void *lineEnd = memchr(p, '\n', static_cast<size_t>(end - p));
+        p = lineEnd != nullptr ? static_cast<const char *>(lineEnd) + 1 : end;
+    }
+}
+} // namespace
+
+namespace vulkan_proto {
+void loadObj(const char *filename, uint32_t threadCount, ObjMesh &mesh,
+             size_t minChunkSize) {
+    MappedFile file;
+    THROW_IF(!file.open(filename), "Could not map %s", filename);
+
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    const size_t chunkCount = std::max<size_t>(
+        1, std::min<size_t>(threadCount,
+                            file.m_size / std::max<size_t>(1, minChunkSize)));
+
+    // Chunks start at the beginning of a line
+    std::vector<const char *> bounds(chunkCount + 1);
+    const char *end = file.m_data + file.m_size;
+    bounds[0] = file.m_data;
+    bounds[chunkCount] = end;
+    for (size_t i = 1; i < chunkCount; i++) {
+        const char *p =
+            std::max(bounds[i - 1], file.m_data + file.m_size * i / chunkCount);
+        const void *lineEnd = memchr(p, '\n', static_cast<size_t>(end - p));
+        bounds[i] =
+            lineEnd != nullptr ? static_cast<const char *>(lineEnd) + 1 : end;
+    }
+
+    // The last chunk is parsed on this thread
+    std::vector<Chunk> chunks(chunkCount);
+    std::vector<std::thread> workers;
+    workers.reserve(chunkCount - 1);
+    for (size_t i = 0; i + 1 < chunkCount; i++) {
+        workers.emplace_back(parseChunk, bounds[i], bounds[i + 1],
+                             std::ref(chunks[i]));
+    }
+    parseChunk(bounds[chunkCount - 1], end, chunks.back());
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    size_t positionCount = 0;
+    size_t texCoordCount = 0;
+    size_t indexCount = 0;
+    for (const auto &chunk : chunks) {
+        THROW_IF(chunk.malformed, "Malformed OBJ file %s", filename);
+        positionCount += chunk.positions.size();
+        texCoordCount += chunk.texCoords.size();
+        indexCount += chunk.indices.size();
+    }
+    THROW_IF(positionCount > static_cast<size_t>(INT32_MAX) ||
+                 texCoordCount > static_cast<size_t>(INT32_MAX),
+             "Too many vertices in %s", filename);
+
+    mesh.positions.clear();
+    mesh.texCoords.clear();
+    mesh.indices.clear();
+    mesh.concavePolygonCount = 0;
+    mesh.positions.reserve(positionCount);
+    mesh.texCoords.reserve(texCoordCount);
+    mesh.indices.reserve(indexCount);
+
+    // Relative indices become absolute once the attributes of the earlier
+    // chunks are known
+    std::vector<std::pair<uint32_t, uint32_t>> polygons;
+    for (const auto &chunk : chunks) {
+        const int32_t firstPosition =
+            static_cast<int32_t>(mesh.positions.size());
+        const int32_t firstTexCoord =
+            static_cast<int32_t>(mesh.texCoords.size());
+        const size_t firstIndex = mesh.indices.size();
+        mesh.positions.insert(mesh.positions.end(), chunk.positions.begin(),
+                              chunk.positions.end());
+        mesh.texCoords.insert(mesh.texCoords.end(), chunk.texCoords.begin(),
+                              chunk.texCoords.end());
+        mesh.indices.insert(mesh.indices.end(), chunk.indices.begin(),
+                            chunk.indices.end());
+        for (const auto &polygon : chunk.polygons) {
+            polygons.emplace_back(
+                static_cast<uint32_t>(firstIndex) + polygon.first,
+                polygon.second);
+        }
+        for (uint32_t i : chunk.relativePositions) {
+            mesh.indices[firstIndex + i].position += firstPosition;
+        }
+        // Missing ones are -1 too, so these are checked here
+        for (uint32_t i : chunk.relativeTexCoords) {
+            int32_t &texCoord = mesh.indices[firstIndex + i].texCoord;
+            texCoord += firstTexCoord;
+            if (texCoord < 0) {
+                THROW_IF(true, "Texture coordinate index before the first "
+                               "one in %s", filename);
+            }
+        }
+    }
+
+    // The messages are only formatted on failure
+    for (const auto &index : mesh.indices) {
+        if (index.position < 0 ||
+            index.position >= static_cast<int32_t>(positionCount)) {
+            THROW_IF(true, "Position index %d out of range in %s",
+                     index.position + 1, filename);
+        }
+        if (index.texCoord >= static_cast<int32_t>(texCoordCount)) {
+            THROW_IF(true, "Texture coordinate index %d out of range in %s",
+                     index.texCoord + 1, filename);
+        }
+    }
+
+    for (const auto &polygon : polygons) {
+        if (!isFanConvex(mesh, polygon.first, polygon.second)) {
+            mesh.concavePolygonCount++;
+        }
+    }
+}
+} // namespace vulkan_proto
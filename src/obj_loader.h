@@ -0,0 +1,36 @@
+#pragma once
+
+#include "headers.h"
+
+namespace vulkan_proto {
+// Geometry of a Wavefront OBJ file. Only what the meshes use is kept, normals
+// and groups, materials and the like are skipped.
+struct ObjMesh {
+    // Zero based into the attributes, texCoord is -1 when the corner has none
+    struct Index {
+        int32_t position = 0;
+        int32_t texCoord = -1;
+    };
+
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texCoords;
+    // Three per triangle, polygons are triangulated as fans so they must be
+    // convex
+    std::vector<Index> indices;
+    // Polygons whose fan has a triangle facing against the polygon, which
+    // covers the wrong area. Concave polygons mostly.
+    uint32_t concavePolygonCount = 0;
+};
+
+// Chunks smaller than this are not worth a thread
+constexpr size_t s_minObjChunkSize = 1 << 20;
+
+// Parses an OBJ file on threadCount threads, or one per core when zero. The
+// file is memory mapped and split at line boundaries, each thread parses its
+// chunk and the chunks are then concatenated in order. Negative indices are
+// relative to the attributes defined before the face, also when those are in
+// an earlier chunk. Throws when the file cannot be read or a face refers to
+// an attribute that does not exist.
+void loadObj(const char *filename, uint32_t threadCount, ObjMesh &mesh,
+             size_t minChunkSize = s_minObjChunkSize);
+} // namespace vulkan_proto
@@ -0,0 +1,358 @@
+#include "overdraw.h"
+#include <algorithm>
+#include <numeric>
+
+namespace {
+constexpr int s_gridSize = 256;
+
+// One view of the estimator, looking along forward. Right x up is -forward,
+// so front faces stay counter clockwise on the screen.
+struct View {
+    glm::vec3 right;
+    glm::vec3 up;
+    glm::vec3 forward;
+};
+
+// Area weighted sums over the triangles of a cluster
+struct ClusterSums {
+    glm::vec3 centroid = glm::vec3(0.0f);
+    glm::vec3 normal = glm::vec3(0.0f);
+    float area = 0.0f;
+};
+
+ClusterSums sumCluster(const uint32_t *indices, size_t indexCount,
+                       const glm::vec3 *positions) {
+    ClusterSums sums;
+    for (size_t i = 0; i + 2 < indexCount; i += 3) {
+        const glm::vec3 &p0 = positions[indices[i + 0]];
+        const glm::vec3 &p1 = positions[indices[i + 1]];
+        const glm::vec3 &p2 = positions[indices[i + 2]];
+        // Its length is twice the area, which is fine for weighting
+        const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        const float area = glm::length(normal);
+        sums.centroid += (area / 3.0f) * (p0 + p1 + p2);
+        sums.normal += normal;
+        sums.area += area;
+    }
+    return sums;
+}
+
+glm::vec3 getCenter(const ClusterSums &sums) {
+    return sums.area > 0.0f ? sums.centroid / sums.area : glm::vec3(0.0f);
+}
+
+// Larger the further out the cluster is along its own normal
+float getSortKey(const ClusterSums &cluster, const glm::vec3 &center) {
+    const float normalLength = glm::length(cluster.normal);
+    if (cluster.area <= 0.0f || normalLength <= 0.0f) {
+        return 0.0f;
+    }
+    return glm::dot(cluster.centroid / cluster.area - center,
+                    cluster.normal / normalLength);
+}
+
+// Reorders ranges of the indices by descending key, ranges are given by
+// their starts and end at the next start or indexCount
+void sortRanges(uint32_t *indices, size_t indexCount,
+                const std::vector<uint32_t> &starts,
+                const std::vector<float> &keys, std::vector<uint32_t> &order) {
+    order.resize(starts.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&keys](uint32_t a,
+                                                         uint32_t b) {
+        return keys[a] > keys[b];
+    });
+
+    std::vector<uint32_t> sorted;
+    sorted.reserve(indexCount);
+    for (uint32_t range : order) {
+        const size_t end =
+            range + 1 < starts.size() ? starts[range + 1] : indexCount;
+        sorted.insert(sorted.end(), indices + starts[range], indices + end);
+    }
+    std::copy(sorted.begin(), sorted.end(), indices);
+}
+
+// Counts the vertices of a triangle that miss the cache, see
+// optimizeVertexCache for the timestamps
+uint32_t updateCache(const uint32_t *triangle, uint32_t cacheSize,
+                     std::vector<uint32_t> &cacheTimes, uint32_t &time) {
+    uint32_t misses = 0;
+    for (uint32_t k = 0; k < 3; k++) {
+        const uint32_t vertex = triangle[k];
+        if (time - cacheTimes[vertex] > cacheSize) {
+            cacheTimes[vertex] = time++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+void rasterize(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c,
+               std::vector<float> &depths, std::vector<uint32_t> &counts) {
+    auto edge = [](const glm::vec3 &p, const glm::vec3 &q, float x, float y) {
+        return (q.x - p.x) * (y - p.y) - (q.y - p.y) * (x - p.x);
+    };
+    const float area = edge(a, b, c.x, c.y);
+    // Back faces and degenerate triangles are culled
+    if (area <= 0.0f) {
+        return;
+    }
+
+    // Pixels on an edge belong to the triangle on its left or top, so
+    // neighbours do not shade them twice
+    auto bias = [](const glm::vec3 &p, const glm::vec3 &q) {
+        const bool topLeft = q.y > p.y || (q.y == p.y && q.x < p.x);
+        return topLeft ? 0.0f : -1e-7f;
+    };
+    const float bias0 = bias(b, c);
+    const float bias1 = bias(c, a);
+    const float bias2 = bias(a, b);
+
+    const int minX = std::max(
+        0, static_cast<int>(std::floor(std::min({a.x, b.x, c.x}))));
+    const int minY = std::max(
+        0, static_cast<int>(std::floor(std::min({a.y, b.y, c.y}))));
+    const int maxX = std::min(
+        s_gridSize - 1, static_cast<int>(std::ceil(std::max({a.x, b.x, c.x}))));
+    const int maxY = std::min(
+        s_gridSize - 1, static_cast<int>(std::ceil(std::max({a.y, b.y, c.y}))));
+    for (int y = minY; y <= maxY; y++) {
+        for (int x = minX; x <= maxX; x++) {
+            const float px = x + 0.5f;
+            const float py = y + 0.5f;
+            const float w0 = edge(b, c, px, py) / area;
+            const float w1 = edge(c, a, px, py) / area;
+            const float w2 = edge(a, b, px, py) / area;
+            if (w0 + bias0 < 0.0f || w1 + bias1 < 0.0f || w2 + bias2 < 0.0f) {
+                continue;
+            }
+            const float depth = w0 * a.z + w1 * b.z + w2 * c.z;
+            const size_t pixel = static_cast<size_t>(y) * s_gridSize + x;
+            if (depth < depths[pixel]) {
+                depths[pixel] = depth;
+                counts[pixel]++;
+            }
+        }
+    }
+}
+} // namespace
+
+namespace vulkan_proto {
+OverdrawStatistics estimateOverdraw(const uint32_t *indices,
+                                    size_t indexCount,
+                                    const std::vector<glm::vec3> &positions) {
+    OverdrawStatistics statistics;
+    if (indexCount < 3) {
+        return statistics;
+    }
+
+    // Fitted to the used vertices, the same scale on every axis
+    glm::vec3 minimum(std::numeric_limits<float>::max());
+    glm::vec3 maximum(std::numeric_limits<float>::lowest());
+    for (size_t i = 0; i < indexCount; i++) {
+        minimum = glm::min(minimum, positions[indices[i]]);
+        maximum = glm::max(maximum, positions[indices[i]]);
+    }
+    const glm::vec3 extent = maximum - minimum;
+    const float size = std::max({extent.x, extent.y, extent.z});
+    if (size <= 0.0f) {
+        return statistics;
+    }
+    const glm::vec3 center = 0.5f * (minimum + maximum);
+    const float scale = static_cast<float>(s_gridSize) / size;
+
+    const glm::vec3 x(1.0f, 0.0f, 0.0f);
+    const glm::vec3 y(0.0f, 1.0f, 0.0f);
+    const glm::vec3 z(0.0f, 0.0f, 1.0f);
+    const View views[] = {{x, y, -z}, {-x, y, z},  {-z, y, -x},
+                          {z, y, x},  {z, x, -y}, {x, z, y}};
+
+    std::vector<float> depths(s_gridSize * s_gridSize);
+    std::vector<uint32_t> counts(s_gridSize * s_gridSize);
+    for (const View &view : views) {
+        std::fill(depths.begin(), depths.end(),
+                  std::numeric_limits<float>::max());
+        std::fill(counts.begin(), counts.end(), 0);
+
+        auto project = [&](uint32_t index) {
+            const glm::vec3 p = positions[index] - center;
+            return glm::vec3(
+                (glm::dot(p, view.right) + 0.5f * size) * scale,
+                (glm::dot(p, view.up) + 0.5f * size) * scale,
+                glm::dot(p, view.forward));
+        };
+        for (size_t i = 0; i + 2 < indexCount; i += 3) {
+            rasterize(project(indices[i + 0]), project(indices[i + 1]),
+                      project(indices[i + 2]), depths, counts);
+        }
+
+        for (uint32_t count : counts) {
+            statistics.coveredPixels += count > 0;
+            statistics.shadedPixels += count;
+        }
+    }
+
+    if (statistics.coveredPixels > 0) {
+        statistics.overdraw = static_cast<float>(statistics.shadedPixels) /
+                              static_cast<float>(statistics.coveredPixels);
+    }
+    return statistics;
+}
+
+void optimizeOverdraw(uint32_t *indices, size_t indexCount,
+                      const glm::vec3 *positions, uint32_t vertexCount,
+                      float threshold, uint32_t cacheSize) {
+    const uint32_t triangleCount = static_cast<uint32_t>(indexCount / 3);
+    if (triangleCount < 2) {
+        return;
+    }
+
+    // Three misses in a row start a new patch of the mesh, the cache order
+    // breaks there anyway
+    std::vector<uint32_t> cacheTimes(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    std::vector<uint32_t> hardStarts;
+    for (uint32_t i = 0; i < triangleCount; i++) {
+        if (updateCache(&indices[3 * i], cacheSize, cacheTimes, time) == 3 ||
+            i == 0) {
+            hardStarts.push_back(i);
+        }
+    }
+    hardStarts.push_back(triangleCount);
+
+    // Each patch is cut again once the miss ratio since the last cut comes
+    // within the threshold of that of the patch. Restarting the cache at
+    // the cuts is what a reordered cluster costs.
+    std::vector<uint32_t> starts;
+    for (size_t i = 0; i + 1 < hardStarts.size(); i++) {
+        const uint32_t start = hardStarts[i];
+        const uint32_t end = hardStarts[i + 1];
+
+        time += cacheSize + 1;
+        uint32_t patchMisses = 0;
+        for (uint32_t t = start; t < end; t++) {
+            patchMisses +=
+                updateCache(&indices[3 * t], cacheSize, cacheTimes, time);
+        }
+        const float targetRatio = threshold * static_cast<float>(patchMisses) /
+                                  static_cast<float>(end - start);
+
+        starts.push_back(3 * start);
+        time += cacheSize + 1;
+        uint32_t misses = 0;
+        uint32_t triangles = 0;
+        for (uint32_t t = start; t < end; t++) {
+            misses += updateCache(&indices[3 * t], cacheSize, cacheTimes, time);
+            triangles++;
+            if (static_cast<float>(misses) <=
+                targetRatio * static_cast<float>(triangles)) {
+                starts.push_back(3 * (t + 1));
+                time += cacheSize + 1;
+                misses = 0;
+                triangles = 0;
+            }
+        }
+        // The rest of the patch is merged into the last cluster, it would
+        // often be a few triangles with a poor ratio. This also drops the cut
+        // at the end of the patch.
+        if (starts.back() != 3 * start) {
+            starts.pop_back();
+        }
+    }
+
+    const glm::vec3 center =
+        getCenter(sumCluster(indices, indexCount, positions));
+    std::vector<float> keys(starts.size());
+    for (size_t i = 0; i < starts.size(); i++) {
+        const size_t end = i + 1 < starts.size() ? starts[i + 1] : indexCount;
+        keys[i] = getSortKey(
+            sumCluster(&indices[starts[i]], end - starts[i], positions),
+            center);
+    }
+
+    // The clusters start with a cold cache wherever they land, which can
+    // cost more than the threshold allows over the whole list. The cache
+    // order is kept then.
+    const size_t sortedCount = 3 * static_cast<size_t>(triangleCount);
+    const std::vector<uint32_t> cacheOrder(indices, indices + sortedCount);
+    const float cacheAcmr =
+        analyzeVertexCache(indices, sortedCount, vertexCount, cacheSize).acmr;
+    std::vector<uint32_t> order;
+    sortRanges(indices, sortedCount, starts, keys, order);
+    if (analyzeVertexCache(indices, sortedCount, vertexCount, cacheSize).acmr >
+        threshold * cacheAcmr) {
+        std::copy(cacheOrder.begin(), cacheOrder.end(), indices);
+    }
+}
+
+void optimizeMeshletOverdraw(const std::vector<glm::vec3> &positions,
+                             std::vector<uint32_t> &indices,
+                             std::vector<Meshlet> &meshlets, float threshold) {
+    if (meshlets.empty()) {
+        return;
+    }
+
+    // Within a meshlet on its local vertices, like the cache order
+    std::vector<uint32_t> localVertices(positions.size(), ~0u);
+    std::vector<uint32_t> localIndices;
+    std::vector<uint32_t> meshletVertices;
+    std::vector<glm::vec3> localPositions;
+    for (const Meshlet &meshlet : meshlets) {
+        uint32_t *meshletIndices = &indices[meshlet.m_firstIndex];
+        localIndices.resize(meshlet.m_indexCount);
+        for (uint32_t i = 0; i < meshlet.m_indexCount; i++) {
+            uint32_t &local = localVertices[meshletIndices[i]];
+            if (local == ~0u) {
+                local = static_cast<uint32_t>(meshletVertices.size());
+                meshletVertices.push_back(meshletIndices[i]);
+                localPositions.push_back(positions[meshletIndices[i]]);
+            }
+            localIndices[i] = local;
+        }
+        optimizeOverdraw(localIndices.data(), localIndices.size(),
+                         localPositions.data(),
+                         static_cast<uint32_t>(meshletVertices.size()),
+                         threshold);
+        for (uint32_t i = 0; i < meshlet.m_indexCount; i++) {
+            meshletIndices[i] = meshletVertices[localIndices[i]];
+        }
+
+        for (uint32_t vertex : meshletVertices) {
+            localVertices[vertex] = ~0u;
+        }
+        meshletVertices.clear();
+        localPositions.clear();
+    }
+
+    // Then the meshlets themselves, they start the cache over anyway
+    const uint32_t firstIndex = meshlets.front().m_firstIndex;
+    const Meshlet &last = meshlets.back();
+    const size_t indexCount =
+        last.m_firstIndex + last.m_indexCount - firstIndex;
+    const glm::vec3 center = getCenter(
+        sumCluster(&indices[firstIndex], indexCount, positions.data()));
+
+    std::vector<uint32_t> starts(meshlets.size());
+    std::vector<float> keys(meshlets.size());
+    for (size_t i = 0; i < meshlets.size(); i++) {
+        starts[i] = meshlets[i].m_firstIndex - firstIndex;
+        keys[i] = getSortKey(sumCluster(&indices[meshlets[i].m_firstIndex],
+                                        meshlets[i].m_indexCount,
+                                        positions.data()),
+                             center);
+    }
+
+    std::vector<uint32_t> order;
+    sortRanges(&indices[firstIndex], indexCount, starts, keys, order);
+    std::vector<Meshlet> sorted;
+    sorted.reserve(meshlets.size());
+    uint32_t nextIndex = firstIndex;
+    for (uint32_t i : order) {
+        sorted.push_back(meshlets[i]);
+        sorted.back().m_firstIndex = nextIndex;
+        nextIndex += meshlets[i].m_indexCount;
+    }
+    meshlets.swap(sorted);
+}
+} // namespace vulkan_proto
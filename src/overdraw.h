@@ -0,0 +1,46 @@
+#pragma once
+
+#include "headers.h"
+#include "meshlet.h"
+#include "vertex_cache.h"
+
+namespace vulkan_proto {
+// How much larger the vertex cache miss ratio of a cluster may get so the
+// clusters are smaller and sort better, see optimizeOverdraw
+constexpr float s_overdrawThreshold = 1.05f;
+
+// Fragments an index list shades when drawn alone, front faces only with a
+// depth test, averaged over six orthographic views along the axes
+struct OverdrawStatistics {
+    uint64_t coveredPixels = 0;
+    uint64_t shadedPixels = 0;
+    // Shaded per covered pixel, at best 1
+    float overdraw = 0.0f;
+};
+
+// Rasterizes the triangles in order on the CPU, into 256 x 256 pixels per view
+// fitted to the bounding box of the triangles
+OverdrawStatistics estimateOverdraw(const uint32_t *indices,
+                                    size_t indexCount,
+                                    const std::vector<glm::vec3> &positions);
+
+// Reorders the triangles of a cache optimized index list so the outer ones
+// that face away from the center are drawn first and hide the rest. The list
+// is cut into clusters wherever the cache starts over anyway, and further
+// wherever the miss ratio so far is within threshold times that of the whole
+// cluster. The clusters are then sorted by how much they face outwards
+// (Sander et al. 2007). A larger threshold makes smaller clusters, less
+// overdraw and more vertex shader invocations. The miss ratio of the whole
+// list grows by at most the threshold, otherwise the order is kept.
+void optimizeOverdraw(uint32_t *indices, size_t indexCount,
+                      const glm::vec3 *positions, uint32_t vertexCount,
+                      float threshold = s_overdrawThreshold,
+                      uint32_t cacheSize = s_vertexCacheSize);
+
+// Runs optimizeOverdraw within each meshlet, then sorts the meshlets the same
+// way as the clusters. The meshlets stay contiguous in the index list.
+void optimizeMeshletOverdraw(const std::vector<glm::vec3> &positions,
+                             std::vector<uint32_t> &indices,
+                             std::vector<Meshlet> &meshlets,
+                             float threshold = s_overdrawThreshold);
+} // namespace vulkan_proto
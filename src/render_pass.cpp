@@ -12,28 +12,57 @@ void RenderPass::create(bool recycle) {
     if (recycle) {
         destroy();
     }
+
+    m_handle = createHandle(true, true);
+    m_firstPhaseHandle = createHandle(true, false);
+    m_secondPhaseHandle = createHandle(false, true);
+}
+
+void RenderPass::destroy() {
+    LOG("=Destroy render pass=");
+    for (VkRenderPass *handle :
+         {&m_handle, &m_firstPhaseHandle, &m_secondPhaseHandle}) {
+        vkDestroyRenderPass(m_renderer.getDevice(), *handle,
+                            m_renderer.getAllocator());
+        *handle = VK_NULL_HANDLE;
+    }
+}
+
+VkRenderPass RenderPass::createHandle(bool first, bool last) const {
+    // Depth is kept between the passes in a layout compute shaders can read
+    const VkImageLayout depthBetweenPasses =
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
     VkAttachmentDescription colorAttchDes = {};
     colorAttchDes.flags = 0;
     colorAttchDes.format = m_renderer.getSurfaceFormat();
     colorAttchDes.samples = VK_SAMPLE_COUNT_1_BIT;
-    colorAttchDes.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttchDes.loadOp =
+        first ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
     colorAttchDes.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     colorAttchDes.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttchDes.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttchDes.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttchDes.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttchDes.initialLayout =
+        first ? VK_IMAGE_LAYOUT_UNDEFINED
+              : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttchDes.finalLayout = last ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+                                     : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
     VkAttachmentDescription depthAttchDes = {};
     depthAttchDes.flags = 0;
     depthAttchDes.format = m_renderer.getDepthFormat();
     depthAttchDes.samples = VK_SAMPLE_COUNT_1_BIT;
-    depthAttchDes.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthAttchDes.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttchDes.loadOp =
+        first ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+    depthAttchDes.storeOp =
+        last ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
     depthAttchDes.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     depthAttchDes.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depthAttchDes.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthAttchDes.initialLayout =
+        first ? VK_IMAGE_LAYOUT_UNDEFINED : depthBetweenPasses;
     depthAttchDes.finalLayout =
-        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        last ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+             : depthBetweenPasses;
 
     std::array<VkAttachmentDescription, 2> attachments = {colorAttchDes,
                                                           depthAttchDes};
@@ -52,14 +81,43 @@ void RenderPass::create(bool recycle) {
     subpass.pColorAttachments = &colorAttchRef;
     subpass.pDepthStencilAttachment = &depthAttchRef;
 
-    VkSubpassDependency dependency = {};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    dependency.srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
-                               VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    std::vector<VkSubpassDependency> dependencies(1);
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    dependencies[0].dstStageMask =
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                                    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    if (first == false) {
+        // The depth is read by compute shaders between the passes
+        dependencies[0].srcStageMask |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        dependencies[0].dstStageMask |=
+            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependencies[0].dstAccessMask |=
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    }
+
+    if (last == false) {
+        dependencies.emplace_back();
+        dependencies[1].srcSubpass = 0;
+        dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[1].srcStageMask =
+            VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[1].srcAccessMask =
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstStageMask =
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT |
+                                        VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                                        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    }
 
     VkRenderPassCreateInfo renderPassCi = {};
     renderPassCi.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -67,18 +125,14 @@ void RenderPass::create(bool recycle) {
     renderPassCi.pAttachments = attachments.data();
     renderPassCi.subpassCount = 1;
     renderPassCi.pSubpasses = &subpass;
-    renderPassCi.dependencyCount = 1;
-    renderPassCi.pDependencies = &dependency;
+    renderPassCi.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassCi.pDependencies = dependencies.data();
 
+    VkRenderPass handle = VK_NULL_HANDLE;
     VK_CHECK(vkCreateRenderPass(m_renderer.getDevice(), &renderPassCi,
-                                m_renderer.getAllocator(), &m_handle));
-}
+                                m_renderer.getAllocator(), &handle));
 
-void RenderPass::destroy() {
-    LOG("=Destroy render pass=");
-    vkDestroyRenderPass(m_renderer.getDevice(), m_handle,
-                        m_renderer.getAllocator());
-    m_handle = VK_NULL_HANDLE;
+    return handle;
 }
 
 Logger &RenderPass::getLogger() { return m_renderer.getLogger(); }
@@ -7,12 +7,22 @@ struct Renderer;
 struct Logger;
 struct RenderPass {
     const Renderer &m_renderer;
+    // Clears the attachments and presents
     VkRenderPass m_handle = VK_NULL_HANDLE;
+    // Split of m_handle in two for occlusion culling. The first one clears and
+    // leaves the depth readable by compute shaders, the second one continues
+    // from where the first one left off and presents. All three are
+    // compatible, so they share the pipelines and the framebuffers.
+    VkRenderPass m_firstPhaseHandle = VK_NULL_HANDLE;
+    VkRenderPass m_secondPhaseHandle = VK_NULL_HANDLE;
 
     RenderPass(Renderer &renderer);
     ~RenderPass();
     void create(bool recycle = false);
     void destroy();
     Logger &getLogger();
+
+  private:
+    VkRenderPass createHandle(bool first, bool last) const;
 };
 } // namespace vulkan_proto
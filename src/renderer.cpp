@@ -3,7 +3,10 @@
 namespace vulkan_proto {
 Renderer::Renderer()
     : m_instance(*this), m_device(*this), m_swapchain(*this),
-      m_renderPass(*this), m_graphicsPipeline(*this), m_camera(*this),
+      m_renderPass(*this), m_shaderCompiler(*this), m_graphicsPipeline(*this),
+      m_depthPipeline(*this), m_gpuTimer(*this), m_descriptorAllocator(*this),
+      m_geometryPool(*this), m_gpuCulling(*this), m_clusterCulling(*this),
+      m_hiZPyramid(*this), m_impostors(*this), m_camera(*this),
       m_logger("vulkan_proto.log") {}
 
 Renderer::~Renderer() {}
@@ -106,6 +109,7 @@ void Renderer::drawFrame() {
 
     VK_CHECK(vkQueueSubmit(m_device.m_graphicsQueue, 1, &submitInfo,
                            VK_NULL_HANDLE));
+    m_submittedImage = imageIndex;
 
     VkPresentInfoKHR presentInfo = {};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -141,14 +145,98 @@ void Renderer::updateUniformBuffers() {
                            m_camera.m_near, m_camera.m_far);
     vp *= m_camera.getLookAt();
 
-    for (auto &model : m_models) {
-        glm::mat4 modelMatrix = model.m_modelMatrix;
-        modelMatrix = vp * modelMatrix;
-        copyCPUToGPU(reinterpret_cast<const void *>(&modelMatrix),
-                     (VkDeviceSize)sizeof(modelMatrix),
-                     model.m_uniformBuffer.stagingMemory,
-                     model.m_uniformBuffer.stagingBuffer,
-                     model.m_uniformBuffer.buffer);
+    m_frustum.update(vp);
+    m_cameraData.viewProjection = vp;
+    m_cameraData.frustumPlanes = m_frustum.m_planes;
+    m_cameraData.position = glm::vec4(m_camera.m_position, 1.0f);
+    m_cameraData.lod = glm::vec4(
+        m_swapchain.m_extent.height /
+            (2.0f * std::tan(0.5f * glm::radians(m_camera.m_fov))),
+        m_lodThreshold, 0.0f, 0.0f);
+
+    // Model matrices are static and uploaded once, only the camera changes
+    copyCPUToGPU(reinterpret_cast<const void *>(&m_cameraData),
+                 (VkDeviceSize)sizeof(m_cameraData),
+                 m_cameraBuffer.stagingMemory, m_cameraBuffer.stagingBuffer,
+                 m_cameraBuffer.buffer);
+
+    // The copy waited for the previous frame to finish
+    double gpuTime = 0.0;
+    if (m_gpuTimer.getMilliseconds(m_submittedImage, gpuTime)) {
+        m_gpuTimeTotal += gpuTime;
+        if (++m_gpuTimeFrameCount == s_gpuTimeFrames) {
+            LOG("GPU frame time %.3f ms on average over %u frames, depth "
+                "pre-pass %s",
+                m_gpuTimeTotal / m_gpuTimeFrameCount, m_gpuTimeFrameCount,
+                m_depthPrepass ? "on" : "off");
+            m_gpuTimeTotal = 0.0;
+            m_gpuTimeFrameCount = 0;
+        }
+    }
+
+    if (m_cullingMode == CullingMode::Cpu) {
+        const auto tStart = std::chrono::high_resolution_clock::now();
+        if (m_softwareOcclusion.m_enabled) {
+            m_softwareOcclusion.render(vp);
+        }
+        const auto tRasterized = std::chrono::high_resolution_clock::now();
+        m_cpuCulling.cull(m_frustum, m_cameraData, m_softwareOcclusion,
+                          m_culledDraws, m_culledInstances);
+        const auto tCulled = std::chrono::high_resolution_clock::now();
+        m_gpuCulling.uploadDraws(m_culledDraws, m_culledInstances);
+
+        const uint32_t visibleCount =
+            static_cast<uint32_t>(m_cpuCulling.m_visibleObjects.size());
+        if (visibleCount != m_visibleObjectCount) {
+            m_visibleObjectCount = visibleCount;
+            const long long cullTime = static_cast<long long>(
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    tCulled - tRasterized)
+                    .count());
+            if (m_softwareOcclusion.m_enabled) {
+                LOG("%u of %u instances visible, %u occluded, culled in %lld "
+                    "us, %u occluder triangles rasterized in %lld us",
+                    visibleCount, m_cpuCulling.m_objectCount,
+                    m_cpuCulling.m_occludedCount, cullTime,
+                    m_softwareOcclusion.getTriangleCount(),
+                    static_cast<long long>(
+                        std::chrono::duration_cast<std::chrono::microseconds>(
+                            tRasterized - tStart)
+                            .count()));
+            } else {
+                LOG("%u of %u instances visible, culled in %lld us",
+                    visibleCount, m_cpuCulling.m_objectCount, cullTime);
+            }
+        }
+    } else if (m_cullingMode == CullingMode::Cluster) {
+        // Available for the same reason as below
+        const ClusterCulling::Statistics statistics =
+            m_clusterCulling.getStatistics();
+        if (statistics.visibleCount != m_visibleObjectCount) {
+            m_visibleObjectCount = statistics.visibleCount;
+            LOG("%u of %u clusters visible, %u outside the frustum, %u facing "
+                "away",
+                statistics.visibleCount, m_clusterCulling.m_slotCount,
+                statistics.frustumCulledCount,
+                statistics.backfaceCulledCount);
+        }
+    } else {
+        // The copy waits for the queue to idle, so the culling results of
+        // the previous frame are available
+        const GpuCulling::Statistics statistics = m_gpuCulling.getStatistics();
+        if (statistics.visibleCount != m_visibleObjectCount) {
+            m_visibleObjectCount = statistics.visibleCount;
+            if (m_gpuCulling.m_occlusion) {
+                LOG("%u of %u instances visible, %u drawn in the first phase, "
+                    "%u in the second, %u occluded",
+                    statistics.visibleCount, m_gpuCulling.m_objectCount,
+                    statistics.firstPhaseCount, statistics.secondPhaseCount,
+                    statistics.occludedCount);
+            } else {
+                LOG("%u of %u instances visible", statistics.visibleCount,
+                    m_gpuCulling.m_objectCount);
+            }
+        }
     }
 }
 
@@ -164,9 +252,17 @@ void Renderer::init() {
     m_swapchain.create();
     createTextureSampler();
     createSemaphores();
+    m_descriptorAllocator.create();
+    createGeometryPool();
     createModels();
+    createCulling();
     setupDescriptors();
-    m_graphicsPipeline.create();
+    captureImpostors();
+    m_depthPrepass = m_programInput.contains("depth_prepass") &&
+                     m_programInput.at("depth_prepass").value("enabled", false);
+    createGraphicsPipelines();
+    m_gpuTimer.create(
+        static_cast<uint32_t>(m_swapchain.m_framebuffers.size()));
     recordCommandBuffers();
 }
 
@@ -197,19 +293,49 @@ void Renderer::terminate() {
         VK_CHECK(vkDeviceWaitIdle(m_device.m_handle));
     }
     m_graphicsPipeline.destroy();
-
-    vkDestroyDescriptorPool(m_device.m_handle, m_descriptorPool, m_allocator);
-    m_descriptorPool = VK_NULL_HANDLE;
-
-    for (auto &dsl : m_descriptorSetLayouts) {
-        vkDestroyDescriptorSetLayout(m_device.m_handle, dsl, m_allocator);
-    }
+    m_depthPipeline.destroy();
+    m_gpuTimer.destroy();
+    m_gpuCulling.destroy();
+    m_clusterCulling.destroy();
+    m_hiZPyramid.destroy();
+    m_cpuCulling.destroy();
+    m_softwareOcclusion.destroy();
+    m_impostors.destroy(m_geometryPool);
+    m_shaderCompiler.destroy();
+
+    m_descriptorAllocator.destroy();
+    m_commonDescriptorSet = VK_NULL_HANDLE;
+    m_textureDescriptorSet = VK_NULL_HANDLE;
     m_descriptorSetLayouts.clear();
+    m_pushConstantRanges.clear();
 
     for (auto &model : m_models) {
         model.destroy();
     }
     m_models.clear();
+    m_instanceBatches.clear();
+    m_drawBatches.clear();
+    m_materialTextures.clear();
+    m_drawKeys.clear();
+    m_drawKeyScratch.clear();
+    m_instanceTransforms.clear();
+
+    for (auto &mesh : m_meshes) {
+        mesh.destroy(m_geometryPool);
+    }
+    m_meshes.clear();
+    m_meshIndices.clear();
+    m_geometryPool.destroy();
+
+    for (auto &texture : m_textures) {
+        texture.destroy();
+    }
+    m_textures.clear();
+    m_textureIndices.clear();
+
+    destroyStagedBuffer(m_instanceBuffer);
+    destroyStagedBuffer(m_cameraBuffer);
+    destroyStagedBuffer(m_materialBuffer);
 
     LOG("=Destroy semaphores=");
     vkDestroySemaphore(m_device.m_handle, m_renderingFinished, m_allocator);
@@ -256,7 +382,15 @@ void Renderer::recreateSwapchain() {
     VK_CHECK(vkDeviceWaitIdle(m_device.m_handle));
     m_renderPass.create(true);
     m_swapchain.create(true);
-    m_graphicsPipeline.create(true);
+    createGraphicsPipelines(true);
+    m_gpuTimer.create(static_cast<uint32_t>(m_swapchain.m_framebuffers.size()),
+                      true);
+    if (m_cullingMode == CullingMode::Gpu) {
+        // The old pyramid is idle, its sets are replaced
+        m_descriptorAllocator.resetSwapchain();
+        m_hiZPyramid.create(true);
+        m_gpuCulling.updateHiZPyramid(m_hiZPyramid.m_descriptor);
+    }
     recordCommandBuffers();
 }
 
@@ -279,6 +413,8 @@ void Renderer::recordCommandBuffers() {
     VK_CHECK(vkAllocateCommandBuffers(m_device.m_handle, &allocInfo,
                                       m_commandBuffers.data()));
 
+    sortDraws();
+
     for (uint32_t i = 0; i < static_cast<uint32_t>(m_commandBuffers.size());
          ++i) {
         VkCommandBufferBeginInfo beginInfo = {};
@@ -288,91 +424,268 @@ void Renderer::recordCommandBuffers() {
 
         // Begin recording a command buffer
         VK_CHECK(vkBeginCommandBuffer(m_commandBuffers[i], &beginInfo));
+        m_gpuTimer.begin(m_commandBuffers[i], i);
+        m_clusterCulling.recordCommands(m_commandBuffers[i]);
+
+        // The culling fills the draw commands & the visible instances of
+        // each phase right before the phase is drawn
+        for (uint32_t phase = 0; phase < m_gpuCulling.getPhaseCount();
+             phase++) {
+            VkRenderPass renderPass = m_renderPass.m_handle;
+            if (m_gpuCulling.getPhaseCount() > 1) {
+                renderPass = phase == 0 ? m_renderPass.m_firstPhaseHandle
+                                        : m_renderPass.m_secondPhaseHandle;
+            }
 
-        VkRenderPassBeginInfo renderPassInfo = {};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = m_renderPass.m_handle;
-        renderPassInfo.framebuffer = m_swapchain.m_framebuffers[i];
-        renderPassInfo.renderArea.offset = {0, 0};
-        renderPassInfo.renderArea.extent = m_swapchain.m_extent;
-
-        std::array<VkClearValue, 2> clearValues = {};
-        clearValues[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
-        clearValues[1].depthStencil = {1.0f, 0};
-        renderPassInfo.clearValueCount =
-            static_cast<uint32_t>(clearValues.size());
-        renderPassInfo.pClearValues = clearValues.data();
-
-        VkDeviceSize offsets[] = {0};
-
-        vkCmdBeginRenderPass(m_commandBuffers[i], &renderPassInfo,
-                             VK_SUBPASS_CONTENTS_INLINE);
-
-        vkCmdBindPipeline(m_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                          m_graphicsPipeline.m_handle);
-        // Common set
-        vkCmdBindDescriptorSets(m_commandBuffers[i],
-                                VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                m_graphicsPipeline.m_layout, 0, 1,
-                                &m_commonDescriptorSet, 0, nullptr);
-
-        for (auto model : m_models) {
-            vkCmdBindVertexBuffers(m_commandBuffers[i], 0, 1,
-                                   &model.m_mesh.m_vertexBuffer, offsets);
-            vkCmdBindIndexBuffer(m_commandBuffers[i],
-                                 model.m_mesh.m_indexBuffer, 0,
-                                 VK_INDEX_TYPE_UINT32);
-            vkCmdBindDescriptorSets(m_commandBuffers[i],
-                                    VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                    m_graphicsPipeline.m_layout, 1, 1,
-                                    &model.m_descriptorSet, 0, nullptr);
-            vkCmdDrawIndexed(m_commandBuffers[i], model.m_mesh.m_indices.size(),
-                             1, 0, 0, 0);
-        }
-
-        vkCmdEndRenderPass(m_commandBuffers[i]);
+            if (phase > 0) {
+                // Occluders are what the first phase drew
+                m_hiZPyramid.recordCommands(m_commandBuffers[i]);
+            }
+            m_gpuCulling.recordCommands(m_commandBuffers[i], phase);
+            recordRenderPass(m_commandBuffers[i],
+                             m_swapchain.m_framebuffers[i], renderPass, phase);
+        }
 
+        m_gpuTimer.end(m_commandBuffers[i], i);
         VK_CHECK(vkEndCommandBuffer(m_commandBuffers[i]));
     }
 }
 
+void Renderer::sortDraws() {
+    // Batches are unique by mesh & textures, so no two keys of a pipeline
+    // are equal. With a depth pre-pass every batch is drawn twice, first
+    // with the depth pipeline. The levels of detail of a batch are separate
+    // draws, which only the cpu & gpu culling fill. Impostors have their own
+    // pipeline & material, they are not in the depth pre-pass since the
+    // depth of a quad depends on its alpha.
+    const bool lods = m_cullingMode == CullingMode::Cpu ||
+                      m_cullingMode == CullingMode::Gpu;
+    m_drawKeys.clear();
+    for (uint32_t i = 0; i < static_cast<uint32_t>(m_instanceBatches.size());
+         i++) {
+        const InstanceBatch &batch = m_instanceBatches[i];
+        const uint32_t drawCount = lods ? batch.m_lodCount : 1;
+        for (uint32_t j = batch.m_firstDraw;
+             j < batch.m_firstDraw + drawCount; j++) {
+            if (isImpostorDraw(batch, j)) {
+                m_drawKeys.emplace_back();
+                m_drawKeys.back().m_key = DrawKey::make(
+                    s_impostorPipeline, m_impostors.m_quad.indexType,
+                    batch.m_impostorMaterialIndex, batch.m_meshIndex);
+                m_drawKeys.back().m_index = j;
+                continue;
+            }
+            const VkIndexType indexType =
+                m_meshes[batch.m_meshIndex].m_geometry.indexType;
+            if (m_depthPrepass) {
+                m_drawKeys.emplace_back();
+                m_drawKeys.back().m_key =
+                    DrawKey::make(s_depthPrepassPipeline, indexType,
+                                  batch.m_materialIndex, batch.m_meshIndex);
+                m_drawKeys.back().m_index = j;
+            }
+            m_drawKeys.emplace_back();
+            m_drawKeys.back().m_key =
+                DrawKey::make(s_mainPipeline, indexType, batch.m_materialIndex,
+                              batch.m_meshIndex);
+            m_drawKeys.back().m_index = j;
+        }
+    }
+    radixSort(m_drawKeys, m_drawKeyScratch);
+    LOG("%zu draws sorted by state", m_drawKeys.size());
+}
+
+bool Renderer::isImpostorDraw(const InstanceBatch &batch,
+                              uint32_t drawIndex) const {
+    return batch.m_impostorMaterialIndex != ~0u &&
+           drawIndex + 1 == batch.m_firstDraw + batch.m_lodCount;
+}
+
+void Renderer::recordRenderPass(VkCommandBuffer commandBuffer,
+                                VkFramebuffer framebuffer,
+                                VkRenderPass renderPass, uint32_t phase) {
+    VkRenderPassBeginInfo renderPassInfo = {};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = renderPass;
+    renderPassInfo.framebuffer = framebuffer;
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = m_swapchain.m_extent;
+
+    std::array<VkClearValue, 2> clearValues = {};
+    clearValues[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
+    clearValues[1].depthStencil = {1.0f, 0};
+    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+    renderPassInfo.pClearValues = clearValues.data();
+
+    VkDeviceSize offsets[] = {0};
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                         VK_SUBPASS_CONTENTS_INLINE);
+
+    // All meshes live in the geometry pool, so bind it only once. The index
+    // buffer is bound again when the index type changes, see GeometryPool.
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_geometryPool.m_vertexBuffer,
+                           offsets);
+    VkIndexType indexType = VK_INDEX_TYPE_MAX_ENUM;
+
+    // Every graphics pipeline is made with the same set layouts & push
+    // constant ranges, so the sets stay bound across pipeline changes
+    const std::array<VkDescriptorSet, 2> descriptorSets = {
+        m_commonDescriptorSet, m_textureDescriptorSet};
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            m_graphicsPipeline.m_layout, 0,
+                            static_cast<uint32_t>(descriptorSets.size()),
+                            descriptorSets.data(), 0, nullptr);
+
+    // One indirect instanced draw per unique mesh & texture combination, in
+    // draw key order. The pipeline & the index type are only bound when the
+    // key says they change.
+    // The instance counts come from the culling pass. The vertex shader maps
+    // gl_InstanceIndex, offset by the first instance of the batch in the
+    // push constants, to a model matrix through the visible instance list.
+    // The fragment shader finds the textures through the material index.
+    // The depth pre-pass sorts first, so the main pipeline only shades what
+    // is left in the depth buffer.
+    uint32_t pipeline = ~0u;
+    const GraphicsPipeline *graphicsPipeline = &m_graphicsPipeline;
+    for (const auto &drawKey : m_drawKeys) {
+        if (DrawKey::getPipeline(drawKey.m_key) != pipeline) {
+            pipeline = DrawKey::getPipeline(drawKey.m_key);
+            graphicsPipeline = &m_graphicsPipeline;
+            if (pipeline == s_depthPrepassPipeline) {
+                graphicsPipeline = &m_depthPipeline;
+            } else if (pipeline == s_impostorPipeline) {
+                graphicsPipeline = &m_impostors.m_pipeline;
+            }
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                              graphicsPipeline->m_handle);
+        }
+        if (DrawKey::getIndexType(drawKey.m_key) != indexType) {
+            indexType = DrawKey::getIndexType(drawKey.m_key);
+            vkCmdBindIndexBuffer(commandBuffer, m_geometryPool.m_indexBuffer, 0,
+                                 indexType);
+        }
+
+        const uint32_t drawIndex = drawKey.m_index;
+        const uint32_t batchIndex = m_drawBatches[drawIndex];
+        const InstanceBatch &batch = m_instanceBatches[batchIndex];
+        DrawConstants drawConstants;
+        drawConstants.materialIndex = batch.m_materialIndex;
+        const Mesh &mesh = m_meshes[batch.m_meshIndex];
+        const bool impostor = isImpostorDraw(batch, drawIndex);
+
+        drawConstants.positionOffset =
+            glm::vec4(mesh.m_quantization.offset, 0.0f);
+        drawConstants.positionScale =
+            glm::vec4(mesh.m_quantization.scale, 0.0f);
+        if (impostor) {
+            drawConstants.materialIndex = batch.m_impostorMaterialIndex;
+            drawConstants.boundingSphere = mesh.m_boundingSphere;
+        }
+        if (m_cullingMode == CullingMode::Cluster) {
+            // One command per cluster slot, each with its own first instance
+            drawConstants.firstInstance = 0;
+            vkCmdPushConstants(commandBuffer, graphicsPipeline->m_layout,
+                               VK_SHADER_STAGE_VERTEX_BIT |
+                                   VK_SHADER_STAGE_FRAGMENT_BIT,
+                               0, sizeof(drawConstants), &drawConstants);
+            m_clusterCulling.recordDraws(commandBuffer, batchIndex);
+            continue;
+        }
+
+        drawConstants.firstInstance = m_gpuCulling.getFirstInstance(
+            phase, drawIndex - batch.m_firstDraw, batch.m_firstInstance);
+        vkCmdPushConstants(commandBuffer, graphicsPipeline->m_layout,
+                           VK_SHADER_STAGE_VERTEX_BIT |
+                               VK_SHADER_STAGE_FRAGMENT_BIT,
+                           0, sizeof(drawConstants), &drawConstants);
+        vkCmdDrawIndexedIndirect(commandBuffer,
+                                 m_gpuCulling.m_drawCommandBuffer.buffer,
+                                 (phase * m_gpuCulling.m_drawCount +
+                                  drawIndex) *
+                                     sizeof(VkDrawIndexedIndirectCommand),
+                                 1, sizeof(VkDrawIndexedIndirectCommand));
+    }
+
+    vkCmdEndRenderPass(commandBuffer);
+}
+
 void Renderer::setupDescriptors() {
     LOG("=Setup descriptors=");
     m_descriptorSetLayouts.clear();
     m_descriptorSetLayouts.resize(2);
 
-    // Texture sampler bindings
+    // Per draw constants
+    m_pushConstantRanges.clear();
+    m_pushConstantRanges.emplace_back();
+    m_pushConstantRanges.back().stageFlags =
+        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    m_pushConstantRanges.back().offset = 0;
+    m_pushConstantRanges.back().size = sizeof(DrawConstants);
+
+    // Common bindings
+    // Texture sampler
     // layout (set = 0, binding = 0)
-    std::array<VkDescriptorSetLayoutBinding, 1> commonBindings;
+    // Model matrices of all instances
+    // layout (set = 0, binding = 1)
+    // Camera view projection
+    // layout (set = 0, binding = 2)
+    // Visible instances, i.e. indices to the model matrices
+    // layout (set = 0, binding = 3)
+    // Material textures, i.e. indices to the texture table
+    // layout (set = 0, binding = 4)
+    std::array<VkDescriptorSetLayoutBinding, 5> commonBindings;
     commonBindings[0].binding = 0;
     commonBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
     commonBindings[0].descriptorCount = 1;
     commonBindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
     commonBindings[0].pImmutableSamplers = &m_textureSampler;
 
-    // Object bindings
-    // First one for model matrix
+    commonBindings[1].binding = 1;
+    commonBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    commonBindings[1].descriptorCount = 1;
+    commonBindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    commonBindings[1].pImmutableSamplers = nullptr;
+
+    commonBindings[2].binding = 2;
+    commonBindings[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    commonBindings[2].descriptorCount = 1;
+    commonBindings[2].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    commonBindings[2].pImmutableSamplers = nullptr;
+
+    commonBindings[3].binding = 3;
+    commonBindings[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    commonBindings[3].descriptorCount = 1;
+    commonBindings[3].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    commonBindings[3].pImmutableSamplers = nullptr;
+
+    commonBindings[4].binding = 4;
+    commonBindings[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    commonBindings[4].descriptorCount = 1;
+    commonBindings[4].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    commonBindings[4].pImmutableSamplers = nullptr;
+
+    // Texture table, every texture at its texture index
     // layout (set = 1, binding = 0)
-    std::vector<VkDescriptorSetLayoutBinding> objectBindings;
-    objectBindings.emplace_back();
-    objectBindings.back().binding = 0;
-    objectBindings.back().descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    // If an array, 'descriptorCount', should equal that
-    objectBindings.back().descriptorCount = 1;
-    objectBindings.back().stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    objectBindings.back().pImmutableSamplers = nullptr;
-
-    // Second one for textures
-    // layout (set = 1, binding = 1..N)
-    // This is hacky, it assumes all models have the same textures size
-    for (uint32_t i = 0; i < m_models[0].m_textures.size(); i++) {
-        objectBindings.emplace_back();
-        objectBindings.back().binding = i + 1;
-        objectBindings.back().descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-        objectBindings.back().descriptorCount = 1;
-        objectBindings.back().stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-        objectBindings.back().pImmutableSamplers = nullptr;
-    }
+    // Only the registered textures are valid, and more can be registered
+    // while the set is bound by command buffers.
+    VkDescriptorSetLayoutBinding textureBinding = {};
+    textureBinding.binding = 0;
+    textureBinding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    textureBinding.descriptorCount = s_maxTextureCount;
+    textureBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    textureBinding.pImmutableSamplers = nullptr;
+
+    const VkDescriptorBindingFlagsEXT textureBindingFlags =
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+        VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT;
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT textureBindingFlagsCi = {};
+    textureBindingFlagsCi.sType =
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+    textureBindingFlagsCi.bindingCount = 1;
+    textureBindingFlagsCi.pBindingFlags = &textureBindingFlags;
+    const VkDescriptorSetLayoutCreateFlags textureLayoutFlags =
+        VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
 
     const VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCis[] = {
         {
@@ -384,106 +697,549 @@ void Renderer::setupDescriptors() {
         },
         {
             VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, // sType
-            nullptr,                                             // pNext
-            0,                                                   // flags
-            static_cast<uint32_t>(objectBindings.size()),        // bindingCount
-            objectBindings.data()                                // pBindings
+            &textureBindingFlagsCi,                              // pNext
+            textureLayoutFlags,                                  // flags
+            1,                                                   // bindingCount
+            &textureBinding                                      // pBindings
         },
     };
 
-    VK_CHECK(vkCreateDescriptorSetLayout(
-        m_device.m_handle, &descriptorSetLayoutCis[0], m_allocator,
-        &m_descriptorSetLayouts[0]));
-
-    VK_CHECK(vkCreateDescriptorSetLayout(
-        m_device.m_handle, &descriptorSetLayoutCis[1], m_allocator,
-        &m_descriptorSetLayouts[1]));
-
-    std::array<VkDescriptorPoolSize, 3> descriptorPoolSizes;
-    descriptorPoolSizes[0].type = VK_DESCRIPTOR_TYPE_SAMPLER;
-    descriptorPoolSizes[0].descriptorCount = 1;
-    descriptorPoolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorPoolSizes[1].descriptorCount =
-        static_cast<uint32_t>(m_models.size());
-    descriptorPoolSizes[2].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-    descriptorPoolSizes[2].descriptorCount =
-        static_cast<uint32_t>(m_models.size() * m_models[0].m_textures.size());
-
-    VkDescriptorPoolCreateInfo descriptorPoolCI = {};
-    descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    descriptorPoolCI.poolSizeCount =
-        static_cast<uint32_t>(descriptorPoolSizes.size());
-    descriptorPoolCI.pPoolSizes = descriptorPoolSizes.data();
-    // 1 for the sampler + 1 per each object
-    descriptorPoolCI.maxSets = 1 + static_cast<uint32_t>(m_models.size());
-
-    VK_CHECK(vkCreateDescriptorPool(m_device.m_handle, &descriptorPoolCI,
-                                    m_allocator, &m_descriptorPool));
-
-    // Common set
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = m_descriptorPool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &m_descriptorSetLayouts[0];
-
-    VK_CHECK(vkAllocateDescriptorSets(m_device.m_handle, &allocInfo,
-                                      &m_commonDescriptorSet));
-
-    // Per object sets
-    for (auto &model : m_models) {
-        allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        allocInfo.descriptorPool = m_descriptorPool;
-        allocInfo.descriptorSetCount = 1;
-        allocInfo.pSetLayouts = &m_descriptorSetLayouts[1];
-
-        VK_CHECK(vkAllocateDescriptorSets(m_device.m_handle, &allocInfo,
-                                          &model.m_descriptorSet));
-
-        model.m_uniformBuffer.descriptor.buffer = model.m_uniformBuffer.buffer;
-        model.m_uniformBuffer.descriptor.offset = 0;
-        model.m_uniformBuffer.descriptor.range = sizeof(model.m_modelMatrix);
-
-        std::vector<VkWriteDescriptorSet> descriptorWrites;
-        descriptorWrites.emplace_back();
-        descriptorWrites.back().sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites.back().dstSet = model.m_descriptorSet;
-        descriptorWrites.back().dstBinding = 0;
-        descriptorWrites.back().dstArrayElement = 0;
-        descriptorWrites.back().descriptorType =
-            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrites.back().descriptorCount = 1;
-        descriptorWrites.back().pBufferInfo = &model.m_uniformBuffer.descriptor;
-
-        uint32_t dstBinding = 1;
-        for (auto &texture : model.m_textures) {
-            descriptorWrites.emplace_back();
-            descriptorWrites.back().sType =
-                VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites.back().dstSet = model.m_descriptorSet;
-            descriptorWrites.back().dstBinding = dstBinding++;
-            descriptorWrites.back().dstArrayElement = 0;
-            descriptorWrites.back().descriptorType =
-                VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-            descriptorWrites.back().descriptorCount = 1;
-            descriptorWrites.back().pImageInfo = &texture.m_descriptor;
-        }
-
-        vkUpdateDescriptorSets(m_device.m_handle,
-                               static_cast<uint32_t>(descriptorWrites.size()),
-                               descriptorWrites.data(), 0, nullptr);
+    // Sets are allocated from the growable pools of the descriptor allocator,
+    // so more can be allocated later without rebuilding these
+    m_descriptorSetLayouts[0] =
+        m_descriptorAllocator.getLayout(descriptorSetLayoutCis[0]);
+    m_descriptorSetLayouts[1] =
+        m_descriptorAllocator.getLayout(descriptorSetLayoutCis[1]);
+
+    m_commonDescriptorSet =
+        m_descriptorAllocator.allocate(m_descriptorSetLayouts[0]);
+
+    CommonDescriptors commonDescriptors;
+    commonDescriptors.instances = m_instanceBuffer.descriptor;
+    commonDescriptors.camera = m_cameraBuffer.descriptor;
+    commonDescriptors.visibleInstances =
+        m_cullingMode == CullingMode::Cluster
+            ? m_clusterCulling.m_visibleInstanceBuffer.descriptor
+            : m_gpuCulling.m_visibleInstanceBuffer.descriptor;
+    commonDescriptors.materials = m_materialBuffer.descriptor;
+
+    const std::vector<VkDescriptorUpdateTemplateEntry> commonEntries = {
+        {1, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+         offsetof(CommonDescriptors, instances), 0},
+        {2, 0, 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+         offsetof(CommonDescriptors, camera), 0},
+        {3, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+         offsetof(CommonDescriptors, visibleInstances), 0},
+        {4, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+         offsetof(CommonDescriptors, materials), 0},
+    };
+    vkUpdateDescriptorSetWithTemplate(
+        m_device.m_handle, m_commonDescriptorSet,
+        m_descriptorAllocator.getUpdateTemplate(m_descriptorSetLayouts[0],
+                                                commonEntries),
+        &commonDescriptors);
+
+    // Texture table
+    m_textureDescriptorSet =
+        m_descriptorAllocator.allocate(m_descriptorSetLayouts[1]);
+
+    for (uint32_t i = 0; i < static_cast<uint32_t>(m_textures.size()); i++) {
+        registerTexture(i, m_textures[i].m_descriptor);
+    }
+    // The impostor atlases follow the textures, one per batch
+    for (uint32_t i = 0;
+         i < static_cast<uint32_t>(m_impostors.m_atlases.size()); i++) {
+        registerTexture(static_cast<uint32_t>(m_textures.size()) + i,
+                        m_impostors.m_atlases[i].descriptor);
+    }
+}
+
+void Renderer::registerTexture(uint32_t textureIndex,
+                               const VkDescriptorImageInfo &descriptor) {
+    THROW_IF(textureIndex >= s_maxTextureCount,
+             "Texture table is full, it has room for %u textures",
+             s_maxTextureCount);
+
+    VkWriteDescriptorSet descriptorWrite = {};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = m_textureDescriptorSet;
+    descriptorWrite.dstBinding = 0;
+    descriptorWrite.dstArrayElement = textureIndex;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pImageInfo = &descriptor;
+
+    vkUpdateDescriptorSets(m_device.m_handle, 1, &descriptorWrite, 0, nullptr);
+}
+
+void Renderer::createGraphicsPipelines(bool recycle) {
+    if (m_depthPrepass) {
+        m_depthPipeline.create(m_programInput.at("depth_prepass").at("shaders"),
+                               GraphicsPipeline::DepthMode::DepthOnly,
+                               recycle);
+        m_graphicsPipeline.create(m_programInput.at("shaders"),
+                                  GraphicsPipeline::DepthMode::DepthEqual,
+                                  recycle);
+    } else {
+        m_graphicsPipeline.create(m_programInput.at("shaders"),
+                                  GraphicsPipeline::DepthMode::Default,
+                                  recycle);
+    }
+    if (m_impostors.m_enabled) {
+        m_impostors.createPipeline(recycle);
     }
 }
 
+void Renderer::createGeometryPool() {
+    // Capacities are in vertices and indices
+    uint32_t vertexCapacity = 1 << 20;
+    uint32_t indexCapacity = 1 << 22;
+    if (m_programInput.contains("geometry_pool")) {
+        const auto &pool = m_programInput.at("geometry_pool");
+        vertexCapacity = pool.value("vertices", vertexCapacity);
+        indexCapacity = pool.value("indices", indexCapacity);
+    }
+
+    // Every mesh is stored in the same vertex format
+    const nlohmann::json mesh =
+        m_programInput.value("mesh", nlohmann::json::object());
+    const std::string format = mesh.value("vertex_format", "compact");
+    if (format == "float") {
+        m_meshSettings.vertexFormat = VertexFormat::Float;
+    } else if (format == "compact") {
+        m_meshSettings.vertexFormat = VertexFormat::Compact;
+    } else {
+        THROW_IF(true, "Invalid vertex format %s, use float or compact",
+                 format.c_str());
+    }
+
+    m_geometryPool.create(vertexCapacity, indexCapacity,
+                          getVertexStride(m_meshSettings.vertexFormat));
+}
+
 void Renderer::createModels() {
+    const nlohmann::json lod =
+        m_programInput.value("lod", nlohmann::json::object());
+    m_meshSettings.lodCount = lod.value("levels", 1u);
+    m_lodThreshold = lod.value("error_pixels", 1.0f);
+    const nlohmann::json mesh =
+        m_programInput.value("mesh", nlohmann::json::object());
+    m_meshSettings.overdrawThreshold =
+        mesh.value("overdraw_threshold", s_overdrawThreshold);
+    m_meshSettings.cache = mesh.value("cache", true);
+    const std::string retention = mesh.value("retention", "discard");
+    if (retention == "discard") {
+        m_meshSettings.retention = MeshRetention::Discard;
+    } else if (retention == "positions") {
+        m_meshSettings.retention = MeshRetention::Positions;
+    } else if (retention == "all") {
+        m_meshSettings.retention = MeshRetention::All;
+    } else {
+        THROW_IF(true,
+                 "Invalid mesh retention %s, use discard, positions or all",
+                 retention.c_str());
+    }
+
     std::string modelsPath(
         m_programInput.at("data_path").get<std::string>() +
         m_programInput.at("models").at("path").get<std::string>());
     for (const auto &it : m_programInput.at("models").at("objs")) {
         m_models.push_back(Model(*this));
-        m_models.back().create(modelsPath.c_str(), it);
+        Model &model = m_models.back();
+        model.create(modelsPath.c_str(), it);
+
+        // Models that refer to the same files share the mesh and textures
+        model.m_meshIndex = loadMesh(model.m_meshPath);
+        for (const auto &texturePath : model.m_texturePaths) {
+            model.m_textureIndices.push_back(loadTexture(texturePath));
+        }
+    }
+
+    createMeshes();
+    createInstanceBatches();
+}
+
+void Renderer::createMeshes() {
+    LOG("=Create meshes=");
+    std::vector<const char *> paths(m_meshes.size());
+    for (const auto &it : m_meshIndices) {
+        paths[it.second] = it.first.c_str();
+    }
+
+    // Software occlusion rasterizes the positions of the occluders, the
+    // retention decides what the load decodes
+    std::vector<MeshRetention> retentions(m_meshes.size(),
+                                          m_meshSettings.retention);
+    for (const auto &model : m_models) {
+        if (model.m_occluder &&
+            retentions[model.m_meshIndex] == MeshRetention::Discard) {
+            retentions[model.m_meshIndex] = MeshRetention::Positions;
+        }
     }
+
+    // Each thread loads the next mesh nobody has taken yet. Decoding a
+    // cache is bound by one core, so meshes load in parallel. The cores are
+    // split between the meshes, each parses its OBJ file on its share of
+    // them. Errors are rethrown here, the first one in mesh order.
+    const size_t coreCount = std::max(1u, std::thread::hardware_concurrency());
+    const size_t threadCount = std::min(coreCount, m_meshes.size());
+    const uint32_t parseThreadCount = static_cast<uint32_t>(
+        std::max<size_t>(1, coreCount / std::max<size_t>(1, threadCount)));
+
+    std::atomic<size_t> next(0);
+    std::vector<std::exception_ptr> errors(m_meshes.size());
+    auto loadMeshes = [&]() {
+        for (size_t i = next++; i < m_meshes.size(); i = next++) {
+            MeshSettings settings = m_meshSettings;
+            settings.retention = retentions[i];
+            settings.parseThreadCount = parseThreadCount;
+            try {
+                m_meshes[i].load(paths[i], m_geometryPool, settings);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < threadCount; i++) {
+        workers.emplace_back(loadMeshes);
+    }
+    loadMeshes();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    for (const auto &error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // Staging & copies go through the one queue
+    size_t memorySize = 0;
+    for (auto &mesh : m_meshes) {
+        mesh.upload(m_geometryPool);
+        memorySize += mesh.getMemorySize();
+    }
+    LOG("%zu meshes keep %zu bytes in system memory", m_meshes.size(),
+        memorySize);
+}
+
+void Renderer::createInstanceBatches() {
+    LOG("=Create instance batches=");
+    // Group the instances of all models by mesh & textures
+    std::map<std::pair<uint32_t, std::vector<uint32_t>>, uint32_t> batchIndices;
+    std::vector<uint32_t> modelBatches(m_models.size());
+    for (size_t i = 0; i < m_models.size(); i++) {
+        const Model &model = m_models[i];
+        const auto key =
+            std::make_pair(model.m_meshIndex, model.m_textureIndices);
+        auto it = batchIndices.find(key);
+        if (it == batchIndices.end()) {
+            it = batchIndices
+                     .emplace(key,
+                              static_cast<uint32_t>(m_instanceBatches.size()))
+                     .first;
+            m_instanceBatches.emplace_back();
+            m_instanceBatches.back().m_meshIndex = model.m_meshIndex;
+            m_instanceBatches.back().m_textureIndices = model.m_textureIndices;
+        }
+        modelBatches[i] = it->second;
+        m_instanceBatches[it->second].m_instanceCount +=
+            static_cast<uint32_t>(model.m_modelMatrices.size());
+    }
+
+    THROW_IF(m_instanceBatches.empty(), "The scene contains no models");
+
+    m_impostors.create(
+        m_programInput.value("impostors", nlohmann::json::object()),
+        m_geometryPool, static_cast<uint32_t>(m_instanceBatches.size()));
+
+    // Lay out the instances of each batch contiguously, and the draws of
+    // its levels of detail and impostor
+    uint32_t firstInstance = 0;
+    for (uint32_t i = 0; i < static_cast<uint32_t>(m_instanceBatches.size());
+         i++) {
+        InstanceBatch &batch = m_instanceBatches[i];
+        batch.m_firstInstance = firstInstance;
+        firstInstance += batch.m_instanceCount;
+        batch.m_instanceCount = 0;
+
+        batch.m_firstDraw = static_cast<uint32_t>(m_drawBatches.size());
+        batch.m_lodCount =
+            static_cast<uint32_t>(m_meshes[batch.m_meshIndex].m_lods.size()) +
+            (m_impostors.m_enabled ? 1 : 0);
+        m_drawBatches.insert(m_drawBatches.end(), batch.m_lodCount, i);
+    }
+
+    m_instanceTransforms.resize(firstInstance);
+    for (size_t i = 0; i < m_models.size(); i++) {
+        InstanceBatch &batch = m_instanceBatches[modelBatches[i]];
+        for (const auto &modelMatrix : m_models[i].m_modelMatrices) {
+            m_instanceTransforms[batch.m_firstInstance +
+                                 batch.m_instanceCount++] = modelMatrix;
+        }
+    }
+
+    LOG("%zu instances of %zu models in %zu batches",
+        m_instanceTransforms.size(), m_models.size(),
+        m_instanceBatches.size());
+
+    VkDeviceSize bufferSize =
+        sizeof(m_instanceTransforms[0]) * m_instanceTransforms.size();
+    createStagedBuffer(bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                       m_instanceBuffer);
+    copyCPUToGPU(reinterpret_cast<const void *>(m_instanceTransforms.data()),
+                 bufferSize, m_instanceBuffer.stagingMemory,
+                 m_instanceBuffer.stagingBuffer, m_instanceBuffer.buffer);
+
+    createStagedBuffer(sizeof(CameraData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                       m_cameraBuffer);
+
+    // Batches that only differ by mesh share a material. Models may have
+    // any number of textures, but the shaders expect at least one. The
+    // impostor atlas of each batch is a material of its own.
+    std::map<std::vector<uint32_t>, uint32_t> materials;
+    for (uint32_t i = 0; i < static_cast<uint32_t>(m_instanceBatches.size());
+         i++) {
+        InstanceBatch &batch = m_instanceBatches[i];
+        THROW_IF(batch.m_textureIndices.empty(),
+                 "Models must have at least one texture");
+        auto it = materials.find(batch.m_textureIndices);
+        if (it == materials.end()) {
+            it = materials
+                     .emplace(batch.m_textureIndices,
+                              static_cast<uint32_t>(m_materialTextures.size()))
+                     .first;
+            m_materialTextures.insert(m_materialTextures.end(),
+                                      batch.m_textureIndices.begin(),
+                                      batch.m_textureIndices.end());
+        }
+        batch.m_materialIndex = it->second;
+
+        if (m_impostors.m_enabled) {
+            batch.m_impostorMaterialIndex =
+                static_cast<uint32_t>(m_materialTextures.size());
+            m_materialTextures.push_back(
+                static_cast<uint32_t>(m_textures.size()) + i);
+        }
+    }
+
+    bufferSize = sizeof(m_materialTextures[0]) * m_materialTextures.size();
+    createStagedBuffer(bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                       m_materialBuffer);
+    copyCPUToGPU(reinterpret_cast<const void *>(m_materialTextures.data()),
+                 bufferSize, m_materialBuffer.stagingMemory,
+                 m_materialBuffer.stagingBuffer, m_materialBuffer.buffer);
+}
+
+void Renderer::createCulling() {
+    const std::string mode = m_programInput.value("culling", "gpu");
+    if (mode == "none") {
+        m_cullingMode = CullingMode::None;
+    } else if (mode == "cpu") {
+        m_cullingMode = CullingMode::Cpu;
+    } else if (mode == "gpu") {
+        m_cullingMode = CullingMode::Gpu;
+    } else if (mode == "cluster") {
+        m_cullingMode = CullingMode::Cluster;
+        THROW_IF(m_device.m_multiDrawIndirect == false,
+                 "Cluster culling requires multiDrawIndirect and "
+                 "drawIndirectFirstInstance");
+    } else {
+        THROW_IF(true, "Invalid culling mode %s, use none, cpu, gpu or cluster",
+                 mode.c_str());
+    }
+
+    // Instances are static, so their world space bounds are computed once
+    std::vector<GpuCulling::Object> objects(m_instanceTransforms.size());
+    std::vector<glm::vec3> boxCenters(objects.size());
+    std::vector<glm::vec3> boxExtents(objects.size());
+    std::vector<VkDrawIndexedIndirectCommand> draws(m_drawBatches.size());
+    std::vector<float> lodErrors(draws.size());
+    for (const auto &batch : m_instanceBatches) {
+        const Mesh &mesh = m_meshes[batch.m_meshIndex];
+        for (uint32_t i = 0; i < batch.m_lodCount; i++) {
+            VkDrawIndexedIndirectCommand &draw = draws[batch.m_firstDraw + i];
+            // Everything is at full detail until culled
+            draw.instanceCount = i == 0 ? batch.m_instanceCount : 0;
+            // Offset with a push constant, see DrawConstants
+            draw.firstInstance = 0;
+            if (isImpostorDraw(batch, batch.m_firstDraw + i)) {
+                // Used once an atlas texel is no larger than the error
+                // allowed, and never before the coarsest mesh level
+                draw.indexCount = m_impostors.m_quad.indexCount;
+                draw.firstIndex = m_impostors.m_quad.firstIndex;
+                draw.vertexOffset = m_impostors.m_quad.vertexOffset;
+                lodErrors[batch.m_firstDraw + i] = std::max(
+                    mesh.m_lods.back().m_error,
+                    Impostors::getTexelSize(mesh.m_boundingSphere));
+                continue;
+            }
+            draw.indexCount = mesh.m_lods[i].m_indexCount;
+            draw.firstIndex = mesh.m_lods[i].m_firstIndex;
+            draw.vertexOffset = mesh.m_geometry.vertexOffset;
+            lodErrors[batch.m_firstDraw + i] = mesh.m_lods[i].m_error;
+        }
+
+        for (uint32_t j = batch.m_firstInstance;
+             j < batch.m_firstInstance + batch.m_instanceCount; j++) {
+            objects[j].boundingSphere = transformBoundingSphere(
+                mesh.m_boundingSphere, m_instanceTransforms[j]);
+            objects[j].firstDraw = batch.m_firstDraw;
+            objects[j].lodCount = batch.m_lodCount;
+            objects[j].transformIndex = j;
+            objects[j].firstInstance = batch.m_firstInstance;
+            // The sphere radius scales by the largest axis scale
+            objects[j].lodScale =
+                mesh.m_boundingSphere.w > 0.0f
+                    ? objects[j].boundingSphere.w / mesh.m_boundingSphere.w
+                    : 1.0f;
+
+            transformBoundingBox(mesh.m_boundingBoxMin, mesh.m_boundingBoxMax,
+                                 m_instanceTransforms[j], boxCenters[j],
+                                 boxExtents[j]);
+        }
+    }
+
+    // The GPU tests against the depth of the previous frame, the CPU
+    // against the occluders rasterized in software
+    const bool occlusion = m_programInput.value("occlusion_culling", false);
+    if (occlusion && (m_cullingMode == CullingMode::None ||
+                      m_cullingMode == CullingMode::Cluster)) {
+        LOG("Occlusion culling requires cpu or gpu culling, ignoring it");
+    }
+
+    if (m_impostors.m_enabled && (m_cullingMode == CullingMode::None ||
+                                  m_cullingMode == CullingMode::Cluster)) {
+        LOG("Impostors require cpu or gpu culling, only the full meshes are "
+            "drawn");
+    }
+
+    // The culling shader binds the pyramid even without occlusion culling
+    if (m_cullingMode == CullingMode::Gpu) {
+        m_hiZPyramid.create();
+    }
+
+    m_gpuCulling.create(m_cullingMode == CullingMode::Gpu, occlusion, objects,
+                        draws, lodErrors, m_cameraBuffer.descriptor,
+                        m_hiZPyramid.m_descriptor);
+    if (m_cullingMode == CullingMode::Cluster) {
+        createClusterCulling();
+    }
+    if (m_cullingMode == CullingMode::Cpu) {
+        m_cpuCulling.create(objects, boxCenters, boxExtents, draws, lodErrors);
+
+        const nlohmann::json settings = m_programInput.value(
+            "software_occlusion", nlohmann::json::object());
+        m_softwareOcclusion.create(occlusion, settings.value("width", 256u),
+                                   settings.value("height", 128u),
+                                   settings.value("threads", 0u));
+        if (m_softwareOcclusion.m_enabled) {
+            for (const auto &model : m_models) {
+                if (model.m_occluder == false) {
+                    continue;
+                }
+
+                const Mesh &mesh = m_meshes[model.m_meshIndex];
+                std::vector<glm::vec3> positions;
+                mesh.getPositions(positions);
+                for (const auto &modelMatrix : model.m_modelMatrices) {
+                    m_softwareOcclusion.addOccluder(positions, mesh.m_indices,
+                                                    modelMatrix);
+                }
+            }
+            LOG("%zu occluder triangles, rasterized at %ux%u on %u threads",
+                m_softwareOcclusion.m_occluderIndices.size() / 3,
+                m_softwareOcclusion.m_width, m_softwareOcclusion.m_height,
+                m_softwareOcclusion.m_threadCount);
+        }
+    }
+}
+
+void Renderer::createClusterCulling() {
+    // The meshlets of all meshes one after the other
+    std::vector<ClusterCulling::Cluster> clusters;
+    std::vector<uint32_t> firstClusters(m_meshes.size());
+    for (size_t i = 0; i < m_meshes.size(); i++) {
+        const Mesh &mesh = m_meshes[i];
+        firstClusters[i] = static_cast<uint32_t>(clusters.size());
+        for (const auto &meshlet : mesh.m_meshlets) {
+            clusters.emplace_back();
+            clusters.back().boundingSphere = meshlet.m_boundingSphere;
+            clusters.back().cone = meshlet.m_cone;
+            clusters.back().firstIndex =
+                mesh.m_geometry.firstIndex + meshlet.m_firstIndex;
+            clusters.back().indexCount = meshlet.m_indexCount;
+            clusters.back().vertexOffset = mesh.m_geometry.vertexOffset;
+        }
+    }
+
+    std::vector<ClusterCulling::Batch> batches(m_instanceBatches.size());
+    uint32_t firstSlot = 0;
+    for (size_t i = 0; i < batches.size(); i++) {
+        const InstanceBatch &batch = m_instanceBatches[i];
+        const Mesh &mesh = m_meshes[batch.m_meshIndex];
+        batches[i].firstSlot = firstSlot;
+        batches[i].clusterCount =
+            static_cast<uint32_t>(mesh.m_meshlets.size());
+        batches[i].slotCount = batch.m_instanceCount * batches[i].clusterCount;
+        batches[i].firstCluster = firstClusters[batch.m_meshIndex];
+        batches[i].firstInstance = batch.m_firstInstance;
+        firstSlot += batches[i].slotCount;
+    }
+
+    m_clusterCulling.create(clusters, batches, m_cameraBuffer.descriptor,
+                            m_instanceBuffer.descriptor);
+}
+
+void Renderer::captureImpostors() {
+    if (m_impostors.m_enabled == false) {
+        return;
+    }
+
+    // Every batch from the full mesh, with its own textures
+    std::vector<Impostors::Capture> captures(m_instanceBatches.size());
+    for (size_t i = 0; i < captures.size(); i++) {
+        const InstanceBatch &batch = m_instanceBatches[i];
+        const Mesh &mesh = m_meshes[batch.m_meshIndex];
+        captures[i].boundingSphere = mesh.m_boundingSphere;
+        captures[i].firstIndex = mesh.m_lods[0].m_firstIndex;
+        captures[i].indexCount = mesh.m_lods[0].m_indexCount;
+        captures[i].vertexOffset = mesh.m_geometry.vertexOffset;
+        captures[i].indexType = mesh.m_geometry.indexType;
+        captures[i].materialIndex = batch.m_materialIndex;
+        captures[i].quantization = mesh.m_quantization;
+    }
+
+    m_impostors.capture(captures, m_geometryPool,
+                        {m_commonDescriptorSet, m_textureDescriptorSet});
+}
+
+uint32_t Renderer::loadMesh(const std::string &path) {
+    auto it = m_meshIndices.find(path);
+    if (it != m_meshIndices.end()) {
+        return it->second;
+    }
+
+    const uint32_t index = static_cast<uint32_t>(m_meshes.size());
+    m_meshes.push_back(Mesh(*this));
+    m_meshIndices[path] = index;
+
+    return index;
+}
+
+uint32_t Renderer::loadTexture(const std::string &path) {
+    auto it = m_textureIndices.find(path);
+    if (it != m_textureIndices.end()) {
+        return it->second;
+    }
+
+    const uint32_t index = static_cast<uint32_t>(m_textures.size());
+    m_textures.push_back(Texture(*this));
+    m_textures.back().create(path.c_str());
+    m_textureIndices[path] = index;
+
+    return index;
 }
 
 void Renderer::createTextureSampler() {
@@ -589,7 +1345,8 @@ void Renderer::errorCallback(int error, const char *description) {
 
 void Renderer::copyCPUToGPU(const void *srcData, VkDeviceSize sizeInBytes,
                             VkDeviceMemory stagingMemory,
-                            VkBuffer stagingBuffer, VkBuffer dstBuffer) const {
+                            VkBuffer stagingBuffer, VkBuffer dstBuffer,
+                            VkDeviceSize dstOffset) const {
     THROW_IF(srcData == nullptr, "Source data is nullptr");
     THROW_IF(sizeInBytes <= 0, "Size to copy is zero");
     THROW_IF(stagingMemory == VK_NULL_HANDLE, "Staging memory is null handle");
@@ -600,7 +1357,7 @@ void Renderer::copyCPUToGPU(const void *srcData, VkDeviceSize sizeInBytes,
     vkMapMemory(m_device.m_handle, stagingMemory, 0, sizeInBytes, 0, &data);
     memcpy(data, srcData, sizeInBytes);
     vkUnmapMemory(m_device.m_handle, stagingMemory);
-    copyBuffer(stagingBuffer, dstBuffer, sizeInBytes);
+    copyBuffer(stagingBuffer, dstBuffer, sizeInBytes, dstOffset);
 }
 
 void Renderer::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width,
@@ -622,11 +1379,11 @@ void Renderer::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width,
 }
 
 void Renderer::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer,
-                          VkDeviceSize size) const {
+                          VkDeviceSize size, VkDeviceSize dstOffset) const {
     VkCommandBuffer commandBuffer = beginSingleTimeCommands();
     VkBufferCopy copyRegion = {};
     copyRegion.srcOffset = 0; // Optional
-    copyRegion.dstOffset = 0; // Optional
+    copyRegion.dstOffset = dstOffset;
     copyRegion.size = size;
     vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
     endSingleTimeCommands(commandBuffer);
@@ -692,6 +1449,30 @@ void Renderer::createImage(uint32_t width, uint32_t height, uint32_t depth,
     VK_CHECK(vkBindImageMemory(m_device.m_handle, image, imageMemory, 0));
 }
 
+void Renderer::createStagedBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                                  Buffer &buffer) const {
+    createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 buffer.stagingBuffer, buffer.stagingMemory);
+
+    createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer.buffer,
+                 buffer.memory);
+
+    buffer.descriptor.buffer = buffer.buffer;
+    buffer.descriptor.offset = 0;
+    buffer.descriptor.range = size;
+}
+
+void Renderer::destroyStagedBuffer(Buffer &buffer) const {
+    vkDestroyBuffer(m_device.m_handle, buffer.stagingBuffer, m_allocator);
+    vkDestroyBuffer(m_device.m_handle, buffer.buffer, m_allocator);
+    vkFreeMemory(m_device.m_handle, buffer.stagingMemory, m_allocator);
+    vkFreeMemory(m_device.m_handle, buffer.memory, m_allocator);
+    buffer = Buffer();
+}
+
 uint32_t Renderer::findMemoryType(uint32_t typeFilter,
                                   VkMemoryPropertyFlags properties) const {
     for (uint32_t i = 0; i < m_device.m_memProps.memoryTypeCount; i++) {
@@ -1,22 +1,86 @@
 #pragma once
+#include "buffer.h"
 #include "camera.h"
+#include "cluster_culling.h"
+#include "cpu_culling.h"
+#include "descriptor_allocator.h"
 #include "device.h"
+#include "draw_key.h"
+#include "frustum.h"
+#include "geometry_pool.h"
+#include "gpu_culling.h"
+#include "gpu_timer.h"
 #include "graphics_pipeline.h"
 #include "headers.h"
+#include "hiz_pyramid.h"
+#include "impostor.h"
 #include "instance.h"
 #include "logger.h"
+#include "mesh.h"
 #include "model.h"
 #include "render_pass.h"
+#include "shader_compiler.h"
+#include "software_occlusion.h"
 #include "swapchain.h"
+#include "texture.h"
 
 namespace vulkan_proto {
 struct Renderer {
   private:
+    enum class CullingMode { None, Cpu, Gpu, Cluster };
+    // Pipeline field of the draw keys
+    static constexpr uint32_t s_depthPrepassPipeline = 0;
+    static constexpr uint32_t s_mainPipeline = 1;
+    static constexpr uint32_t s_impostorPipeline = 2;
+    // GPU frame times are averaged over this many frames
+    static constexpr uint32_t s_gpuTimeFrames = 500;
+
+    // Size of the bindless texture table
+    static constexpr uint32_t s_maxTextureCount = 1024;
+
+    // Matches DrawConstants of the shaders. The visible instances of a draw
+    // start from firstInstance in the instance list, the indirect commands
+    // themselves always start from instance zero. The textures of the draw
+    // start from materialIndex in the material textures. Only impostors
+    // read the bounding sphere, see Impostors. The stored positions of the
+    // mesh map to object space as positionOffset + positionScale * stored,
+    // see VertexQuantization.
+    struct DrawConstants {
+        uint32_t firstInstance = 0;
+        uint32_t materialIndex = 0;
+        uint32_t padding[2] = {};
+        glm::vec4 boundingSphere = glm::vec4(0.0f);
+        glm::vec4 positionOffset = glm::vec4(0.0f);
+        glm::vec4 positionScale = glm::vec4(1.0f);
+    };
+
+    // Buffers of the common set, bindings 1..4, written with one update
+    // template
+    struct CommonDescriptors {
+        VkDescriptorBufferInfo instances = {};
+        VkDescriptorBufferInfo camera = {};
+        VkDescriptorBufferInfo visibleInstances = {};
+        VkDescriptorBufferInfo materials = {};
+    };
+
     Instance m_instance;
     Device m_device;
     Swapchain m_swapchain;
     RenderPass m_renderPass;
+    ShaderCompiler m_shaderCompiler;
     GraphicsPipeline m_graphicsPipeline;
+    GraphicsPipeline m_depthPipeline;
+    GpuTimer m_gpuTimer;
+    mutable DescriptorAllocator m_descriptorAllocator;
+    GeometryPool m_geometryPool;
+    GpuCulling m_gpuCulling;
+    ClusterCulling m_clusterCulling;
+    CpuCulling m_cpuCulling;
+    HiZPyramid m_hiZPyramid;
+    SoftwareOcclusion m_softwareOcclusion;
+    Impostors m_impostors;
+    CullingMode m_cullingMode = CullingMode::Gpu;
+    bool m_depthPrepass = false;
 
     VkSurfaceKHR m_surface = VK_NULL_HANDLE;
 
@@ -28,14 +92,47 @@ struct Renderer {
     VkSemaphore m_renderingFinished = VK_NULL_HANDLE;
 
     VkDescriptorSet m_commonDescriptorSet = VK_NULL_HANDLE;
-    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    // Every texture, indexed by the texture index
+    VkDescriptorSet m_textureDescriptorSet = VK_NULL_HANDLE;
 
     std::vector<VkPushConstantRange> m_pushConstantRanges;
+    // Owned by the descriptor allocator
     std::vector<VkDescriptorSetLayout> m_descriptorSetLayouts;
 
     std::vector<VkCommandBuffer> m_commandBuffers;
 
     std::vector<Model> m_models;
+    std::vector<Mesh> m_meshes;
+    std::vector<Texture> m_textures;
+    std::map<std::string, uint32_t> m_meshIndices;
+    std::map<std::string, uint32_t> m_textureIndices;
+
+    // Model matrices of all instances, sorted by batch
+    std::vector<glm::mat4> m_instanceTransforms;
+    std::vector<InstanceBatch> m_instanceBatches;
+    // Texture table indices of each unique texture combination of the
+    // batches, one after the other
+    std::vector<uint32_t> m_materialTextures;
+    Buffer m_materialBuffer;
+    // Batch of each draw, the draws of a batch are its levels of detail
+    std::vector<uint32_t> m_drawBatches;
+    // Draws in the order they are drawn
+    std::vector<DrawKey> m_drawKeys;
+    std::vector<DrawKey> m_drawKeyScratch;
+    Buffer m_instanceBuffer;
+    Buffer m_cameraBuffer;
+    CameraData m_cameraData;
+    Frustum m_frustum;
+    uint32_t m_visibleObjectCount = ~0u;
+    MeshSettings m_meshSettings;
+    // The largest error in pixels a level of detail is drawn with
+    float m_lodThreshold = 1.0f;
+    std::vector<VkDrawIndexedIndirectCommand> m_culledDraws;
+    std::vector<uint32_t> m_culledInstances;
+    // Swapchain image of the last submitted frame
+    uint32_t m_submittedImage = ~0u;
+    double m_gpuTimeTotal = 0.0;
+    uint32_t m_gpuTimeFrameCount = 0;
 
     Camera m_camera;
     mutable Logger m_logger;
@@ -68,9 +165,27 @@ struct Renderer {
     void onWindowResize();
     void recreateSwapchain();
     void recordCommandBuffers();
+    void sortDraws();
+    // The last level of a batch with impostors
+    bool isImpostorDraw(const InstanceBatch &batch, uint32_t drawIndex) const;
+    void recordRenderPass(VkCommandBuffer commandBuffer,
+                          VkFramebuffer framebuffer, VkRenderPass renderPass,
+                          uint32_t phase);
 
     void setupDescriptors();
+    void registerTexture(uint32_t textureIndex,
+                         const VkDescriptorImageInfo &descriptor);
+    void createGraphicsPipelines(bool recycle = false);
+    void createGeometryPool();
     void createModels();
+    void createMeshes();
+    void createInstanceBatches();
+    void createCulling();
+    void createClusterCulling();
+    void captureImpostors();
+    // The mesh is created later, by createMeshes
+    uint32_t loadMesh(const std::string &path);
+    uint32_t loadTexture(const std::string &path);
     void createTextureSampler();
     void createSemaphores();
 
@@ -116,6 +231,8 @@ struct Renderer {
 
     const VkFormat &getDepthFormat() const { return m_swapchain.m_depthFormat; }
 
+    const VkImageView &getDepthView() const { return m_swapchain.m_depthView; }
+
     VkExtent2D getSwapchainExtent() const { return m_swapchain.m_extent; }
 
     VkExtent2D getWindowExtent() const {
@@ -134,6 +251,14 @@ struct Renderer {
         return (uint32_t)m_device.m_presentFI;
     }
 
+    VertexFormat getVertexFormat() const {
+        return m_meshSettings.vertexFormat;
+    }
+
+    const ShaderCompiler &getShaderCompiler() const {
+        return m_shaderCompiler;
+    }
+
     const std::vector<VkPushConstantRange> &getPushConstantRanges() const {
         return m_pushConstantRanges;
     }
@@ -142,16 +267,23 @@ struct Renderer {
         return m_descriptorSetLayouts;
     }
 
+    DescriptorAllocator &getDescriptorAllocator() const {
+        return m_descriptorAllocator;
+    }
+
     void copyCPUToGPU(const void *srcData, VkDeviceSize sizeInBytes,
                       VkDeviceMemory stagingMemory, VkBuffer stagingBuffer,
-                      VkBuffer dstBuffer) const;
+                      VkBuffer dstBuffer, VkDeviceSize dstOffset = 0) const;
     void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width,
                            uint32_t height) const;
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer,
-                    VkDeviceSize size) const;
+    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size,
+                    VkDeviceSize dstOffset = 0) const;
     void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
                       VkMemoryPropertyFlags properties, VkBuffer &buffer,
                       VkDeviceMemory &bufferMemory) const;
+    void createStagedBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                            Buffer &buffer) const;
+    void destroyStagedBuffer(Buffer &buffer) const;
     void createImage(uint32_t width, uint32_t height, uint32_t depth,
                      VkFormat format, VkImageTiling tiling,
                      VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
@@ -0,0 +1,136 @@
+#include "shader_compiler.h"
+#include "DirStackFileIncluder.h"
+#include "logger.h"
+#include "renderer.h"
+#include <glslang/SPIRV/GlslangToSpv.h>
+
+bool vulkan_proto::ShaderCompiler::glslangInitialized = false;
+
+namespace vulkan_proto {
+ShaderCompiler::ShaderCompiler(Renderer &renderer) : m_renderer(renderer) {}
+ShaderCompiler::~ShaderCompiler() {}
+
+void ShaderCompiler::destroy() {
+    if (glslangInitialized) {
+        glslang::FinalizeProcess();
+        glslangInitialized = false;
+    }
+}
+
+Logger &ShaderCompiler::getLogger() const { return m_renderer.getLogger(); }
+
+VkShaderModule ShaderCompiler::createShaderModule(const uint32_t *code,
+                                                  uint32_t bytes) const {
+    VkShaderModuleCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = bytes;
+    createInfo.pCode = code;
+
+    VkShaderModule shaderModule = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateShaderModule(m_renderer.getDevice(), &createInfo,
+                                  m_renderer.getAllocator(), &shaderModule));
+
+    return shaderModule;
+}
+
+VkShaderModule
+ShaderCompiler::createShaderModuleFromSpirV(const char *fName) const {
+    std::ifstream file(fName, std::ios::ate | std::ios::binary);
+    THROW_IF(file.is_open() == false, "Failed to open file!");
+    const uint32_t fileSize = (uint32_t)file.tellg();
+    std::vector<char> buffer(fileSize);
+    file.seekg(0);
+    file.read(buffer.data(), fileSize);
+    file.close();
+
+    return createShaderModule(reinterpret_cast<uint32_t *>(buffer.data()),
+                              static_cast<uint32_t>(buffer.size()));
+}
+
+VkShaderModule
+ShaderCompiler::createShaderModuleFromGLSL(std::string &&filename,
+                                           EShLanguage shaderStage) const {
+    LOG("=Creating shader module from %s=", filename.c_str());
+    // Initialize only once per process
+    if (!glslangInitialized) {
+        glslang::InitializeProcess();
+        glslangInitialized = true;
+    }
+
+    std::filesystem::path f{filename.c_str()};
+    THROW_IF(!std::filesystem::exists(f), "File %s does not exist",
+             filename.c_str());
+    std::ifstream file(filename.c_str(), std::ios::in);
+    THROW_IF(!file.is_open(), "Problem opening file %s", filename.c_str());
+
+    std::string sourceStr((std::istreambuf_iterator<char>(file)),
+                          std::istreambuf_iterator<char>());
+
+    const char *sourceCStr = sourceStr.c_str();
+    std::string pathStr(filename.substr(0, filename.find_last_of("/")));
+    DirStackFileIncluder includer;
+    includer.pushExternalLocalDirectory(pathStr);
+
+    glslang::TShader shader(shaderStage);
+    shader.setStrings(&sourceCStr, 1);
+
+    // Specify Vulkan/SpirV environment
+    // Get these from somewhere?
+    const int defaultVersion = 100;
+    const int clientInputSemanticsVersion = 100;
+    glslang::EShTargetClientVersion vulkanVersion =
+        glslang::EShTargetVulkan_1_0;
+    glslang::EShTargetLanguageVersion targetVersion = glslang::EShTargetSpv_1_0;
+
+    shader.setEnvInput(glslang::EShSourceGlsl, shaderStage,
+                       glslang::EShClientVulkan, clientInputSemanticsVersion);
+    shader.setEnvClient(glslang::EShClientVulkan, vulkanVersion);
+    shader.setEnvTarget(glslang::EShTargetSpv, targetVersion);
+
+    TBuiltInResource resources = DefaultTBuiltInResource;
+    EShMessages messages = (EShMessages)(EShMsgSpvRules | EShMsgVulkanRules);
+    std::string tempStr;
+
+    if (!shader.preprocess(&resources, defaultVersion, ENoProfile, false, false,
+                           messages, &tempStr, includer)) {
+        LOG("GLSL preprocessing failed for %s\n%s\n%s\n", filename.c_str(),
+            shader.getInfoLog(), shader.getInfoDebugLog());
+
+        return VK_NULL_HANDLE;
+    }
+
+    const char *preprocessedCStr = tempStr.c_str();
+    shader.setStrings(&preprocessedCStr, 1);
+
+    if (!shader.parse(&resources, defaultVersion, false, messages)) {
+        LOG("GLSL parse failed for %s\n%s\n%s\n", filename.c_str(),
+            shader.getInfoLog(), shader.getInfoDebugLog());
+
+        return VK_NULL_HANDLE;
+    }
+
+    glslang::TProgram program;
+    program.addShader(&shader);
+
+    if (!program.link(messages)) {
+        LOG("GLSL linking failed for %s\n%s\n%s\n", filename.c_str(),
+            shader.getInfoLog(), shader.getInfoDebugLog());
+
+        return VK_NULL_HANDLE;
+    }
+
+    std::vector<uint32_t> spirvCode;
+    spv::SpvBuildLogger logger;
+    glslang::SpvOptions spvOptions;
+    glslang::GlslangToSpv(*program.getIntermediate(shaderStage), spirvCode,
+                          &logger, &spvOptions);
+
+    if (logger.getAllMessages().length() > 0) {
+        LOG(logger.getAllMessages().c_str());
+    }
+
+    return createShaderModule(
+        spirvCode.data(),
+        static_cast<uint32_t>(spirvCode.size() * sizeof(spirvCode[0])));
+}
+} // namespace vulkan_proto
@@ -0,0 +1,384 @@
+#include "simplifier.h"
+#include <algorithm>
+#include <numeric>
+
+namespace {
+// Sum of the squared distances to a set of planes, weighted by the areas of
+// their triangles, as the upper half of a symmetric 4x4 matrix
+struct Quadric {
+    std::array<double, 10> m_a = {};
+    double m_weight = 0.0;
+
+    void addPlane(const glm::vec3 &normal, double d, double weight) {
+        const double a = normal.x;
+        const double b = normal.y;
+        const double c = normal.z;
+        const std::array<double, 10> plane = {a * a, a * b, a * c, a * d,
+                                              b * b, b * c, b * d, c * c,
+                                              c * d, d * d};
+        for (size_t i = 0; i < m_a.size(); i++) {
+            m_a[i] += weight * plane[i];
+        }
+        m_weight += weight;
+    }
+
+    Quadric &operator+=(const Quadric &other) {
+        for (size_t i = 0; i < m_a.size(); i++) {
+            m_a[i] += other.m_a[i];
+        }
+        m_weight += other.m_weight;
+        return *this;
+    }
+
+    // Weighted mean of the squared distances of p from the planes
+    double evaluate(const glm::vec3 &p) const {
+        if (m_weight <= 0.0) {
+            return 0.0;
+        }
+        const double x = p.x;
+        const double y = p.y;
+        const double z = p.z;
+        const double q =
+            m_a[0] * x * x + m_a[4] * y * y + m_a[7] * z * z + m_a[9] +
+            2.0 * (m_a[1] * x * y + m_a[2] * x * z + m_a[3] * x +
+                   m_a[5] * y * z + m_a[6] * y + m_a[8] * z);
+        return std::max(q, 0.0) / m_weight;
+    }
+};
+
+// Moves the welded vertex 'from' onto the welded vertex 'to'
+struct Collapse {
+    uint32_t from = 0;
+    uint32_t to = 0;
+    double cost = 0.0;
+};
+} // namespace
+
+namespace vulkan_proto {
+float simplifyMesh(const std::vector<glm::vec3> &positions,
+                   const std::vector<uint32_t> &indices,
+                   size_t targetIndexCount, std::vector<uint32_t> &result) {
+    result = indices;
+    const uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+
+    // Vertices at the same position are welded, e.g. the sides of a texture
+    // seam. The welded vertex is the first one at the position, and the
+    // vertices at each position form a ring through nextAtPosition.
+    std::vector<uint32_t> order(vertexCount);
+    std::iota(order.begin(), order.end(), 0);
+    auto lessPosition = [&positions](uint32_t a, uint32_t b) {
+        const glm::vec3 &pa = positions[a];
+        const glm::vec3 &pb = positions[b];
+        return pa.x != pb.x ? pa.x < pb.x
+                            : (pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z);
+    };
+    std::sort(order.begin(), order.end(), lessPosition);
+    std::vector<uint32_t> weldedVertices(vertexCount);
+    std::vector<uint32_t> nextAtPosition(vertexCount);
+    for (uint32_t i = 0; i < vertexCount;) {
+        uint32_t end = i + 1;
+        while (end < vertexCount &&
+               positions[order[end]] == positions[order[i]]) {
+            end++;
+        }
+        for (uint32_t j = i; j < end; j++) {
+            weldedVertices[order[j]] = order[i];
+            nextAtPosition[order[j]] = order[j + 1 < end ? j + 1 : i];
+        }
+        i = end;
+    }
+
+    // Planes of the original triangles, so the errors are always measured
+    // against the input. The area weighted normals of the input keep the
+    // triangles from turning over a bit at a time over many collapses.
+    std::vector<Quadric> quadrics(vertexCount);
+    std::vector<glm::vec3> normals(vertexCount, glm::vec3(0.0f));
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const glm::vec3 &p0 = positions[indices[i + 0]];
+        const glm::vec3 &p1 = positions[indices[i + 1]];
+        const glm::vec3 &p2 = positions[indices[i + 2]];
+        const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        const float length = glm::length(normal);
+        if (length <= 0.0f) {
+            continue;
+        }
+        const glm::vec3 unitNormal = normal / length;
+        const double d = -glm::dot(unitNormal, p0);
+        for (uint32_t k = 0; k < 3; k++) {
+            quadrics[weldedVertices[indices[i + k]]].addPlane(
+                unitNormal, d, 0.5 * length);
+            normals[weldedVertices[indices[i + k]]] += normal;
+        }
+    }
+
+    std::vector<uint32_t> remap(vertexCount);
+    std::iota(remap.begin(), remap.end(), 0);
+    double maxError = 0.0;
+
+    // Moves the collapsed vertices, triangles with two corners at the same
+    // position are gone
+    auto applyRemap = [&]() {
+        size_t indexCount = 0;
+        for (size_t i = 0; i < result.size(); i += 3) {
+            const uint32_t a = remap[result[i + 0]];
+            const uint32_t b = remap[result[i + 1]];
+            const uint32_t c = remap[result[i + 2]];
+            const uint32_t weldedA = weldedVertices[a];
+            const uint32_t weldedB = weldedVertices[b];
+            const uint32_t weldedC = weldedVertices[c];
+            if (weldedA == weldedB || weldedB == weldedC ||
+                weldedA == weldedC) {
+                continue;
+            }
+            result[indexCount++] = a;
+            result[indexCount++] = b;
+            result[indexCount++] = c;
+        }
+        result.resize(indexCount);
+    };
+    applyRemap();
+
+    std::vector<uint32_t> triangleOffsets;
+    std::vector<uint32_t> vertexTriangles;
+    std::vector<uint32_t> cursors;
+    std::vector<std::pair<uint32_t, uint32_t>> edges;
+    std::vector<bool> locked;
+    std::vector<bool> touched;
+    std::vector<Collapse> collapses;
+    std::vector<std::pair<uint32_t, uint32_t>> partners;
+    std::vector<uint32_t> fromNeighbours;
+    std::vector<uint32_t> toNeighbours;
+
+    // Welded vertices of the triangles around a welded vertex, but itself
+    auto gatherNeighbours = [&](uint32_t vertex,
+                                std::vector<uint32_t> &neighbours) {
+        neighbours.clear();
+        for (uint32_t i = triangleOffsets[vertex];
+             i < triangleOffsets[vertex + 1]; i++) {
+            for (uint32_t k = 0; k < 3; k++) {
+                const uint32_t neighbour =
+                    weldedVertices[result[3 * vertexTriangles[i] + k]];
+                if (neighbour != vertex) {
+                    neighbours.push_back(neighbour);
+                }
+            }
+        }
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()),
+                         neighbours.end());
+    };
+
+    // Finds the vertex each vertex at 'from' moves onto, and checks that the
+    // collapse keeps the surface manifold and flips no triangle
+    auto canCollapse = [&](const Collapse &collapse) {
+        const uint32_t from = collapse.from;
+        const uint32_t to = collapse.to;
+
+        // The triangles of the edge must be the only ones shared by the two
+        // fans, otherwise the collapse pinches the surface
+        gatherNeighbours(from, fromNeighbours);
+        gatherNeighbours(to, toNeighbours);
+        uint32_t sharedCount = 0;
+        for (size_t i = 0, j = 0;
+             i < fromNeighbours.size() && j < toNeighbours.size();) {
+            if (fromNeighbours[i] < toNeighbours[j]) {
+                i++;
+            } else if (toNeighbours[j] < fromNeighbours[i]) {
+                j++;
+            } else {
+                sharedCount++;
+                i++;
+                j++;
+            }
+        }
+        if (sharedCount != 2) {
+            return false;
+        }
+
+        // Each vertex at 'from' moves onto a vertex at 'to' it shares a
+        // triangle with. Without one, 'from' is on a seam 'to' is not on.
+        partners.clear();
+        uint32_t vertex = from;
+        do {
+            bool used = false;
+            uint32_t partner = ~0u;
+            for (uint32_t i = triangleOffsets[from];
+                 i < triangleOffsets[from + 1] && partner == ~0u; i++) {
+                const uint32_t *triangle = &result[3 * vertexTriangles[i]];
+                if (triangle[0] != vertex && triangle[1] != vertex &&
+                    triangle[2] != vertex) {
+                    continue;
+                }
+                used = true;
+                for (uint32_t k = 0; k < 3; k++) {
+                    if (weldedVertices[triangle[k]] == to) {
+                        partner = triangle[k];
+                    }
+                }
+            }
+            if (used && partner == ~0u) {
+                return false;
+            }
+            if (used) {
+                partners.emplace_back(vertex, partner);
+            }
+            vertex = nextAtPosition[vertex];
+        } while (vertex != from);
+
+        // The triangles that stay must not turn over
+        for (uint32_t i = triangleOffsets[from]; i < triangleOffsets[from + 1];
+             i++) {
+            const uint32_t *triangle = &result[3 * vertexTriangles[i]];
+            std::array<glm::vec3, 3> moved;
+            glm::vec3 inputNormal(0.0f);
+            bool collapses = false;
+            for (uint32_t k = 0; k < 3; k++) {
+                const uint32_t welded = weldedVertices[triangle[k]];
+                collapses = collapses || welded == to;
+                moved[k] = welded == from ? positions[to]
+                                          : positions[triangle[k]];
+                inputNormal += normals[welded == from ? to : welded];
+            }
+            if (collapses) {
+                continue;
+            }
+            const glm::vec3 &p0 = positions[triangle[0]];
+            const glm::vec3 &p1 = positions[triangle[1]];
+            const glm::vec3 &p2 = positions[triangle[2]];
+            const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            const glm::vec3 movedNormal =
+                glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+            // More than about 75 degrees counts as turned over, slivers
+            // can flip with small moves otherwise
+            if (glm::dot(normal, movedNormal) <=
+                    0.25f * glm::length(normal) * glm::length(movedNormal) &&
+                glm::dot(normal, normal) > 0.0f) {
+                return false;
+            }
+            // Small turns add up, the input around the corners decides
+            if (glm::dot(inputNormal, movedNormal) <= 0.0f) {
+                return false;
+            }
+        }
+
+        return true;
+    };
+
+    // Each pass collapses a set of edges that do not touch each other, so
+    // the checks of a collapse see the final positions of its neighbours
+    while (result.size() > targetIndexCount) {
+        // Triangles of each welded vertex
+        triangleOffsets.assign(vertexCount + 1, 0);
+        for (uint32_t index : result) {
+            triangleOffsets[weldedVertices[index] + 1]++;
+        }
+        std::partial_sum(triangleOffsets.begin(), triangleOffsets.end(),
+                         triangleOffsets.begin());
+        vertexTriangles.resize(result.size());
+        cursors.assign(triangleOffsets.begin(), triangleOffsets.end() - 1);
+        for (uint32_t i = 0; i < static_cast<uint32_t>(result.size()); i++) {
+            vertexTriangles[cursors[weldedVertices[result[i]]]++] = i / 3;
+        }
+
+        edges.clear();
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (uint32_t k = 0; k < 3; k++) {
+                const uint32_t a = weldedVertices[result[i + k]];
+                const uint32_t b = weldedVertices[result[i + (k + 1) % 3]];
+                edges.emplace_back(std::min(a, b), std::max(a, b));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+
+        // An edge of one triangle is on a border, and one of more than two
+        // is non-manifold. Their vertices stay where they are.
+        locked.assign(vertexCount, false);
+        for (size_t i = 0; i < edges.size();) {
+            size_t end = i + 1;
+            while (end < edges.size() && edges[end] == edges[i]) {
+                end++;
+            }
+            if (end - i != 2) {
+                locked[edges[i].first] = true;
+                locked[edges[i].second] = true;
+            }
+            i = end;
+        }
+
+        // The cheaper direction of each edge that can collapse
+        collapses.clear();
+        for (size_t i = 0; i < edges.size();) {
+            size_t end = i + 1;
+            while (end < edges.size() && edges[end] == edges[i]) {
+                end++;
+            }
+            const uint32_t a = edges[i].first;
+            const uint32_t b = edges[i].second;
+            i = end;
+            if (locked[a] && locked[b]) {
+                continue;
+            }
+
+            Quadric quadric = quadrics[a];
+            quadric += quadrics[b];
+            Collapse collapse;
+            collapse.cost = std::numeric_limits<double>::max();
+            if (locked[a] == false) {
+                collapse = {a, b, quadric.evaluate(positions[b])};
+            }
+            if (locked[b] == false) {
+                const double cost = quadric.evaluate(positions[a]);
+                if (cost < collapse.cost) {
+                    collapse = {b, a, cost};
+                }
+            }
+            collapses.push_back(collapse);
+        }
+        if (collapses.empty()) {
+            break;
+        }
+        std::sort(collapses.begin(), collapses.end(),
+                  [](const Collapse &a, const Collapse &b) {
+                      return a.cost < b.cost;
+                  });
+
+        // Each collapse removes two triangles. Many of the cheapest ones are
+        // blocked by a neighbour collapsing first, so the pass accepts some
+        // more error than the last collapse it would need.
+        const size_t goal = (result.size() - targetIndexCount) / 6 + 1;
+        const double errorLimit = goal < collapses.size()
+                                      ? 1.5 * collapses[goal].cost
+                                      : std::numeric_limits<double>::max();
+        touched.assign(vertexCount, false);
+        size_t collapseCount = 0;
+        for (const Collapse &collapse : collapses) {
+            if (collapseCount == goal || collapse.cost > errorLimit) {
+                break;
+            }
+            if (touched[collapse.from] || touched[collapse.to] ||
+                canCollapse(collapse) == false) {
+                continue;
+            }
+
+            for (const auto &partner : partners) {
+                remap[partner.first] = partner.second;
+            }
+            quadrics[collapse.to] += quadrics[collapse.from];
+            touched[collapse.from] = true;
+            touched[collapse.to] = true;
+            for (uint32_t neighbour : fromNeighbours) {
+                touched[neighbour] = true;
+            }
+            maxError = std::max(maxError, collapse.cost);
+            collapseCount++;
+        }
+        if (collapseCount == 0) {
+            break;
+        }
+
+        applyRemap();
+    }
+
+    return static_cast<float>(std::sqrt(maxError));
+}
+} // namespace vulkan_proto
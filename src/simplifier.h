@@ -0,0 +1,20 @@
+#pragma once
+
+#include "headers.h"
+
+namespace vulkan_proto {
+// Simplifies a triangle list towards the target index count by collapsing
+// edges with quadric error metrics (Garland & Heckbert). Each edge collapses
+// onto one of its vertices, so the result indexes the same vertices as the
+// input and shares its vertex buffer. Vertices on open borders never move,
+// and vertices split by texture seams only move along the seam. No triangle
+// turns against the normals of the input around its corners.
+//
+// Returns the error of the result, the root mean square distance of the
+// worst collapsed vertex from the planes of the triangles it replaced, in
+// the units of the positions. The result may stay above the target when
+// nothing more can be collapsed.
+float simplifyMesh(const std::vector<glm::vec3> &positions,
+                   const std::vector<uint32_t> &indices,
+                   size_t targetIndexCount, std::vector<uint32_t> &result);
+} // namespace vulkan_proto
@@ -0,0 +1,354 @@
+#include "software_occlusion.h"
+#include <algorithm>
+#include <cmath>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+// Vertices in front of the near plane would project behind the camera
+bool isBehindNearPlane(const glm::vec4 &clip) {
+    return clip.w <= 0.0f || clip.z < 0.0f;
+}
+} // namespace
+
+namespace vulkan_proto {
+SoftwareOcclusion::~SoftwareOcclusion() { stopWorkers(); }
+
+void SoftwareOcclusion::create(bool enabled, uint32_t width, uint32_t height,
+                               uint32_t threadCount) {
+    stopWorkers();
+    m_enabled = enabled;
+    if (m_enabled == false) {
+        return;
+    }
+
+    m_width = std::max(1u, (width + s_tileSize - 1) / s_tileSize) * s_tileSize;
+    m_height =
+        std::max(1u, (height + s_tileSize - 1) / s_tileSize) * s_tileSize;
+
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    m_threadCount = std::min(threadCount, m_height / s_tileSize);
+
+    m_depth.assign(m_width * m_height, 1.0f);
+    m_tileMaxDepth.assign(m_width * m_height / (s_tileSize * s_tileSize),
+                          1.0f);
+
+    for (uint32_t band = 0; band + 1 < m_threadCount; band++) {
+        m_workers.emplace_back(&SoftwareOcclusion::work, this, band);
+    }
+}
+
+void SoftwareOcclusion::destroy() {
+    stopWorkers();
+    m_occluderVertices.clear();
+    m_occluderIndices.clear();
+    m_clipVertices.clear();
+    m_triangles.clear();
+    m_depth.clear();
+    m_tileMaxDepth.clear();
+    m_enabled = false;
+}
+
+void SoftwareOcclusion::addOccluder(const std::vector<glm::vec3> &positions,
+                                    const std::vector<uint32_t> &indices,
+                                    const glm::mat4 &transform) {
+    const uint32_t firstVertex =
+        static_cast<uint32_t>(m_occluderVertices.size());
+    for (const auto &position : positions) {
+        const glm::vec4 p = transform * glm::vec4(position, 1.0f);
+        m_occluderVertices.emplace_back(p.x, p.y, p.z);
+    }
+    for (const auto &index : indices) {
+        m_occluderIndices.push_back(firstVertex + index);
+    }
+}
+
+void SoftwareOcclusion::render(const glm::mat4 &viewProjection) {
+    m_viewProjection = viewProjection;
+    setupTriangles();
+
+    {
+        std::lock_guard<std::mutex> lock(m_workMutex);
+        m_renderCount++;
+        m_pendingWorkers = static_cast<uint32_t>(m_workers.size());
+    }
+    m_workReady.notify_all();
+
+    // The last band is rasterized on this thread
+    rasterizeBand(m_threadCount - 1);
+
+    std::unique_lock<std::mutex> lock(m_workMutex);
+    m_workDone.wait(lock, [this]() { return m_pendingWorkers == 0; });
+}
+
+bool SoftwareOcclusion::isOccluded(const glm::vec3 &center,
+                                   const glm::vec3 &extent) const {
+    float minX = std::numeric_limits<float>::max();
+    float minY = std::numeric_limits<float>::max();
+    float maxX = std::numeric_limits<float>::lowest();
+    float maxY = std::numeric_limits<float>::lowest();
+    float nearest = std::numeric_limits<float>::max();
+    for (uint32_t i = 0; i < 8; i++) {
+        const glm::vec3 corner =
+            center + glm::vec3(i & 1 ? extent.x : -extent.x,
+                               i & 2 ? extent.y : -extent.y,
+                               i & 4 ? extent.z : -extent.z);
+        const glm::vec4 clip = m_viewProjection * glm::vec4(corner, 1.0f);
+        if (isBehindNearPlane(clip)) {
+            return false;
+        }
+
+        const float x = (clip.x / clip.w * 0.5f + 0.5f) * m_width;
+        const float y = (clip.y / clip.w * 0.5f + 0.5f) * m_height;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearest = std::min(nearest, clip.z / clip.w);
+    }
+
+    // Every pixel the box touches, not only the ones whose center it covers
+    const int32_t x0 = std::max(0, static_cast<int32_t>(std::floor(minX)));
+    const int32_t y0 = std::max(0, static_cast<int32_t>(std::floor(minY)));
+    const int32_t x1 =
+        std::min(static_cast<int32_t>(m_width),
+                 static_cast<int32_t>(std::ceil(maxX)));
+    const int32_t y1 =
+        std::min(static_cast<int32_t>(m_height),
+                 static_cast<int32_t>(std::ceil(maxY)));
+    if (x0 >= x1 || y0 >= y1) {
+        return false;
+    }
+
+    const int32_t tileSize = static_cast<int32_t>(s_tileSize);
+    const uint32_t tilesPerRow = m_width / s_tileSize;
+    for (int32_t ty = y0 / tileSize; ty <= (y1 - 1) / tileSize; ty++) {
+        for (int32_t tx = x0 / tileSize; tx <= (x1 - 1) / tileSize; tx++) {
+            if (nearest > m_tileMaxDepth[ty * tilesPerRow + tx]) {
+                continue;
+            }
+
+            // Some pixel of the tile may be farther than the box
+            const int32_t rowEnd = std::min(y1, (ty + 1) * tileSize);
+            const int32_t columnEnd = std::min(x1, (tx + 1) * tileSize);
+            for (int32_t y = std::max(y0, ty * tileSize); y < rowEnd; y++) {
+                const float *row = &m_depth[y * m_width];
+                for (int32_t x = std::max(x0, tx * tileSize); x < columnEnd;
+                     x++) {
+                    if (nearest <= row[x]) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+void SoftwareOcclusion::setupTriangles() {
+    m_clipVertices.resize(m_occluderVertices.size());
+    for (size_t i = 0; i < m_occluderVertices.size(); i++) {
+        m_clipVertices[i] =
+            m_viewProjection * glm::vec4(m_occluderVertices[i], 1.0f);
+    }
+
+    // Occluders are rasterized from both sides. Triangles crossing the near
+    // plane are dropped, which only ever makes the buffer less occluding.
+    m_triangles.clear();
+    for (size_t i = 0; i + 2 < m_occluderIndices.size(); i += 3) {
+        std::array<glm::vec3, 3> v;
+        bool clipped = false;
+        for (size_t j = 0; j < 3; j++) {
+            const glm::vec4 &clip = m_clipVertices[m_occluderIndices[i + j]];
+            clipped |= isBehindNearPlane(clip);
+            v[j] = glm::vec3((clip.x / clip.w * 0.5f + 0.5f) * m_width,
+                             (clip.y / clip.w * 0.5f + 0.5f) * m_height,
+                             clip.z / clip.w);
+        }
+        if (clipped) {
+            continue;
+        }
+
+        float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) -
+                     (v[1].y - v[0].y) * (v[2].x - v[0].x);
+        if (area == 0.0f) {
+            continue;
+        }
+        if (area < 0.0f) {
+            std::swap(v[1], v[2]);
+            area = -area;
+        }
+
+        // Pixel centers are at half coordinates
+        Triangle t;
+        t.minX = std::max(0, static_cast<int32_t>(std::floor(
+                                 std::min({v[0].x, v[1].x, v[2].x}) - 0.5f)));
+        t.minY = std::max(0, static_cast<int32_t>(std::floor(
+                                 std::min({v[0].y, v[1].y, v[2].y}) - 0.5f)));
+        t.maxX = std::min(static_cast<int32_t>(m_width) - 1,
+                          static_cast<int32_t>(std::ceil(
+                              std::max({v[0].x, v[1].x, v[2].x}) - 0.5f)));
+        t.maxY = std::min(static_cast<int32_t>(m_height) - 1,
+                          static_cast<int32_t>(std::ceil(
+                              std::max({v[0].y, v[1].y, v[2].y}) - 0.5f)));
+        if (t.minX > t.maxX || t.minY > t.maxY) {
+            continue;
+        }
+
+        for (size_t j = 0; j < 3; j++) {
+            const glm::vec3 &p = v[j];
+            const glm::vec3 &q = v[(j + 1) % 3];
+            t.a[j] = p.y - q.y;
+            t.b[j] = q.x - p.x;
+            t.c[j] = (q.y - p.y) * p.x - (q.x - p.x) * p.y;
+        }
+
+        // A pixel stores the farthest depth of the triangle within it, so a
+        // box is never hidden by a part of a pixel the triangle is in front
+        // of
+        const float dz1 = v[1].z - v[0].z;
+        const float dz2 = v[2].z - v[0].z;
+        t.depthX = (dz1 * (v[2].y - v[0].y) - dz2 * (v[1].y - v[0].y)) / area;
+        t.depthY = (dz2 * (v[1].x - v[0].x) - dz1 * (v[2].x - v[0].x)) / area;
+        t.depthC = v[0].z - t.depthX * v[0].x - t.depthY * v[0].y +
+                   0.5f * (std::abs(t.depthX) + std::abs(t.depthY));
+        t.maxDepth = std::max({v[0].z, v[1].z, v[2].z});
+
+        m_triangles.push_back(t);
+    }
+}
+
+void SoftwareOcclusion::work(uint32_t band) {
+    uint64_t renderCount = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_workMutex);
+            m_workReady.wait(lock, [&]() {
+                return m_stopWorkers || m_renderCount != renderCount;
+            });
+            if (m_stopWorkers) {
+                return;
+            }
+            renderCount = m_renderCount;
+        }
+
+        rasterizeBand(band);
+
+        std::lock_guard<std::mutex> lock(m_workMutex);
+        if (--m_pendingWorkers == 0) {
+            m_workDone.notify_one();
+        }
+    }
+}
+
+void SoftwareOcclusion::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(m_workMutex);
+        m_stopWorkers = true;
+    }
+    m_workReady.notify_all();
+    for (auto &worker : m_workers) {
+        worker.join();
+    }
+    m_workers.clear();
+    m_stopWorkers = false;
+    m_renderCount = 0;
+}
+
+void SoftwareOcclusion::rasterizeBand(uint32_t band) {
+    const uint32_t tileRows = m_height / s_tileSize;
+    rasterizeBand(tileRows * band / m_threadCount,
+                  tileRows * (band + 1) / m_threadCount);
+}
+
+void SoftwareOcclusion::rasterizeBand(uint32_t firstTileRow,
+                                      uint32_t endTileRow) {
+    const int32_t firstRow = static_cast<int32_t>(firstTileRow * s_tileSize);
+    const int32_t endRow = static_cast<int32_t>(endTileRow * s_tileSize);
+    std::fill(m_depth.begin() + firstRow * m_width,
+              m_depth.begin() + endRow * m_width, 1.0f);
+
+    for (const auto &t : m_triangles) {
+        const int32_t rowBegin = std::max(firstRow, t.minY);
+        const int32_t rowEnd = std::min(endRow, t.maxY + 1);
+        for (int32_t y = rowBegin; y < rowEnd; y++) {
+            float *row = &m_depth[y * m_width];
+            const float py = y + 0.5f;
+#if defined(__SSE2__)
+            // Four pixels at a time, the width is a multiple of four
+            const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 maxDepth = _mm_set1_ps(t.maxDepth);
+            __m128 a[3];
+            __m128 rowEdge[3];
+            for (size_t j = 0; j < 3; j++) {
+                a[j] = _mm_set1_ps(t.a[j]);
+                rowEdge[j] = _mm_set1_ps(t.b[j] * py + t.c[j]);
+            }
+            const __m128 depthX = _mm_set1_ps(t.depthX);
+            const __m128 rowDepth = _mm_set1_ps(t.depthY * py + t.depthC);
+
+            for (int32_t x = t.minX & ~3; x <= t.maxX; x += 4) {
+                const __m128 px =
+                    _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), offsets);
+                __m128 inside = _mm_cmpge_ps(
+                    _mm_add_ps(_mm_mul_ps(a[0], px), rowEdge[0]), zero);
+                inside = _mm_and_ps(
+                    inside, _mm_cmpge_ps(
+                                _mm_add_ps(_mm_mul_ps(a[1], px), rowEdge[1]),
+                                zero));
+                inside = _mm_and_ps(
+                    inside, _mm_cmpge_ps(
+                                _mm_add_ps(_mm_mul_ps(a[2], px), rowEdge[2]),
+                                zero));
+                if (_mm_movemask_ps(inside) == 0) {
+                    continue;
+                }
+
+                const __m128 depth = _mm_min_ps(
+                    _mm_add_ps(_mm_mul_ps(depthX, px), rowDepth), maxDepth);
+                const __m128 old = _mm_loadu_ps(&row[x]);
+                _mm_storeu_ps(
+                    &row[x],
+                    _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(old, depth)),
+                              _mm_andnot_ps(inside, old)));
+            }
+#else
+            for (int32_t x = t.minX; x <= t.maxX; x++) {
+                const float px = x + 0.5f;
+                bool inside = true;
+                for (size_t j = 0; j < 3; j++) {
+                    inside =
+                        inside && t.a[j] * px + t.b[j] * py + t.c[j] >= 0.0f;
+                }
+                if (inside) {
+                    const float depth =
+                        std::min(t.depthX * px + t.depthY * py + t.depthC,
+                                 t.maxDepth);
+                    row[x] = std::min(row[x], depth);
+                }
+            }
+#endif
+        }
+    }
+
+    const uint32_t tilesPerRow = m_width / s_tileSize;
+    for (uint32_t ty = firstTileRow; ty < endTileRow; ty++) {
+        for (uint32_t tx = 0; tx < tilesPerRow; tx++) {
+            float farthest = 0.0f;
+            for (uint32_t y = ty * s_tileSize; y < (ty + 1) * s_tileSize;
+                 y++) {
+                const float *row = &m_depth[y * m_width + tx * s_tileSize];
+                for (uint32_t x = 0; x < s_tileSize; x++) {
+                    farthest = std::max(farthest, row[x]);
+                }
+            }
+            m_tileMaxDepth[ty * tilesPerRow + tx] = farthest;
+        }
+    }
+}
+} // namespace vulkan_proto
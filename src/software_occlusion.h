@@ -0,0 +1,85 @@
+#pragma once
+
+#include "headers.h"
+
+namespace vulkan_proto {
+// Occlusion culling without the GPU. A few large occluders are rasterized
+// into a low resolution depth buffer on worker threads and the screen space
+// bounds of the objects are tested against it. Every thread owns a band of
+// tile rows and depth only ever decreases, so the buffer does not depend on
+// the number of threads or the order of the triangles.
+struct SoftwareOcclusion {
+    // Tiles of this many pixels squared keep the farthest depth of their
+    // pixels, so most box tests never touch the pixels
+    static constexpr uint32_t s_tileSize = 8;
+
+    struct Triangle {
+        // Pixel bounds, inclusive
+        int32_t minX = 0;
+        int32_t maxX = 0;
+        int32_t minY = 0;
+        int32_t maxY = 0;
+        // Edge functions a * x + b * y + c, non-negative inside
+        std::array<float, 3> a = {};
+        std::array<float, 3> b = {};
+        std::array<float, 3> c = {};
+        // Depth plane, biased to the farthest point of a pixel
+        float depthX = 0.0f;
+        float depthY = 0.0f;
+        float depthC = 0.0f;
+        float maxDepth = 0.0f;
+    };
+
+    bool m_enabled = false;
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    uint32_t m_threadCount = 1;
+
+    // Occluder geometry in world space
+    std::vector<glm::vec3> m_occluderVertices;
+    std::vector<uint32_t> m_occluderIndices;
+
+    glm::mat4 m_viewProjection = glm::mat4(1.0f);
+    std::vector<glm::vec4> m_clipVertices;
+    std::vector<Triangle> m_triangles;
+    std::vector<float> m_depth;
+    std::vector<float> m_tileMaxDepth;
+
+    // One per band but the last, which render rasterizes itself. They live
+    // from create to destroy & wait for each render, starting threads every
+    // frame would cost a good part of the frame.
+    std::vector<std::thread> m_workers;
+    std::mutex m_workMutex;
+    std::condition_variable m_workReady;
+    std::condition_variable m_workDone;
+    // Counts the renders, a worker rasterizes once per count
+    uint64_t m_renderCount = 0;
+    uint32_t m_pendingWorkers = 0;
+    bool m_stopWorkers = false;
+
+    ~SoftwareOcclusion();
+    // Width and height are rounded up to whole tiles, zero threads uses all
+    // hardware threads
+    void create(bool enabled, uint32_t width, uint32_t height,
+                uint32_t threadCount);
+    void destroy();
+    void addOccluder(const std::vector<glm::vec3> &positions,
+                     const std::vector<uint32_t> &indices,
+                     const glm::mat4 &transform);
+    // Rasterizes the occluders as seen through the given matrix
+    void render(const glm::mat4 &viewProjection);
+    // True if a world space box, given as center and half extents, is
+    // behind the occluders everywhere it covers on the screen
+    bool isOccluded(const glm::vec3 &center, const glm::vec3 &extent) const;
+    uint32_t getTriangleCount() const {
+        return static_cast<uint32_t>(m_triangles.size());
+    }
+
+  private:
+    void setupTriangles();
+    void rasterizeBand(uint32_t band);
+    void rasterizeBand(uint32_t firstTileRow, uint32_t endTileRow);
+    void work(uint32_t band);
+    void stopWorkers();
+};
+} // namespace vulkan_proto
@@ -116,11 +116,13 @@ void Swapchain::create(bool recycle) {
                                    m_renderer.getAllocator(), &m_views[i]));
     }
 
-    // Depth
-    m_renderer.createImage(
-        m_extent.width, m_extent.height, 1, m_depthFormat,
-        VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_depthImage, m_depthMemory);
+    // Depth, sampled when building the hierarchical depth for culling
+    m_renderer.createImage(m_extent.width, m_extent.height, 1, m_depthFormat,
+                           VK_IMAGE_TILING_OPTIMAL,
+                           VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                               VK_IMAGE_USAGE_SAMPLED_BIT,
+                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_depthImage,
+                           m_depthMemory);
 
     imageViewCi = {};
     imageViewCi.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -250,7 +252,8 @@ void Swapchain::chooseFormats() {
                                                 VK_FORMAT_D32_SFLOAT_S8_UINT,
                                                 VK_FORMAT_D24_UNORM_S8_UINT};
     const VkFormatFeatureFlags features =
-        VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT |
+        VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
 
     for (auto &format : candidates) {
         VkFormatProperties props = {};
@@ -0,0 +1,133 @@
+#include "vertex_cache.h"
+#include <numeric>
+
+namespace vulkan_proto {
+VertexCacheStatistics analyzeVertexCache(const uint32_t *indices,
+                                         size_t indexCount,
+                                         uint32_t vertexCount,
+                                         uint32_t cacheSize) {
+    VertexCacheStatistics statistics;
+    if (indexCount < 3) {
+        return statistics;
+    }
+
+    // A vertex is in the cache until cacheSize other vertices have been
+    // transformed after it
+    std::vector<uint64_t> transformedAt(vertexCount, ~0ull);
+    uint64_t transformCount = 0;
+    uint32_t usedCount = 0;
+    for (size_t i = 0; i < indexCount; i++) {
+        uint64_t &time = transformedAt[indices[i]];
+        if (time == ~0ull) {
+            usedCount++;
+        } else if (transformCount - time < cacheSize) {
+            continue;
+        }
+        time = transformCount++;
+    }
+
+    statistics.acmr = static_cast<float>(transformCount) /
+                      static_cast<float>(indexCount / 3);
+    statistics.atvr = static_cast<float>(transformCount) /
+                      static_cast<float>(std::max(usedCount, 1u));
+    return statistics;
+}
+
+void optimizeVertexCache(uint32_t *indices, size_t indexCount,
+                         uint32_t vertexCount, uint32_t cacheSize) {
+    const uint32_t triangleCount = static_cast<uint32_t>(indexCount / 3);
+    if (triangleCount < 2) {
+        return;
+    }
+
+    // Triangles of each vertex, and how many of them are not emitted yet
+    std::vector<uint32_t> liveCounts(vertexCount, 0);
+    for (size_t i = 0; i < 3 * static_cast<size_t>(triangleCount); i++) {
+        liveCounts[indices[i]]++;
+    }
+    std::vector<uint32_t> triangleOffsets(vertexCount + 1, 0);
+    std::partial_sum(liveCounts.begin(), liveCounts.end(),
+                     triangleOffsets.begin() + 1);
+    std::vector<uint32_t> vertexTriangles(3 * triangleCount);
+    std::vector<uint32_t> cursors(triangleOffsets.begin(),
+                                  triangleOffsets.end() - 1);
+    for (uint32_t i = 0; i < 3 * triangleCount; i++) {
+        vertexTriangles[cursors[indices[i]]++] = i / 3;
+    }
+
+    // The cache is simulated with the time each vertex was transformed at,
+    // the time being the number of vertices transformed so far
+    std::vector<uint32_t> cacheTimes(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    std::vector<bool> emitted(triangleCount, false);
+    // Vertices of the emitted triangles, most recent last
+    std::vector<uint32_t> deadEndStack;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> result;
+    result.reserve(3 * triangleCount);
+    uint32_t nextVertex = 0;
+
+    // A vertex with triangles left, from the most recently used ones or
+    // else in input order, ~0u once every triangle is emitted
+    auto skipDeadEnd = [&]() {
+        while (deadEndStack.empty() == false) {
+            const uint32_t vertex = deadEndStack.back();
+            deadEndStack.pop_back();
+            if (liveCounts[vertex] > 0) {
+                return vertex;
+            }
+        }
+        for (; nextVertex < vertexCount; nextVertex++) {
+            if (liveCounts[nextVertex] > 0) {
+                return nextVertex;
+            }
+        }
+        return ~0u;
+    };
+
+    uint32_t fanVertex = indices[0];
+    while (fanVertex != ~0u) {
+        candidates.clear();
+        for (uint32_t i = triangleOffsets[fanVertex];
+             i < triangleOffsets[fanVertex + 1]; i++) {
+            const uint32_t triangle = vertexTriangles[i];
+            if (emitted[triangle]) {
+                continue;
+            }
+            emitted[triangle] = true;
+            for (uint32_t k = 0; k < 3; k++) {
+                const uint32_t vertex = indices[3 * triangle + k];
+                result.push_back(vertex);
+                deadEndStack.push_back(vertex);
+                candidates.push_back(vertex);
+                liveCounts[vertex]--;
+                if (time - cacheTimes[vertex] > cacheSize) {
+                    cacheTimes[vertex] = time++;
+                }
+            }
+        }
+
+        // Prefer the candidate that entered the cache earliest, as long as
+        // fanning around it keeps it in the cache
+        uint32_t best = ~0u;
+        int64_t bestPriority = -1;
+        for (uint32_t vertex : candidates) {
+            if (liveCounts[vertex] == 0) {
+                continue;
+            }
+            int64_t priority = 0;
+            const uint32_t age = time - cacheTimes[vertex];
+            if (age + 2 * liveCounts[vertex] <= cacheSize) {
+                priority = age;
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                best = vertex;
+            }
+        }
+        fanVertex = best != ~0u ? best : skipDeadEnd();
+    }
+
+    std::copy(result.begin(), result.end(), indices);
+}
+} // namespace vulkan_proto
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "headers.h"
+
+namespace vulkan_proto {
+// Entries of the post-transform cache the index lists are optimized for and
+// measured with. GPUs differ, but ordering for a small cache works well on
+// larger ones too.
+constexpr uint32_t s_vertexCacheSize = 16;
+
+// How many vertex shader invocations an index list costs when drawn through
+// a FIFO post-transform cache
+struct VertexCacheStatistics {
+    // Average cache miss ratio, transformed vertices per triangle. At best
+    // about 0.5 for large regular meshes, at worst 3.
+    float acmr = 0.0f;
+    // Average transform to vertex ratio, transformed vertices per vertex
+    // used by the triangles. At best 1.
+    float atvr = 0.0f;
+};
+
+VertexCacheStatistics
+analyzeVertexCache(const uint32_t *indices, size_t indexCount,
+                   uint32_t vertexCount,
+                   uint32_t cacheSize = s_vertexCacheSize);
+
+// Reorders the triangles of an index list to transform fewer vertices, with
+// Tipsify (Sander et al. 2007). Triangles are fanned around the vertex that
+// is most likely to stay in the cache, and the traversal jumps to a recently
+// used vertex at dead ends. Runs in linear time. The vertices of each
+// triangle keep their order, so the winding does not change. Every index
+// must be less than the vertex count.
+void optimizeVertexCache(uint32_t *indices, size_t indexCount,
+                         uint32_t vertexCount,
+                         uint32_t cacheSize = s_vertexCacheSize);
+} // namespace vulkan_proto
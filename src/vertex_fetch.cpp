@@ -0,0 +1,64 @@
+#include "vertex_fetch.h"
+
+namespace {
+constexpr size_t s_cacheLineSize = 64;
+constexpr size_t s_cacheLineCount = 16 * 1024 / s_cacheLineSize;
+} // namespace
+
+namespace vulkan_proto {
+VertexFetchStatistics analyzeVertexFetch(const uint32_t *indices,
+                                         size_t indexCount,
+                                         uint32_t vertexCount,
+                                         size_t vertexSize) {
+    VertexFetchStatistics statistics;
+
+    // Line held by each slot of the cache, plus one so zero is empty
+    std::vector<uint64_t> cacheLines(s_cacheLineCount, 0);
+    std::vector<bool> used(vertexCount, false);
+    uint32_t usedCount = 0;
+    for (size_t i = 0; i < indexCount; i++) {
+        const uint32_t vertex = indices[i];
+        if (used[vertex] == false) {
+            used[vertex] = true;
+            usedCount++;
+        }
+
+        // A vertex can straddle two lines
+        const uint64_t first = vertex * vertexSize / s_cacheLineSize;
+        const uint64_t last =
+            ((vertex + 1) * vertexSize - 1) / s_cacheLineSize;
+        for (uint64_t line = first; line <= last; line++) {
+            uint64_t &slot = cacheLines[line % s_cacheLineCount];
+            if (slot != line + 1) {
+                slot = line + 1;
+                statistics.bytesFetched += s_cacheLineSize;
+            }
+        }
+    }
+
+    if (usedCount > 0) {
+        statistics.overfetch =
+            static_cast<float>(statistics.bytesFetched) /
+            static_cast<float>(static_cast<uint64_t>(usedCount) * vertexSize);
+    }
+    return statistics;
+}
+
+void optimizeVertexFetch(uint32_t *indices, size_t indexCount,
+                         uint32_t vertexCount, std::vector<uint32_t> &remap) {
+    remap.assign(vertexCount, ~0u);
+    uint32_t nextVertex = 0;
+    for (size_t i = 0; i < indexCount; i++) {
+        uint32_t &vertex = remap[indices[i]];
+        if (vertex == ~0u) {
+            vertex = nextVertex++;
+        }
+        indices[i] = vertex;
+    }
+    for (uint32_t &vertex : remap) {
+        if (vertex == ~0u) {
+            vertex = nextVertex++;
+        }
+    }
+}
+} // namespace vulkan_proto
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "headers.h"
+
+namespace vulkan_proto {
+// Memory traffic of the vertex fetches of an index list, through a direct
+// mapped cache of 16 KB in 64 byte lines. Only the order matters, the sizes
+// are those of a small first level cache.
+struct VertexFetchStatistics {
+    uint64_t bytesFetched = 0;
+    // Fetched per byte of the vertices used, at best 1
+    float overfetch = 0.0f;
+};
+
+VertexFetchStatistics analyzeVertexFetch(const uint32_t *indices,
+                                         size_t indexCount,
+                                         uint32_t vertexCount,
+                                         size_t vertexSize);
+
+// Renumbers the vertices in the order the index list first uses them, so
+// neighbouring triangles fetch neighbouring memory. The indices are
+// rewritten, remap gets the new index of each vertex for moving the vertex
+// data. Vertices the list does not use are moved to the end, in order.
+void optimizeVertexFetch(uint32_t *indices, size_t indexCount,
+                         uint32_t vertexCount, std::vector<uint32_t> &remap);
+} // namespace vulkan_proto
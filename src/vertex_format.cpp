@@ -0,0 +1,83 @@
+#include "vertex_format.h"
+#include <glm/gtc/packing.hpp>
+
+namespace {
+// Matches VK_FORMAT_R16G16B16A16_SNORM & VK_FORMAT_R16G16_SFLOAT
+struct CompactVertex {
+    uint16_t position[4];
+    uint16_t texCoord[2];
+};
+static_assert(sizeof(CompactVertex) == 12, "CompactVertex must be packed");
+
+struct FloatVertex {
+    float position[3];
+    float texCoord[2];
+};
+static_assert(sizeof(FloatVertex) == 20, "FloatVertex must be packed");
+} // namespace
+
+namespace vulkan_proto {
+uint32_t getVertexStride(VertexFormat format) {
+    return format == VertexFormat::Compact ? sizeof(CompactVertex)
+                                           : sizeof(FloatVertex);
+}
+
+void getVertexAttributes(
+    VertexFormat format,
+    std::vector<VkVertexInputAttributeDescription> &attributes) {
+    attributes.resize(2);
+    attributes[0].location = 0;
+    attributes[0].binding = 0;
+    attributes[1].location = 1;
+    attributes[1].binding = 0;
+
+    if (format == VertexFormat::Compact) {
+        attributes[0].format = VK_FORMAT_R16G16B16A16_SNORM;
+        attributes[0].offset = offsetof(CompactVertex, position);
+        attributes[1].format = VK_FORMAT_R16G16_SFLOAT;
+        attributes[1].offset = offsetof(CompactVertex, texCoord);
+    } else {
+        attributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+        attributes[0].offset = offsetof(FloatVertex, position);
+        attributes[1].format = VK_FORMAT_R32G32_SFLOAT;
+        attributes[1].offset = offsetof(FloatVertex, texCoord);
+    }
+}
+
+VertexQuantization getVertexQuantization(VertexFormat format,
+                                         const glm::vec3 &boundingBoxMin,
+                                         const glm::vec3 &boundingBoxMax) {
+    VertexQuantization quantization;
+    if (format == VertexFormat::Compact) {
+        quantization.offset = 0.5f * (boundingBoxMin + boundingBoxMax);
+        quantization.scale = 0.5f * (boundingBoxMax - boundingBoxMin);
+    }
+    return quantization;
+}
+
+void encodeVertex(VertexFormat format, const VertexQuantization &quantization,
+                  const glm::vec3 &position, const glm::vec2 &texCoord,
+                  uint8_t *destination) {
+    if (format == VertexFormat::Float) {
+        const FloatVertex vertex = {{position.x, position.y, position.z},
+                                    {texCoord.x, texCoord.y}};
+        memcpy(destination, &vertex, sizeof(vertex));
+        return;
+    }
+
+    // A flat box has no extent along an axis, every position is the offset
+    const glm::vec3 relative = position - quantization.offset;
+    const glm::vec3 &scale = quantization.scale;
+    const glm::vec4 normalized(scale.x > 0.0f ? relative.x / scale.x : 0.0f,
+                               scale.y > 0.0f ? relative.y / scale.y : 0.0f,
+                               scale.z > 0.0f ? relative.z / scale.z : 0.0f,
+                               0.0f);
+    const uint64_t packedPosition = glm::packSnorm4x16(normalized);
+    const uint32_t packedTexCoord = glm::packHalf2x16(texCoord);
+
+    CompactVertex vertex;
+    memcpy(vertex.position, &packedPosition, sizeof(vertex.position));
+    memcpy(vertex.texCoord, &packedTexCoord, sizeof(vertex.texCoord));
+    memcpy(destination, &vertex, sizeof(vertex));
+}
+} // namespace vulkan_proto
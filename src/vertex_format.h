@@ -0,0 +1,39 @@
+#pragma once
+
+#include "headers.h"
+
+namespace vulkan_proto {
+// Layout of the vertices in the geometry pool, the same for every mesh. The
+// vertex shaders read a position at location 0 and texture coordinates at
+// location 1 either way.
+//
+// Float stores both as 32 bit floats, 20 bytes. Compact stores the position
+// as 16 bit snorm relative to the bounding box of the mesh and the texture
+// coordinates as half floats, 12 bytes. The fourth lane of the position is
+// free, for an octahedral normal once shading needs one.
+enum class VertexFormat { Float, Compact };
+
+// Maps a stored position back to object space as offset + scale * stored,
+// see DrawConstants. The identity for the float format.
+struct VertexQuantization {
+    glm::vec3 offset = glm::vec3(0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+};
+
+uint32_t getVertexStride(VertexFormat format);
+
+// Vertex input of the graphics pipelines, binding 0
+void getVertexAttributes(
+    VertexFormat format,
+    std::vector<VkVertexInputAttributeDescription> &attributes);
+
+// Fits the compact positions to the bounding box, so [-1, 1] covers it
+VertexQuantization getVertexQuantization(VertexFormat format,
+                                         const glm::vec3 &boundingBoxMin,
+                                         const glm::vec3 &boundingBoxMax);
+
+// Writes getVertexStride bytes
+void encodeVertex(VertexFormat format, const VertexQuantization &quantization,
+                  const glm::vec3 &position, const glm::vec2 &texCoord,
+                  uint8_t *destination);
+} // namespace vulkan_proto
@@ -0,0 +1,189 @@
+#include "mesh_codec.h"
+#include "test.h"
+#include <random>
+
+namespace {
+using namespace vulkan_proto;
+
+// Encodes & decodes, true when the vertices come back unchanged. Every
+// shorter encoding must fail to decode.
+bool roundTripVertices(const std::vector<uint8_t> &vertices,
+                       size_t vertexSize, size_t *encodedSize = nullptr) {
+    const size_t vertexCount = vertices.size() / vertexSize;
+    std::vector<uint8_t> encoded;
+    encodeVertexBuffer(vertices.data(), vertexCount, vertexSize, encoded);
+    if (encodedSize) {
+        *encodedSize = encoded.size();
+    }
+
+    std::vector<uint8_t> decoded(vertices.size() + 1, 0xcd);
+    const bool decodes = decodeVertexBuffer(encoded.data(), encoded.size(),
+                                            vertexCount, vertexSize,
+                                            decoded.data());
+    // Nothing is written past the vertices
+    const bool unchanged =
+        std::equal(vertices.begin(), vertices.end(), decoded.begin()) &&
+        decoded.back() == 0xcd;
+    bool truncatedFails = true;
+    for (size_t size = 0; size < encoded.size(); size += 1 + size / 8) {
+        truncatedFails &= !decodeVertexBuffer(encoded.data(), size,
+                                              vertexCount, vertexSize,
+                                              decoded.data());
+    }
+    return decodes && unchanged && truncatedFails;
+}
+
+bool roundTripIndices(const std::vector<uint32_t> &indices,
+                      uint32_t vertexCount) {
+    std::vector<uint8_t> encoded;
+    encodeIndexBuffer(indices.data(), indices.size(), encoded);
+    std::vector<uint32_t> decoded(indices.size());
+    const bool decodes =
+        decodeIndexBuffer(encoded.data(), encoded.size(), indices.size(),
+                          vertexCount, decoded.data());
+    bool truncatedFails = true;
+    for (size_t size = 0; size < encoded.size(); size += 1 + size / 8) {
+        truncatedFails &= !decodeIndexBuffer(
+            encoded.data(), size, indices.size(), vertexCount, decoded.data());
+    }
+    return decodes && decoded == indices && truncatedFails;
+}
+
+// Bytes whose difference to the previous one repeats with the period, so
+// the delta streams are long matches overlapping themselves
+std::vector<uint8_t> createPeriodicBytes(size_t size, size_t period,
+                                         uint32_t seed) {
+    std::mt19937 random(seed);
+    std::vector<uint8_t> deltas(period);
+    for (auto &delta : deltas) {
+        delta = static_cast<uint8_t>(random());
+    }
+    std::vector<uint8_t> bytes(size);
+    uint8_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        value = static_cast<uint8_t>(value + deltas[i % period]);
+        bytes[i] = value;
+    }
+    return bytes;
+}
+} // namespace
+
+TEST(vertexCodecOverlappingMatches) {
+    // Shorter & longer than the 16 byte copies of the decoder, and matches
+    // beyond the 15 + 255 of one length byte
+    for (const size_t period : {1, 2, 3, 7, 15, 16, 17, 20, 33}) {
+        for (const size_t vertexSize : {1, 3, 12, 32}) {
+            const auto vertices =
+                createPeriodicBytes(1000 * vertexSize, period, 1);
+            CHECK(roundTripVertices(vertices, vertexSize));
+        }
+    }
+}
+
+TEST(vertexCodecLiterals) {
+    // Random bytes do not compress, every length is a literal run
+    std::mt19937 random(2);
+    for (const size_t vertexCount : {1, 15, 16, 17, 255, 256, 257, 3000}) {
+        for (const size_t vertexSize : {4, 5, 12, 20, 64}) {
+            std::vector<uint8_t> vertices(vertexCount * vertexSize);
+            for (auto &byte : vertices) {
+                byte = static_cast<uint8_t>(random());
+            }
+            CHECK(roundTripVertices(vertices, vertexSize));
+        }
+    }
+}
+
+TEST(vertexCodecMixed) {
+    // Literal runs & matches of every length take turns
+    std::mt19937 random(3);
+    std::vector<uint8_t> vertices;
+    while (vertices.size() < 50000) {
+        const size_t runLength = random() % 600;
+        const uint8_t value = static_cast<uint8_t>(random());
+        const bool repeat = random() % 2 == 0;
+        for (size_t i = 0; i < runLength; i++) {
+            vertices.push_back(repeat ? value
+                                      : static_cast<uint8_t>(random()));
+        }
+    }
+    vertices.resize(50000 / 12 * 12);
+    CHECK(roundTripVertices(vertices, 12));
+    CHECK(roundTripVertices(vertices, 4));
+}
+
+TEST(vertexCodecEmpty) {
+    CHECK(roundTripVertices(std::vector<uint8_t>(), 12));
+}
+
+TEST(vertexCodecCompresses) {
+    // A grid in vertex order changes by a little from vertex to vertex
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    createGrid(100, 100, positions, indices);
+    std::vector<uint8_t> vertices(positions.size() * 4);
+    for (size_t i = 0; i < positions.size(); i++) {
+        const uint16_t x = static_cast<uint16_t>(positions[i].x * 100.0f);
+        const uint16_t y = static_cast<uint16_t>(positions[i].y * 100.0f);
+        memcpy(&vertices[4 * i], &x, sizeof(x));
+        memcpy(&vertices[4 * i + 2], &y, sizeof(y));
+    }
+    size_t encodedSize = 0;
+    CHECK(roundTripVertices(vertices, 4, &encodedSize));
+    CHECK(encodedSize < vertices.size() / 4);
+}
+
+TEST(vertexCodecCorruption) {
+    // Corrupt data may decode to other vertices, but never out of bounds
+    const auto vertices = createPeriodicBytes(12 * 500, 7, 4);
+    std::vector<uint8_t> encoded;
+    encodeVertexBuffer(vertices.data(), 500, 12, encoded);
+    std::vector<uint8_t> decoded(vertices.size());
+    std::mt19937 random(5);
+    for (uint32_t i = 0; i < 1000; i++) {
+        std::vector<uint8_t> corrupt = encoded;
+        corrupt[random() % corrupt.size()] ^=
+            static_cast<uint8_t>(1 + random() % 255);
+        decodeVertexBuffer(corrupt.data(), corrupt.size(), 500, 12,
+                           decoded.data());
+    }
+    // A different vertex size does not match the encoded size
+    CHECK(!decodeVertexBuffer(encoded.data(), encoded.size(), 500, 16,
+                              decoded.data()));
+}
+
+TEST(indexCodecDeltas) {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    createGrid(64, 64, positions, indices);
+    const uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+    CHECK(roundTripIndices(indices, vertexCount));
+    shuffleTriangles(indices, 6);
+    CHECK(roundTripIndices(indices, vertexCount));
+
+    // Negative deltas, and the largest ones both ways, which take all five
+    // 7 bit groups
+    const uint32_t largest = std::numeric_limits<uint32_t>::max();
+    CHECK(roundTripIndices({5, 4, 3, 0, 2, 1}, 6));
+    CHECK(roundTripIndices({0, largest - 1, 0, largest - 1, 1, 0}, largest));
+    CHECK(roundTripIndices({1u << 31, 0, 1u << 31, (1u << 31) - 1}, largest));
+    CHECK(roundTripIndices({}, 0));
+}
+
+TEST(indexCodecRange) {
+    // Every index must be below the vertex count
+    const std::vector<uint32_t> indices = {0, 1, 2, 2, 1, 3};
+    std::vector<uint8_t> encoded;
+    encodeIndexBuffer(indices.data(), indices.size(), encoded);
+    std::vector<uint32_t> decoded(indices.size());
+    CHECK(decodeIndexBuffer(encoded.data(), encoded.size(), indices.size(), 4,
+                            decoded.data()));
+    CHECK(!decodeIndexBuffer(encoded.data(), encoded.size(), indices.size(),
+                             3, decoded.data()));
+    // Fewer indices leave bytes over, more run out
+    CHECK(!decodeIndexBuffer(encoded.data(), encoded.size(),
+                             indices.size() - 1, 4, decoded.data()));
+    decoded.resize(indices.size() + 1);
+    CHECK(!decodeIndexBuffer(encoded.data(), encoded.size(),
+                             indices.size() + 1, 4, decoded.data()));
+}
@@ -0,0 +1,156 @@
+#include "obj_loader.h"
+#include "test.h"
+
+namespace {
+using namespace vulkan_proto;
+
+// Writes the OBJ text to a temporary file & parses it
+struct ObjFile {
+    std::string path;
+
+    explicit ObjFile(const std::string &text) {
+        static uint32_t fileCount = 0;
+        path = (std::filesystem::temp_directory_path() /
+                ("vupro_test_" + std::to_string(fileCount++) + ".obj"))
+                   .string();
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << text;
+    }
+    ~ObjFile() { std::remove(path.c_str()); }
+
+    bool load(ObjMesh &mesh, uint32_t threadCount = 1,
+              size_t minChunkSize = s_minObjChunkSize) const {
+        try {
+            loadObj(path.c_str(), threadCount, mesh, minChunkSize);
+            return true;
+        } catch (const std::exception &) {
+            return false;
+        }
+    }
+};
+
+bool equals(const ObjMesh &a, const ObjMesh &b) {
+    if (a.positions != b.positions || a.texCoords != b.texCoords ||
+        a.indices.size() != b.indices.size() ||
+        a.concavePolygonCount != b.concavePolygonCount) {
+        return false;
+    }
+    for (size_t i = 0; i < a.indices.size(); i++) {
+        if (a.indices[i].position != b.indices[i].position ||
+            a.indices[i].texCoord != b.indices[i].texCoord) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<int32_t> getPositionIndices(const ObjMesh &mesh) {
+    std::vector<int32_t> indices;
+    for (const auto &index : mesh.indices) {
+        indices.push_back(index.position);
+    }
+    return indices;
+}
+} // namespace
+
+TEST(objCorners) {
+    const ObjFile file("# comment\n"
+                       "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+                       "vt 0 0\nvt 1 0\nvt 1 1\n"
+                       "vn 0 0 1\n"
+                       "f 1/1/1 2/2/1 3/3/1\r\n"
+                       "f 1//1 3//1 4//1\n"
+                       "g group\nusemtl material\n"
+                       "f 4 1/1 3\n");
+    ObjMesh mesh;
+    CHECK(file.load(mesh));
+    CHECK(mesh.positions.size() == 4 && mesh.texCoords.size() == 3);
+    CHECK(mesh.positions[2] == glm::vec3(1.0f, 1.0f, 0.0f));
+    CHECK(mesh.texCoords[2] == glm::vec2(1.0f, 1.0f));
+    CHECK(getPositionIndices(mesh) ==
+          std::vector<int32_t>({0, 1, 2, 0, 2, 3, 3, 0, 2}));
+    CHECK(mesh.indices[2].texCoord == 2 && mesh.indices[3].texCoord == -1 &&
+          mesh.indices[7].texCoord == 0 && mesh.indices[8].texCoord == -1);
+}
+
+TEST(objNegativeIndices) {
+    // Relative to the attributes so far, not to all of them
+    const ObjFile file("v 0 0 0\nv 1 0 0\nv 1 1 0\nvt 0 0\nvt 1 1\n"
+                       "f -3/-2 -2/-1 -1\n"
+                       "v 0 1 0\n"
+                       "f -4 -2 -1\n");
+    ObjMesh mesh;
+    CHECK(file.load(mesh));
+    CHECK(getPositionIndices(mesh) ==
+          std::vector<int32_t>({0, 1, 2, 0, 2, 3}));
+    CHECK(mesh.indices[0].texCoord == 0 && mesh.indices[1].texCoord == 1);
+}
+
+TEST(objChunkMerge) {
+    // Every face refers back to vertices several chunks earlier, both ways
+    std::string text;
+    for (uint32_t i = 0; i < 300; i++) {
+        text += "v " + std::to_string(i) + " 0 0\nvt 0 " +
+                std::to_string(i) + "\n";
+        if (i >= 20) {
+            text += "f -20/-20 -1/-1 " + std::to_string(i - 9) + "/" +
+                    std::to_string(i - 9) + "\n";
+        }
+    }
+    const ObjFile file(text);
+    ObjMesh single;
+    CHECK(file.load(single));
+    CHECK(single.indices.size() == 3 * 280);
+    bool resolved = true;
+    for (uint32_t face = 0; face < 280; face++) {
+        const uint32_t i = face + 20;
+        const ObjMesh::Index *corners = &single.indices[3 * face];
+        resolved &= corners[0].position == static_cast<int32_t>(i - 19) &&
+                    corners[1].position == static_cast<int32_t>(i) &&
+                    corners[2].position == static_cast<int32_t>(i - 10) &&
+                    corners[0].texCoord == corners[0].position &&
+                    corners[1].texCoord == corners[1].position;
+    }
+    CHECK(resolved);
+
+    // Chunks of a few hundred bytes, and more threads than lines
+    for (const uint32_t threadCount : {2u, 7u, 64u, 2000u}) {
+        ObjMesh chunked;
+        CHECK(file.load(chunked, threadCount, 1));
+        CHECK(equals(chunked, single));
+    }
+}
+
+TEST(objOutOfRange) {
+    ObjMesh mesh;
+    const char *base = "v 0 0 0\nv 1 0 0\nv 1 1 0\nvt 0 0\n";
+    // Past the last attribute, before the first, zero & not a number
+    for (const char *face :
+         {"f 1 2 4\n", "f 1 2 -4\n", "f 1/2 2 3\n", "f 1/-2 2 3\n",
+          "f 0 1 2\n", "f 1/0 2 3\n", "f 1 2 x\n", "f 1 2 3x\n"}) {
+        const ObjFile file(std::string(base) + face);
+        CHECK(!file.load(mesh));
+        CHECK(!file.load(mesh, 4, 1));
+    }
+    // A negative index before the chunk, but after the first vertex, is fine
+    const ObjFile file(std::string(base) + "\n\n\n\n\n\n\n\nf -3 -2 -1\n");
+    CHECK(file.load(mesh, 4, 1));
+    CHECK(getPositionIndices(mesh) == std::vector<int32_t>({0, 1, 2}));
+}
+
+TEST(objPolygons) {
+    // A convex quad & pentagon, and an arrow head that is concave at the
+    // second corner, so its fan folds over
+    const ObjFile file("v 0 0 0\nv 2 0 0\nv 2 2 0\nv 0 2 0\nv 1 3 0\n"
+                       "f 1 2 3 4\n"
+                       "f 1 2 3 5 4\n"
+                       "v 0 0 1\nv 1 1 1\nv 2 0 1\nv 1 3 1\n"
+                       "f 6 7 8 9\n");
+    ObjMesh mesh;
+    CHECK(file.load(mesh));
+    CHECK(mesh.indices.size() == 3 * (2 + 3 + 2));
+    CHECK(getPositionIndices(mesh) ==
+          std::vector<int32_t>({0, 1, 2, 0, 2, 3, 0, 1, 2, 0, 2, 4, 0, 4, 3,
+                                5, 6, 7, 5, 7, 8}));
+    CHECK(mesh.concavePolygonCount == 1);
+}
@@ -0,0 +1,42 @@
+#include "overdraw.h"
+#include "test.h"
+#include "vertex_cache.h"
+
+namespace {
+using namespace vulkan_proto;
+
+float getAcmr(const std::vector<uint32_t> &indices, size_t vertexCount) {
+    return analyzeVertexCache(indices.data(), indices.size(),
+                              static_cast<uint32_t>(vertexCount))
+        .acmr;
+}
+} // namespace
+
+TEST(overdrawAcmr) {
+    // The torus hides parts of itself in the views along x & y
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    createTorus(96, 48, positions, indices);
+    const uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+    shuffleTriangles(indices, 7);
+    optimizeVertexCache(indices.data(), indices.size(), vertexCount);
+    const auto triangles = getSortedTriangles(indices);
+    const float cacheAcmr = getAcmr(indices, vertexCount);
+    const OverdrawStatistics cacheOverdraw =
+        estimateOverdraw(indices.data(), indices.size(), positions);
+
+    for (const float threshold : {1.0f, s_overdrawThreshold, 1.5f}) {
+        std::vector<uint32_t> sorted = indices;
+        optimizeOverdraw(sorted.data(), sorted.size(), positions.data(),
+                         vertexCount, threshold);
+        const OverdrawStatistics overdraw =
+            estimateOverdraw(sorted.data(), sorted.size(), positions);
+        CHECK(getAcmr(sorted, vertexCount) <= threshold * cacheAcmr);
+        CHECK(overdraw.overdraw <= cacheOverdraw.overdraw);
+        if (threshold > 1.0f) {
+            CHECK(overdraw.overdraw < 0.9f * cacheOverdraw.overdraw);
+        }
+        CHECK(overdraw.coveredPixels == cacheOverdraw.coveredPixels);
+        CHECK(getSortedTriangles(sorted) == triangles);
+    }
+}
@@ -0,0 +1,109 @@
+#include "simplifier.h"
+#include "test.h"
+
+namespace {
+using namespace vulkan_proto;
+
+glm::vec3 getTriangleNormal(const std::vector<glm::vec3> &positions,
+                            const uint32_t *triangle) {
+    const glm::vec3 &a = positions[triangle[0]];
+    return glm::cross(positions[triangle[1]] - a, positions[triangle[2]] - a);
+}
+
+// Area weighted normals of the vertices of the input
+std::vector<glm::vec3>
+getVertexNormals(const std::vector<glm::vec3> &positions,
+                 const std::vector<uint32_t> &indices) {
+    std::vector<glm::vec3> normals(positions.size(), glm::vec3(0.0f));
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        const glm::vec3 normal = getTriangleNormal(positions, &indices[i]);
+        for (size_t corner = 0; corner < 3; corner++) {
+            normals[indices[i + corner]] += normal;
+        }
+    }
+    return normals;
+}
+} // namespace
+
+TEST(simplifierGridBorder) {
+    // The grid is flat, so it collapses without error, but its open border
+    // keeps every vertex and the grid keeps its area
+    const uint32_t size = 16;
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    createGrid(size, size, positions, indices);
+
+    std::vector<uint32_t> result;
+    const float error =
+        simplifyMesh(positions, indices, indices.size() / 4, result);
+    CHECK(!result.empty() && result.size() % 3 == 0);
+    CHECK(result.size() < indices.size() / 2);
+    CHECK(error < 1e-3f);
+
+    std::vector<bool> used(positions.size(), false);
+    float area = 0.0f;
+    for (size_t i = 0; i < result.size(); i += 3) {
+        for (size_t corner = 0; corner < 3; corner++) {
+            used[result[i + corner]] = true;
+        }
+        const glm::vec3 normal = getTriangleNormal(positions, &result[i]);
+        CHECK(normal.z > 0.0f);
+        area += 0.5f * normal.z;
+    }
+    CHECK(std::abs(area - size * size) < 1e-3f);
+    for (size_t i = 0; i < positions.size(); i++) {
+        const glm::vec3 &position = positions[i];
+        if (position.x == 0.0f || position.y == 0.0f ||
+            position.x == size || position.y == size) {
+            CHECK(used[i]);
+        }
+    }
+}
+
+TEST(simplifierTorus) {
+    // Closed, so it reaches the target, and the normals of what is left
+    // still agree with those of the input around it
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    createTorus(48, 24, positions, indices);
+    const std::vector<glm::vec3> normals = getVertexNormals(positions, indices);
+
+    for (const size_t target : {indices.size() / 2, indices.size() / 8}) {
+        std::vector<uint32_t> result;
+        const float error = simplifyMesh(positions, indices, target, result);
+        CHECK(!result.empty() && result.size() % 3 == 0);
+        CHECK(result.size() <= target);
+        CHECK(error > 0.0f && error < 0.1f);
+
+        uint32_t flippedCount = 0;
+        for (size_t i = 0; i < result.size(); i += 3) {
+            const glm::vec3 inputNormal = normals[result[i]] +
+                                          normals[result[i + 1]] +
+                                          normals[result[i + 2]];
+            const glm::vec3 normal = getTriangleNormal(positions, &result[i]);
+            flippedCount += glm::dot(normal, inputNormal) <= 0.0f ? 1 : 0;
+        }
+        CHECK(flippedCount == 0);
+    }
+}
+
+TEST(simplifierLodChain) {
+    // Like Mesh::load, every level halves the previous one but starts from
+    // the full mesh, so its error only grows along the chain
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    createTorus(96, 48, positions, indices);
+
+    size_t indexCount = indices.size();
+    float previousError = 0.0f;
+    std::vector<uint32_t> result;
+    for (uint32_t lod = 1; lod < 6; lod++) {
+        const float error =
+            simplifyMesh(positions, indices, indexCount / 6 * 3, result);
+        CHECK(result.size() < indexCount);
+        CHECK(error >= previousError);
+        indexCount = result.size();
+        previousError = error;
+    }
+    CHECK(previousError > 0.0f);
+}
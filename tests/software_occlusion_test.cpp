@@ -0,0 +1,55 @@
+#include "software_occlusion.h"
+#include "test.h"
+
+namespace {
+using namespace vulkan_proto;
+
+// A square in the xy plane at the depth, seen through the identity, so
+// world space is clip space
+void addSquare(SoftwareOcclusion &occlusion, float halfSize, float depth) {
+    const std::vector<glm::vec3> positions = {
+        {-halfSize, -halfSize, depth},
+        {halfSize, -halfSize, depth},
+        {halfSize, halfSize, depth},
+        {-halfSize, halfSize, depth}};
+    occlusion.addOccluder(positions, {0, 1, 2, 0, 2, 3}, glm::mat4(1.0f));
+}
+} // namespace
+
+TEST(softwareOcclusion) {
+    for (const uint32_t threadCount : {1u, 3u, 0u}) {
+        SoftwareOcclusion occlusion;
+        occlusion.create(true, 100, 60, threadCount);
+        CHECK(occlusion.m_width == 104 && occlusion.m_height == 64);
+        addSquare(occlusion, 0.5f, 0.5f);
+        occlusion.render(glm::mat4(1.0f));
+        CHECK(occlusion.getTriangleCount() == 2);
+
+        const glm::vec3 extent(0.1f);
+        // Behind the square
+        CHECK(occlusion.isOccluded(glm::vec3(0.0f, 0.0f, 0.8f), extent));
+        CHECK(occlusion.isOccluded(glm::vec3(0.35f, -0.35f, 0.8f), extent));
+        // In front, straddling it, beside it or partly beside it
+        CHECK(!occlusion.isOccluded(glm::vec3(0.0f, 0.0f, 0.2f), extent));
+        CHECK(!occlusion.isOccluded(glm::vec3(0.0f, 0.0f, 0.5f), extent));
+        CHECK(!occlusion.isOccluded(glm::vec3(0.8f, 0.0f, 0.8f), extent));
+        CHECK(!occlusion.isOccluded(glm::vec3(0.45f, 0.0f, 0.8f), extent));
+
+        // The workers are woken once per render. The boxes move with the
+        // square, but a band left from the previous matrix would get one of
+        // them wrong.
+        for (uint32_t frame = 1; frame < 6; frame++) {
+            glm::mat4 viewProjection(1.0f);
+            viewProjection[3][0] = frame % 2 == 1 ? -0.7f : 0.0f;
+            occlusion.render(viewProjection);
+            CHECK(occlusion.isOccluded(glm::vec3(0.0f, 0.0f, 0.8f), extent));
+            CHECK(!occlusion.isOccluded(glm::vec3(0.45f, 0.0f, 0.8f), extent));
+        }
+
+        // Workers are restarted by creating again
+        occlusion.create(true, 100, 60, threadCount);
+        occlusion.render(glm::mat4(1.0f));
+        CHECK(occlusion.isOccluded(glm::vec3(0.0f, 0.0f, 0.8f), extent));
+        occlusion.destroy();
+    }
+}
@@ -0,0 +1,113 @@
+#include "test.h"
+#include <random>
+
+namespace {
+uint32_t s_failureCount = 0;
+} // namespace
+
+namespace vulkan_proto {
+std::vector<TestCase> &getTestCases() {
+    // Constructed on first use, the registrations run before main
+    static std::vector<TestCase> testCases;
+    return testCases;
+}
+
+void reportFailure(const char *condition, const char *fileName, int line) {
+    printf("%s:%d: CHECK(%s) failed\n", fileName, line, condition);
+    s_failureCount++;
+}
+
+void createGrid(uint32_t width, uint32_t height,
+                std::vector<glm::vec3> &positions,
+                std::vector<uint32_t> &indices) {
+    positions.clear();
+    indices.clear();
+    for (uint32_t y = 0; y <= height; y++) {
+        for (uint32_t x = 0; x <= width; x++) {
+            positions.emplace_back(static_cast<float>(x),
+                                   static_cast<float>(y), 0.0f);
+        }
+    }
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            const uint32_t corner = y * (width + 1) + x;
+            indices.insert(indices.end(),
+                           {corner, corner + 1, corner + width + 2, corner,
+                            corner + width + 2, corner + width + 1});
+        }
+    }
+}
+
+void createTorus(uint32_t rings, uint32_t sides,
+                 std::vector<glm::vec3> &positions,
+                 std::vector<uint32_t> &indices) {
+    const float pi = 3.14159265f;
+    positions.clear();
+    indices.clear();
+    for (uint32_t ring = 0; ring < rings; ring++) {
+        const float u = 2.0f * pi * ring / rings;
+        for (uint32_t side = 0; side < sides; side++) {
+            const float v = 2.0f * pi * side / sides;
+            const float radius = 1.0f + 0.4f * std::cos(v);
+            positions.emplace_back(radius * std::cos(u), radius * std::sin(u),
+                                   0.4f * std::sin(v));
+        }
+    }
+    for (uint32_t ring = 0; ring < rings; ring++) {
+        const uint32_t nextRing = (ring + 1) % rings;
+        for (uint32_t side = 0; side < sides; side++) {
+            const uint32_t nextSide = (side + 1) % sides;
+            const uint32_t a = ring * sides + side;
+            const uint32_t b = nextRing * sides + side;
+            const uint32_t c = nextRing * sides + nextSide;
+            const uint32_t d = ring * sides + nextSide;
+            indices.insert(indices.end(), {a, b, c, a, c, d});
+        }
+    }
+}
+
+void shuffleTriangles(std::vector<uint32_t> &indices, uint32_t seed) {
+    std::vector<uint32_t> order(indices.size() / 3);
+    for (uint32_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), std::mt19937(seed));
+
+    std::vector<uint32_t> shuffled;
+    shuffled.reserve(indices.size());
+    for (const auto triangle : order) {
+        shuffled.insert(shuffled.end(), indices.begin() + 3 * triangle,
+                        indices.begin() + 3 * triangle + 3);
+    }
+    indices.swap(shuffled);
+}
+
+std::vector<std::array<uint32_t, 3>>
+getSortedTriangles(const std::vector<uint32_t> &indices) {
+    std::vector<std::array<uint32_t, 3>> triangles;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        std::array<uint32_t, 3> triangle = {indices[i], indices[i + 1],
+                                            indices[i + 2]};
+        // Rotated, not sorted, so the winding is compared too
+        while (triangle[0] > triangle[1] || triangle[0] > triangle[2]) {
+            std::rotate(triangle.begin(), triangle.begin() + 1,
+                        triangle.end());
+        }
+        triangles.push_back(triangle);
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+} // namespace vulkan_proto
+
+int main() {
+    for (const auto &testCase : vulkan_proto::getTestCases()) {
+        const uint32_t failureCount = s_failureCount;
+        testCase.function();
+        printf("%s %s\n", failureCount == s_failureCount ? "passed" : "FAILED",
+               testCase.name);
+    }
+    printf("%zu tests, %u failed checks\n",
+           vulkan_proto::getTestCases().size(), s_failureCount);
+    return s_failureCount == 0 ? 0 : 1;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "headers.h"
+
+namespace vulkan_proto {
+// A small test runner for the parts that run without a GPU. TEST defines &
+// registers a test, a failed CHECK is reported & fails the run but the test
+// goes on.
+struct TestCase {
+    const char *name = nullptr;
+    void (*function)() = nullptr;
+};
+
+std::vector<TestCase> &getTestCases();
+void reportFailure(const char *condition, const char *fileName, int line);
+
+struct TestRegistration {
+    TestRegistration(const char *name, void (*function)()) {
+        getTestCases().push_back({name, function});
+    }
+};
+
+// Meshes the tests process. The grid lies in the xy plane, the torus has
+// the z axis through its hole, so it hides parts of itself from the side.
+void createGrid(uint32_t width, uint32_t height,
+                std::vector<glm::vec3> &positions,
+                std::vector<uint32_t> &indices);
+void createTorus(uint32_t rings, uint32_t sides,
+                 std::vector<glm::vec3> &positions,
+                 std::vector<uint32_t> &indices);
+// Reorders the triangles, each keeps its winding
+void shuffleTriangles(std::vector<uint32_t> &indices, uint32_t seed);
+// Triangles with their smallest index first, sorted, for comparing the
+// triangles of two index lists regardless of their order
+std::vector<std::array<uint32_t, 3>>
+getSortedTriangles(const std::vector<uint32_t> &indices);
+} // namespace vulkan_proto
+
+#define TEST(name)                                                             \
+    static void name();                                                        \
+    static const vulkan_proto::TestRegistration name##Registration(#name,      \
+                                                                   name);      \
+    static void name()
+
+#define CHECK(condition)                                                       \
+    ((condition) ? (void)0                                                     \
+                 : vulkan_proto::reportFailure(#condition, __FILE__,           \
+                                               __LINE__))
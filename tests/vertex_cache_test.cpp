@@ -0,0 +1,41 @@
+#include "test.h"
+#include "vertex_cache.h"
+
+namespace {
+using namespace vulkan_proto;
+
+float getAcmr(const std::vector<uint32_t> &indices, size_t vertexCount) {
+    return analyzeVertexCache(indices.data(), indices.size(),
+                              static_cast<uint32_t>(vertexCount))
+        .acmr;
+}
+} // namespace
+
+TEST(tipsifyAcmr) {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    for (uint32_t mesh = 0; mesh < 2; mesh++) {
+        if (mesh == 0) {
+            createGrid(64, 64, positions, indices);
+        } else {
+            createTorus(96, 48, positions, indices);
+        }
+        const uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+        const auto triangles = getSortedTriangles(indices);
+
+        // From the generated order, a shuffled one & its own output
+        std::vector<uint32_t> shuffled = indices;
+        shuffleTriangles(shuffled, mesh);
+        for (auto *list : {&indices, &shuffled}) {
+            const float before = getAcmr(*list, vertexCount);
+            optimizeVertexCache(list->data(), list->size(), vertexCount);
+            const float after = getAcmr(*list, vertexCount);
+            CHECK(after <= before);
+            CHECK(after < 0.8f);
+            CHECK(getSortedTriangles(*list) == triangles);
+
+            optimizeVertexCache(list->data(), list->size(), vertexCount);
+            CHECK(getAcmr(*list, vertexCount) <= after);
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#include "test.h"
+#include "vertex_cache.h"
+#include "vertex_fetch.h"
+
+using namespace vulkan_proto;
+
+TEST(vertexFetchOrder) {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    createTorus(96, 48, positions, indices);
+    const uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+    shuffleTriangles(indices, 8);
+    optimizeVertexCache(indices.data(), indices.size(), vertexCount);
+    const std::vector<uint32_t> original = indices;
+    const VertexFetchStatistics before =
+        analyzeVertexFetch(indices.data(), indices.size(), vertexCount, 12);
+
+    std::vector<uint32_t> remap;
+    optimizeVertexFetch(indices.data(), indices.size(), vertexCount, remap);
+    const VertexFetchStatistics after =
+        analyzeVertexFetch(indices.data(), indices.size(), vertexCount, 12);
+    CHECK(after.bytesFetched <= before.bytesFetched);
+    CHECK(after.overfetch >= 1.0f);
+
+    // A permutation, which the indices follow
+    std::vector<uint32_t> sortedRemap = remap;
+    std::sort(sortedRemap.begin(), sortedRemap.end());
+    bool permutation = sortedRemap.size() == vertexCount;
+    for (uint32_t i = 0; permutation && i < vertexCount; i++) {
+        permutation = sortedRemap[i] == i;
+    }
+    CHECK(permutation);
+    bool remapped = true;
+    for (size_t i = 0; i < indices.size(); i++) {
+        remapped &= indices[i] == remap[original[i]];
+    }
+    CHECK(remapped);
+}
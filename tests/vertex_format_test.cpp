@@ -0,0 +1,89 @@
+#include "test.h"
+#include "vertex_format.h"
+#include <glm/gtc/packing.hpp>
+#include <random>
+
+namespace {
+using namespace vulkan_proto;
+
+// What the vertex shader reads from a compact vertex, see encodeVertex
+void decodeCompactVertex(const VertexQuantization &quantization,
+                         const uint8_t *source, glm::vec3 &position,
+                         glm::vec2 &texCoord) {
+    uint64_t packedPosition = 0;
+    uint32_t packedTexCoord = 0;
+    memcpy(&packedPosition, source, sizeof(packedPosition));
+    memcpy(&packedTexCoord, source + sizeof(packedPosition),
+           sizeof(packedTexCoord));
+    const glm::vec4 normalized = glm::unpackSnorm4x16(packedPosition);
+    position = quantization.offset +
+               quantization.scale *
+                   glm::vec3(normalized.x, normalized.y, normalized.z);
+    texCoord = glm::unpackHalf2x16(packedTexCoord);
+}
+} // namespace
+
+TEST(compactVertexErrorBounds) {
+    // Extents far apart, and a flat axis
+    const glm::vec3 boundingBoxMin(-3.0f, 0.0f, 2.0f);
+    const glm::vec3 boundingBoxMax(5.0f, 0.01f, 2.0f);
+    const VertexQuantization quantization = getVertexQuantization(
+        VertexFormat::Compact, boundingBoxMin, boundingBoxMax);
+    CHECK(getVertexStride(VertexFormat::Compact) == 12);
+
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for (uint32_t i = 0; i < 10000; i++) {
+        glm::vec3 position;
+        for (int axis = 0; axis < 3; axis++) {
+            position[axis] =
+                boundingBoxMin[axis] +
+                unit(random) * (boundingBoxMax[axis] - boundingBoxMin[axis]);
+        }
+        // The corners are exact
+        if (i < 8) {
+            position = glm::vec3(i & 1 ? boundingBoxMax.x : boundingBoxMin.x,
+                                 i & 2 ? boundingBoxMax.y : boundingBoxMin.y,
+                                 i & 4 ? boundingBoxMax.z : boundingBoxMin.z);
+        }
+        const glm::vec2 texCoord(unit(random), 2.0f * unit(random) - 0.5f);
+
+        uint8_t stored[12];
+        encodeVertex(VertexFormat::Compact, quantization, position, texCoord,
+                     stored);
+        glm::vec3 decodedPosition;
+        glm::vec2 decodedTexCoord;
+        decodeCompactVertex(quantization, stored, decodedPosition,
+                            decodedTexCoord);
+
+        // Half a step of the 16 bit snorm, plus float rounding
+        for (int axis = 0; axis < 3; axis++) {
+            const float step = quantization.scale[axis] / 32767.0f;
+            const float error =
+                std::abs(decodedPosition[axis] - position[axis]);
+            CHECK(error <= 0.5f * step + 1e-6f);
+        }
+        // Half a unit in the last place of the 11 bit significand
+        for (int axis = 0; axis < 2; axis++) {
+            const float error =
+                std::abs(decodedTexCoord[axis] - texCoord[axis]);
+            CHECK(error <= std::abs(texCoord[axis]) / 2048.0f + 1e-7f);
+        }
+    }
+}
+
+TEST(floatVertexExact) {
+    const VertexQuantization quantization = getVertexQuantization(
+        VertexFormat::Float, glm::vec3(-1.0f), glm::vec3(1.0f));
+    CHECK(quantization.offset == glm::vec3(0.0f));
+    CHECK(quantization.scale == glm::vec3(1.0f));
+    CHECK(getVertexStride(VertexFormat::Float) == 20);
+
+    const glm::vec3 position(0.1f, -7.25f, 1e6f);
+    const glm::vec2 texCoord(0.3f, 1.7f);
+    float stored[5];
+    encodeVertex(VertexFormat::Float, quantization, position, texCoord,
+                 reinterpret_cast<uint8_t *>(stored));
+    CHECK(glm::vec3(stored[0], stored[1], stored[2]) == position);
+    CHECK(glm::vec2(stored[3], stored[4]) == texCoord);
+}